@@ -13,6 +13,7 @@
 #include "../ECS/EntityManager.h"
 
 #include "FixedUpdate.h"
+#include "Memory/AllocatorRegistry.h"
 
 #include "../Physics/PhysicsSystem.h"
 
@@ -268,6 +269,7 @@ int Engine::Run()
     while (m_running) {
         m_timerMaster.Tick();
         m_inputStateManager.Tick();
+        AllocatorRegistry::Get().BeginFrame();
 
         const ImGuiIO &imguiIO = ImGui::GetIO();
         if (imguiIO.WantCaptureKeyboard || imguiIO.WantCaptureMouse) {
@@ -0,0 +1,142 @@
+#include "AllocatorRegistry.h"
+
+#include "../../JsonCpp/json.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+namespace Farlor {
+
+AllocatorRegistry& AllocatorRegistry::Get()
+{
+    static AllocatorRegistry registry;
+    return registry;
+}
+
+AllocatorRegistry::AllocatorRegistry()
+    : m_samplingEnabled(false)
+    , m_numSampledFrames(0)
+{
+}
+
+void AllocatorRegistry::Register(const std::string& name, Allocator& allocator,
+    const Allocator* pParent)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assert(std::none_of(m_entries.begin(), m_entries.end(),
+        [&](const Entry& entry) { return entry.pAllocator == &allocator; })
+        && "Allocator registered twice");
+
+    Entry entry = {};
+    entry.pAllocator = &allocator;
+    entry.pParent = pParent;
+    entry.stats.m_name = name;
+    UpdateEntry(entry);
+    entry.lastTotalAllocations = entry.stats.m_totalAllocations;
+    m_entries.push_back(entry);
+}
+
+void AllocatorRegistry::Unregister(const Allocator& allocator)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+        [&](const Entry& entry) { return entry.pAllocator == &allocator; }), m_entries.end());
+}
+
+void AllocatorRegistry::SetSamplingEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (enabled && !m_samplingEnabled)
+    {
+        // Allocations made while sampling was off should not land in the first sampled frame
+        for (Entry& entry : m_entries)
+        {
+            UpdateEntry(entry);
+            entry.lastTotalAllocations = entry.stats.m_totalAllocations;
+        }
+    }
+    m_samplingEnabled = enabled;
+}
+
+std::vector<AllocatorStats> AllocatorRegistry::Snapshot()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<AllocatorStats> snapshot;
+    snapshot.reserve(m_entries.size());
+    for (Entry& entry : m_entries)
+    {
+        UpdateEntry(entry);
+        entry.stats.m_fragmentation = entry.pAllocator->GetFragmentation();
+        entry.stats.m_parentName.clear();
+        for (const Entry& parentEntry : m_entries)
+        {
+            if (parentEntry.pAllocator == entry.pParent)
+                entry.stats.m_parentName = parentEntry.stats.m_name;
+        }
+        snapshot.push_back(entry.stats);
+    }
+    return snapshot;
+}
+
+std::string AllocatorRegistry::ToJson()
+{
+    Json::Value root;
+    root["sampledFrames"] = Json::UInt64(m_numSampledFrames);
+    root["allocators"] = Json::Value(Json::arrayValue);
+    for (const AllocatorStats& stats : Snapshot())
+    {
+        Json::Value allocatorValue;
+        allocatorValue["name"] = stats.m_name;
+        allocatorValue["parent"] = stats.m_parentName;
+        allocatorValue["capacity"] = Json::UInt64(stats.m_capacity);
+        allocatorValue["used"] = Json::UInt64(stats.m_usedMemory);
+        allocatorValue["peak"] = Json::UInt64(stats.m_peakUsedMemory);
+        allocatorValue["allocations"] = Json::UInt64(stats.m_numAllocations);
+        allocatorValue["totalAllocations"] = Json::UInt64(stats.m_totalAllocations);
+        allocatorValue["allocationsLastFrame"] = Json::UInt64(stats.m_allocationsLastFrame);
+        allocatorValue["fragmentation"] = stats.m_fragmentation;
+        root["allocators"].append(allocatorValue);
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    return Json::writeString(builder, root);
+}
+
+bool AllocatorRegistry::DumpJson(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << ToJson() << std::endl;
+    return bool(file);
+}
+
+void AllocatorRegistry::SampleFrame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Entry& entry : m_entries)
+    {
+        UpdateEntry(entry);
+        entry.stats.m_allocationsLastFrame
+            = entry.stats.m_totalAllocations - entry.lastTotalAllocations;
+        entry.lastTotalAllocations = entry.stats.m_totalAllocations;
+    }
+    m_numSampledFrames++;
+}
+
+void AllocatorRegistry::UpdateEntry(Entry& entry)
+{
+    Allocator& allocator = *entry.pAllocator;
+    allocator.RefreshStatistics();
+
+    AllocatorStats& stats = entry.stats;
+    stats.m_capacity = allocator.m_size;
+    stats.m_usedMemory = allocator.m_usedMemory;
+    stats.m_peakUsedMemory = std::max(stats.m_peakUsedMemory, allocator.m_usedMemory);
+    stats.m_numAllocations = allocator.m_numAllocations;
+    stats.m_totalAllocations = allocator.m_totalAllocations;
+}
+
+}
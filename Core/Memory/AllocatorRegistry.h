@@ -0,0 +1,85 @@
+#pragma once
+
+#include "BaseAllocator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Farlor {
+
+// Statistics of one registered allocator
+struct AllocatorStats
+{
+    std::string m_name;
+    // Empty for allocators that own their memory
+    std::string m_parentName;
+
+    size_t m_capacity;
+    size_t m_usedMemory;
+    // Highest m_usedMemory seen by the per frame sampling or a snapshot
+    size_t m_peakUsedMemory;
+    size_t m_numAllocations;
+    size_t m_totalAllocations;
+    // Allocations made during the last sampled frame
+    size_t m_allocationsLastFrame;
+    float m_fragmentation;
+};
+
+// Global list of named allocators, so memory can be attributed to the subsystems using it.
+// Sampling once per frame keeps peaks and allocation rates; while it is off BeginFrame is a
+// single flag check.
+class AllocatorRegistry
+{
+public:
+    static AllocatorRegistry& Get();
+
+    // pParent is the allocator the memory comes from, if it is registered too
+    void Register(const std::string& name, Allocator& allocator,
+        const Allocator* pParent = nullptr);
+    void Unregister(const Allocator& allocator);
+
+    void SetSamplingEnabled(bool enabled);
+    bool IsSamplingEnabled() const { return m_samplingEnabled; }
+
+    void BeginFrame()
+    {
+        if (m_samplingEnabled.load(std::memory_order_relaxed))
+            SampleFrame();
+    }
+    uint64_t GetNumSampledFrames() const { return m_numSampledFrames; }
+
+    // Current statistics of every allocator. Fragmentation can walk an allocator's blocks, so
+    // this is meant for reporting rather than every frame.
+    std::vector<AllocatorStats> Snapshot();
+
+    std::string ToJson();
+    bool DumpJson(const std::string& path);
+
+private:
+    AllocatorRegistry();
+
+    AllocatorRegistry(const AllocatorRegistry&); // Prevent copies
+    AllocatorRegistry& operator=(const AllocatorRegistry&);
+
+    struct Entry
+    {
+        Allocator* pAllocator;
+        const Allocator* pParent;
+        size_t lastTotalAllocations;
+        AllocatorStats stats;
+    };
+
+    void SampleFrame();
+    void UpdateEntry(Entry& entry);
+
+    std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+
+    std::atomic<bool> m_samplingEnabled;
+    uint64_t m_numSampledFrames;
+};
+
+}
@@ -9,11 +9,13 @@ Allocator::Allocator(size_t size, void* pStart)
 
     m_usedMemory = 0;
     m_numAllocations = 0;
+    m_totalAllocations = 0;
 }
 
 Allocator::~Allocator()
 {
-    assert(m_numAllocations == 0 && m_usedMemory == 0);
+    // Wrap the allocator in a TrackingAllocator to find out what leaked
+    assert(m_numAllocations == 0 && m_usedMemory == 0 && "Allocator destroyed with live allocations");
     m_pStart = nullptr;
     m_size = 0;
 }
@@ -2,8 +2,10 @@
 
 #include "MemoryAlignmentUtils.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <cassert>
+#include <new>
 
 //
 //#include "../../Farlor.h"
@@ -12,11 +14,11 @@
 
 Allocator model:
 
-Allocate 1GB of memory for Free List allocator
-Create Proxy Allocator that redirects all allocations to the Free List allocator
+Allocate 1GB of memory for the TLSF allocator (TLSFAllocator), the free list root heap
+Create Proxy Allocator that redirects all allocations to the TLSF allocator
 Initialize resource manager by passing pointer to proxy allocator
 Register the proxy allocator in the memory usage tracker
-Allocate 16MB of memory using free list allocator and create a linear allocator
+Allocate 16MB of memory using the TLSF allocator and create a linear allocator
 Use the linear allocator to make small temporary allocations needed for game logic and clear before the end of each frame
 The resouirce manager will create a pool allocator for every resource package it loads
 
@@ -34,11 +36,21 @@ namespace Farlor
         virtual void* Allocate(size_t size, uint8_t alignment = 4) = 0;
         virtual void Deallocate(void* pMemory) = 0;
 
+        // Brings the counters below up to date, for allocators that do not keep them current
+        // on every call
+        virtual void RefreshStatistics() {}
+
+        // 0 when all free memory is in one piece, towards 1 as it splinters. Allocators that
+        // cannot fragment report 0.
+        virtual float GetFragmentation() const { return 0.0f; }
+
     public:
         void* m_pStart;
         size_t m_size;
         size_t m_usedMemory;
         size_t m_numAllocations;
+        // Every allocation ever made, for allocation rates
+        size_t m_totalAllocations;
     };
 
 
@@ -0,0 +1,330 @@
+#include "ConcurrentPoolAllocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// ThreadSanitizer annotations, see PopMagazine
+#if defined(__SANITIZE_THREAD__)
+#define FARLOR_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define FARLOR_TSAN 1
+#endif
+#endif
+
+#if FARLOR_TSAN
+extern "C" void AnnotateIgnoreReadsBegin(const char* pFile, int line);
+extern "C" void AnnotateIgnoreReadsEnd(const char* pFile, int line);
+#define FARLOR_TSAN_IGNORE_READS_BEGIN() AnnotateIgnoreReadsBegin(__FILE__, __LINE__)
+#define FARLOR_TSAN_IGNORE_READS_END() AnnotateIgnoreReadsEnd(__FILE__, __LINE__)
+#else
+#define FARLOR_TSAN_IGNORE_READS_BEGIN() ((void)0)
+#define FARLOR_TSAN_IGNORE_READS_END() ((void)0)
+#endif
+
+namespace Farlor {
+
+namespace {
+
+const uint32_t NullIndex = 0xFFFFFFFF;
+
+// Written over a free object. The head object of a magazine also records the magazine below it
+// in the depot (as index + 1, 0 for none) and how many objects it chains together.
+struct FreeNode
+{
+    uint32_t nextInMagazine;
+    uint32_t nextMagazine;
+    uint32_t count;
+};
+
+}
+
+struct ConcurrentPoolAllocator::Shared
+{
+    uint8_t* pObjects;
+    size_t stride;
+    uint32_t numObjects;
+
+    // Depot stacks as (tag << 32) | (head index + 1). Magazines of exactly MagazineSize objects
+    // go on the full stack, the rest on the partial one.
+    alignas(64) std::atomic<uint64_t> fullMagazines;
+    alignas(64) std::atomic<uint64_t> partialMagazines;
+
+    alignas(64) std::mutex cacheMutex;
+    std::vector<ThreadCache*> caches;
+    std::atomic<bool> alive;
+    // Allocations minus frees, and all allocations, of threads that have exited
+    int64_t retiredBalance;
+    uint64_t retiredAllocations;
+
+    FreeNode* Node(uint32_t index)
+    {
+        return (FreeNode*)(pObjects + size_t(index) * stride);
+    }
+
+    void PushMagazine(uint32_t head, uint32_t count)
+    {
+        std::atomic<uint64_t>& stack = (count == MagazineSize) ? fullMagazines : partialMagazines;
+        FreeNode* pNode = Node(head);
+        pNode->count = count;
+
+        uint64_t oldTop = stack.load(std::memory_order_relaxed);
+        uint64_t newTop;
+        do
+        {
+            std::atomic_ref<uint32_t>(pNode->nextMagazine).store(uint32_t(oldTop),
+                std::memory_order_relaxed);
+            newTop = (((oldTop >> 32) + 1) << 32) | (uint64_t(head) + 1);
+        } while (!stack.compare_exchange_weak(oldTop, newTop, std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
+    bool PopMagazine(std::atomic<uint64_t>& stack, uint32_t& head, uint32_t& count)
+    {
+        uint64_t oldTop = stack.load(std::memory_order_acquire);
+        uint64_t newTop;
+        do
+        {
+            uint32_t top = uint32_t(oldTop);
+            if (top == 0)
+                return false;
+
+            // May read a node another thread has just popped and is already writing to. The
+            // value is then stale, but the top has changed since, so the tag makes the exchange
+            // fail and the value is never used. The pool memory stays mapped, so the read itself
+            // cannot fault. ThreadSanitizer still sees a race with the new owner's plain writes,
+            // so the read is hidden from it.
+            FARLOR_TSAN_IGNORE_READS_BEGIN();
+            uint32_t next = std::atomic_ref<uint32_t>(Node(top - 1)->nextMagazine).load(
+                std::memory_order_relaxed);
+            FARLOR_TSAN_IGNORE_READS_END();
+            newTop = (((oldTop >> 32) + 1) << 32) | next;
+        } while (!stack.compare_exchange_weak(oldTop, newTop, std::memory_order_acquire,
+            std::memory_order_acquire));
+
+        head = uint32_t(oldTop) - 1;
+        count = Node(head)->count;
+        return true;
+    }
+};
+
+struct ConcurrentPoolAllocator::ThreadCache
+{
+    std::shared_ptr<Shared> spShared;
+
+    // The previous magazine is always either empty or full
+    uint32_t loadedHead = NullIndex;
+    uint32_t loadedCount = 0;
+    uint32_t previousHead = NullIndex;
+    uint32_t previousCount = 0;
+
+    // Only written by the owning thread, read when gathering statistics
+    alignas(64) std::atomic<int64_t> balance = 0;
+    std::atomic<uint64_t> allocations = 0;
+
+    void Flush()
+    {
+        if (loadedCount > 0)
+            spShared->PushMagazine(loadedHead, loadedCount);
+        if (previousCount > 0)
+            spShared->PushMagazine(previousHead, previousCount);
+        loadedHead = NullIndex;
+        loadedCount = 0;
+        previousHead = NullIndex;
+        previousCount = 0;
+    }
+
+    ~ThreadCache()
+    {
+        std::lock_guard<std::mutex> lock(spShared->cacheMutex);
+        if (!spShared->alive)
+            return;
+
+        Flush();
+        spShared->retiredBalance += balance.load(std::memory_order_relaxed);
+        spShared->retiredAllocations += allocations.load(std::memory_order_relaxed);
+        std::vector<ThreadCache*>& caches = spShared->caches;
+        caches.erase(std::find(caches.begin(), caches.end(), this));
+    }
+};
+
+ConcurrentPoolAllocator::ConcurrentPoolAllocator(size_t objectSize, uint8_t objectAlignment,
+    size_t size, void* pMemory)
+    : Allocator(size, pMemory)
+    , m_objectSize(objectSize)
+    , m_objectAlignment(objectAlignment)
+    , m_spShared(std::make_shared<Shared>())
+{
+    assert(objectSize > 0);
+
+    // Objects are spaced so the free list node in each one is aligned too
+    size_t stride = std::max(objectSize, sizeof(FreeNode));
+    size_t strideAlignment = std::max<size_t>(objectAlignment, alignof(FreeNode));
+    stride = (stride + strideAlignment - 1) & ~(strideAlignment - 1);
+
+    uint8_t adjustment = AlignForwardAdjustment(pMemory, uint8_t(strideAlignment));
+    assert(size > adjustment && (size - adjustment) / stride > 0 && "Pool too small");
+
+    Shared& shared = *m_spShared;
+    shared.pObjects = (uint8_t*)pMemory + adjustment;
+    shared.stride = stride;
+    shared.numObjects = uint32_t(std::min<size_t>((size - adjustment) / stride, NullIndex - 1));
+    shared.fullMagazines = 0;
+    shared.partialMagazines = 0;
+    shared.alive = true;
+    shared.retiredBalance = 0;
+    shared.retiredAllocations = 0;
+
+    // Pushed from the top down so the lowest addresses are handed out first
+    uint32_t numMagazines = (shared.numObjects + MagazineSize - 1) / MagazineSize;
+    for (uint32_t magazine = numMagazines; magazine > 0; magazine--)
+    {
+        uint32_t first = (magazine - 1) * MagazineSize;
+        uint32_t last = std::min(first + MagazineSize, shared.numObjects);
+        for (uint32_t index = first; index < last; index++)
+            shared.Node(index)->nextInMagazine = (index + 1 < last) ? index + 1 : NullIndex;
+        shared.PushMagazine(first, last - first);
+    }
+}
+
+ConcurrentPoolAllocator::~ConcurrentPoolAllocator()
+{
+    assert(GetNumLiveObjects() == 0 && "Pool destroyed with live objects");
+
+    // Thread caches that outlive the pool must not touch its memory any more
+    {
+        std::lock_guard<std::mutex> lock(m_spShared->cacheMutex);
+        m_spShared->alive = false;
+        m_spShared->caches.clear();
+    }
+
+    m_numAllocations = 0;
+    m_usedMemory = 0;
+}
+
+void* ConcurrentPoolAllocator::Allocate([[maybe_unused]] size_t size,
+    [[maybe_unused]] uint8_t alignment)
+{
+    assert(size <= m_objectSize && alignment <= m_objectAlignment);
+
+    ThreadCache& cache = GetThreadCache();
+    Shared& shared = *cache.spShared;
+    if (cache.loadedCount == 0)
+    {
+        if (cache.previousCount > 0)
+        {
+            std::swap(cache.loadedHead, cache.previousHead);
+            std::swap(cache.loadedCount, cache.previousCount);
+        }
+        else if (!shared.PopMagazine(shared.fullMagazines, cache.loadedHead, cache.loadedCount)
+            && !shared.PopMagazine(shared.partialMagazines, cache.loadedHead,
+                cache.loadedCount))
+        {
+            return nullptr;
+        }
+    }
+
+    uint32_t index = cache.loadedHead;
+    cache.loadedHead = shared.Node(index)->nextInMagazine;
+    cache.loadedCount--;
+    cache.balance.store(cache.balance.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    cache.allocations.store(cache.allocations.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    return shared.Node(index);
+}
+
+void ConcurrentPoolAllocator::Deallocate(void* pMemory)
+{
+    assert(pMemory != nullptr);
+
+    ThreadCache& cache = GetThreadCache();
+    Shared& shared = *cache.spShared;
+    size_t offset = (uint8_t*)pMemory - shared.pObjects;
+    assert(offset % shared.stride == 0 && offset / shared.stride < shared.numObjects
+        && "Object does not belong to this pool");
+    uint32_t index = uint32_t(offset / shared.stride);
+
+    if (cache.loadedCount == MagazineSize)
+    {
+        // Keep one full magazine in hand and trade the other for an empty one
+        if (cache.previousCount == MagazineSize)
+            shared.PushMagazine(cache.previousHead, cache.previousCount);
+        cache.previousHead = cache.loadedHead;
+        cache.previousCount = cache.loadedCount;
+        cache.loadedHead = NullIndex;
+        cache.loadedCount = 0;
+    }
+
+    shared.Node(index)->nextInMagazine = cache.loadedHead;
+    cache.loadedHead = index;
+    cache.loadedCount++;
+    cache.balance.store(cache.balance.load(std::memory_order_relaxed) - 1,
+        std::memory_order_relaxed);
+}
+
+void ConcurrentPoolAllocator::FlushThreadCache()
+{
+    GetThreadCache().Flush();
+}
+
+size_t ConcurrentPoolAllocator::GetNumLiveObjects() const
+{
+    std::lock_guard<std::mutex> lock(m_spShared->cacheMutex);
+    int64_t balance = m_spShared->retiredBalance;
+    for (const ThreadCache* pCache : m_spShared->caches)
+        balance += pCache->balance.load(std::memory_order_relaxed);
+    return size_t(std::max<int64_t>(balance, 0));
+}
+
+void ConcurrentPoolAllocator::RefreshStatistics()
+{
+    m_numAllocations = GetNumLiveObjects();
+    m_usedMemory = m_numAllocations * m_objectSize;
+
+    std::lock_guard<std::mutex> lock(m_spShared->cacheMutex);
+    uint64_t totalAllocations = m_spShared->retiredAllocations;
+    for (const ThreadCache* pCache : m_spShared->caches)
+        totalAllocations += pCache->allocations.load(std::memory_order_relaxed);
+    m_totalAllocations = size_t(totalAllocations);
+}
+
+ConcurrentPoolAllocator::ThreadCache& ConcurrentPoolAllocator::GetThreadCache()
+{
+    thread_local std::vector<std::unique_ptr<ThreadCache>> threadCaches;
+    thread_local ThreadCache* pLastCache = nullptr;
+
+    if (pLastCache != nullptr && pLastCache->spShared == m_spShared)
+        return *pLastCache;
+
+    for (std::unique_ptr<ThreadCache>& upCache : threadCaches)
+    {
+        if (upCache->spShared == m_spShared)
+        {
+            pLastCache = upCache.get();
+            return *pLastCache;
+        }
+    }
+
+    // First use from this thread. Caches of pools that are gone are dropped on the way.
+    threadCaches.erase(std::remove_if(threadCaches.begin(), threadCaches.end(),
+        [](const std::unique_ptr<ThreadCache>& upCache) {
+            return !upCache->spShared->alive;
+        }), threadCaches.end());
+
+    std::unique_ptr<ThreadCache> upCache = std::make_unique<ThreadCache>();
+    upCache->spShared = m_spShared;
+    {
+        std::lock_guard<std::mutex> lock(m_spShared->cacheMutex);
+        m_spShared->caches.push_back(upCache.get());
+    }
+    pLastCache = upCache.get();
+    threadCaches.push_back(std::move(upCache));
+    return *pLastCache;
+}
+
+}
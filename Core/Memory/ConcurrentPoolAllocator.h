@@ -0,0 +1,59 @@
+#pragma once
+
+#include "BaseAllocator.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace Farlor {
+
+// Thread safe version of PoolAllocator. Every thread keeps up to two magazines of free objects
+// of its own, so most allocations and frees touch no shared state at all. Only when a thread
+// runs out, or has two full magazines, does it trade a whole magazine with a shared depot, a
+// pair of lock free stacks whose heads carry a tag against ABA. PoolAllocator stays the faster
+// choice for pools only one thread uses.
+//
+// Objects parked in another thread's magazines are not visible to this one, so a pool can
+// report full while up to 2 * MagazineSize objects per thread are still free. Threads give
+// their magazines back when they exit or call FlushThreadCache.
+class ConcurrentPoolAllocator : public Allocator
+{
+public:
+    static constexpr uint32_t MagazineSize = 32;
+
+public:
+    ConcurrentPoolAllocator(size_t objectSize, uint8_t objectAlignment, size_t size,
+        void* pMemory);
+    ~ConcurrentPoolAllocator();
+
+    virtual void* Allocate(size_t size, uint8_t alignment = 4) override;
+    virtual void Deallocate(void* pMemory) override;
+
+    // Hands the calling thread's magazines back to the depot
+    void FlushThreadCache();
+
+    // Objects allocated and not yet freed, over all threads. Only exact while no other thread
+    // is allocating.
+    size_t GetNumLiveObjects() const;
+
+    // Copies the per thread counts into m_numAllocations, m_usedMemory and m_totalAllocations,
+    // which the threads cannot update without contending on them
+    virtual void RefreshStatistics() override;
+
+private:
+    ConcurrentPoolAllocator(const ConcurrentPoolAllocator&); // Prevent copies
+    ConcurrentPoolAllocator& operator=(const ConcurrentPoolAllocator&);
+
+    // State the thread caches share with the pool, kept alive by whichever goes last
+    struct Shared;
+    struct ThreadCache;
+
+    ThreadCache& GetThreadCache();
+
+    size_t m_objectSize;
+    uint8_t m_objectAlignment;
+
+    std::shared_ptr<Shared> m_spShared;
+};
+
+}
@@ -0,0 +1,151 @@
+#include "FrameAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+
+namespace Farlor {
+
+struct FrameAllocator::SlotPool
+{
+    std::mutex mutex;
+    std::vector<uint32_t> freeSlots;
+};
+
+namespace {
+
+// Keeps a thread's slot in one FrameAllocator, and hands it back when the thread exits
+struct SlotLease
+{
+    std::shared_ptr<void> spPool;
+    uint32_t slot;
+    void (*pRelease)(void* pPool, uint32_t slot);
+
+    ~SlotLease()
+    {
+        pRelease(spPool.get(), slot);
+    }
+};
+
+thread_local std::vector<std::unique_ptr<SlotLease>> t_slotLeases;
+
+// Arenas start on their own cache lines so neighbouring threads never share one
+const size_t ArenaAlignment = 64;
+
+}
+
+FrameAllocator::FrameAllocator(Allocator& parent, size_t arenaSize, uint32_t maxThreads,
+    uint32_t numBuffers)
+    : m_parent(parent)
+    , m_pArenaMemory(nullptr)
+    , m_arenaSize((arenaSize + ArenaAlignment - 1) & ~(ArenaAlignment - 1))
+    , m_maxThreads(maxThreads)
+    , m_numBuffers(numBuffers)
+    , m_spSlotPool(std::make_shared<SlotPool>())
+    , m_currentBuffer(0)
+    , m_frameIdx(0)
+    , m_peakUsedMemory(0)
+{
+    assert(arenaSize > 0 && maxThreads > 0 && numBuffers > 0);
+
+    size_t numArenas = size_t(numBuffers) * maxThreads;
+    m_pArenaMemory = m_parent.Allocate(numArenas * m_arenaSize, uint8_t(ArenaAlignment));
+    assert(m_pArenaMemory != nullptr && "Parent allocator could not fit the frame arenas");
+
+    m_arenas.reserve(numArenas);
+    for (size_t arenaIdx = 0; arenaIdx < numArenas; arenaIdx++)
+    {
+        void* pArena = (void*)((uintptr_t)m_pArenaMemory + arenaIdx * m_arenaSize);
+        m_arenas.push_back(std::make_unique<LinearAllocator>(m_arenaSize, pArena));
+    }
+
+    // Handed out lowest slot first
+    for (uint32_t slot = maxThreads; slot > 0; slot--)
+        m_spSlotPool->freeSlots.push_back(slot - 1);
+}
+
+FrameAllocator::~FrameAllocator()
+{
+    // Linear arenas never count their allocations back down, so clear them before they go
+    for (std::unique_ptr<LinearAllocator>& upArena : m_arenas)
+        upArena->Clear();
+    m_arenas.clear();
+
+    m_parent.Deallocate(m_pArenaMemory);
+    m_pArenaMemory = nullptr;
+}
+
+LinearAllocator* FrameAllocator::GetThreadArena()
+{
+    SlotLease* pLease = nullptr;
+    for (std::unique_ptr<SlotLease>& upLease : t_slotLeases)
+    {
+        if (upLease->spPool.get() == m_spSlotPool.get())
+        {
+            pLease = upLease.get();
+            break;
+        }
+    }
+
+    if (pLease == nullptr)
+    {
+        uint32_t slot = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_spSlotPool->mutex);
+            if (m_spSlotPool->freeSlots.empty())
+            {
+                assert(false && "More threads than the frame allocator has arenas for");
+                return nullptr;
+            }
+            slot = m_spSlotPool->freeSlots.back();
+            m_spSlotPool->freeSlots.pop_back();
+        }
+
+        // Leases of allocators that are gone only keep their pool alive, so drop them here
+        t_slotLeases.erase(std::remove_if(t_slotLeases.begin(), t_slotLeases.end(),
+            [](const std::unique_ptr<SlotLease>& upLease) {
+                return upLease->spPool.use_count() == 1;
+            }), t_slotLeases.end());
+
+        std::unique_ptr<SlotLease> upLease = std::make_unique<SlotLease>();
+        upLease->spPool = m_spSlotPool;
+        upLease->slot = slot;
+        upLease->pRelease = [](void* pPool, uint32_t releasedSlot) {
+            SlotPool* pSlotPool = (SlotPool*)pPool;
+            std::lock_guard<std::mutex> lock(pSlotPool->mutex);
+            pSlotPool->freeSlots.push_back(releasedSlot);
+        };
+        pLease = upLease.get();
+        t_slotLeases.push_back(std::move(upLease));
+    }
+
+    return m_arenas[size_t(m_currentBuffer) * m_maxThreads + pLease->slot].get();
+}
+
+void* FrameAllocator::Allocate(size_t size, uint8_t alignment)
+{
+    LinearAllocator* pArena = GetThreadArena();
+    if (pArena == nullptr)
+        return nullptr;
+    return pArena->Allocate(size, alignment);
+}
+
+void FrameAllocator::BeginFrame()
+{
+    m_peakUsedMemory = std::max(m_peakUsedMemory, GetUsedMemory());
+
+    m_currentBuffer = (m_currentBuffer + 1) % m_numBuffers;
+    m_frameIdx++;
+    for (uint32_t slot = 0; slot < m_maxThreads; slot++)
+        m_arenas[size_t(m_currentBuffer) * m_maxThreads + slot]->Clear();
+}
+
+size_t FrameAllocator::GetUsedMemory() const
+{
+    size_t usedMemory = 0;
+    for (uint32_t slot = 0; slot < m_maxThreads; slot++)
+        usedMemory += m_arenas[size_t(m_currentBuffer) * m_maxThreads + slot]->m_usedMemory;
+    return usedMemory;
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "BaseAllocator.h"
+#include "LinearAllocator.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Farlor {
+
+// Per thread linear arenas for memory that only has to live for a frame or two. Every thread
+// that allocates gets its own LinearAllocator, so allocation is a pointer bump with no locking,
+// and each thread has numBuffers of them that are rotated by BeginFrame. Memory allocated in
+// frame N stays valid until BeginFrame has been called numBuffers more times.
+class FrameAllocator
+{
+public:
+    // Takes numBuffers * maxThreads arenas of arenaSize bytes from parent up front
+    FrameAllocator(Allocator& parent, size_t arenaSize, uint32_t maxThreads,
+        uint32_t numBuffers = 2);
+    ~FrameAllocator();
+
+    // Arena of the calling thread for the current frame. A thread keeps its slot until it exits,
+    // when the slot goes back to be reused by the next new thread. Returns nullptr if more than
+    // maxThreads threads are using the allocator at once.
+    LinearAllocator* GetThreadArena();
+
+    // Returns nullptr when the thread's arena for this frame is full
+    void* Allocate(size_t size, uint8_t alignment = 4);
+
+    // Uninitialized space for count objects; only meant for trivially destructible types
+    template<class T>
+    T* AllocateArray(size_t count)
+    {
+        return (T*)Allocate(sizeof(T) * count, __alignof(T));
+    }
+
+    // Moves every thread on to its next arena and clears it, releasing whatever was allocated
+    // numBuffers frames ago. Must not run while other threads are allocating.
+    void BeginFrame();
+
+    uint64_t GetFrameIdx() const { return m_frameIdx; }
+
+    // Bytes allocated from the current frame's arenas, over all threads
+    size_t GetUsedMemory() const;
+    // Most any single frame has used since construction
+    size_t GetPeakUsedMemory() const { return m_peakUsedMemory; }
+
+private:
+    FrameAllocator(const FrameAllocator&); // Prevent copies
+    FrameAllocator& operator=(const FrameAllocator&);
+
+    struct SlotPool;
+
+    Allocator& m_parent;
+    void* m_pArenaMemory;
+    size_t m_arenaSize;
+    uint32_t m_maxThreads;
+    uint32_t m_numBuffers;
+
+    // Shared with the thread slot leases, which return their slot here when their thread exits
+    std::shared_ptr<SlotPool> m_spSlotPool;
+
+    // Indexed by buffer * maxThreads + slot
+    std::vector<std::unique_ptr<LinearAllocator>> m_arenas;
+
+    uint32_t m_currentBuffer;
+    uint64_t m_frameIdx;
+    size_t m_peakUsedMemory;
+};
+
+}
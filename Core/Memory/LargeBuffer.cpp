@@ -0,0 +1,361 @@
+#include "LargeBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Farlor {
+
+namespace {
+
+size_t RoundUp(size_t size, size_t granularity)
+{
+    return (size + granularity - 1) / granularity * granularity;
+}
+
+#if !defined(_WIN32)
+
+// From linux/mempolicy.h, which is not always installed
+const int MpolBind = 2;
+const unsigned MpolMfMove = 1 << 1;
+
+size_t GetPageSize()
+{
+    static const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    return pageSize;
+}
+
+// Parses lists like "0-3,8,10-11" as found in /sys/devices/system
+std::vector<uint32_t> ParseIdList(const std::string& list)
+{
+    std::vector<uint32_t> ids;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        uint32_t first = 0;
+        uint32_t last = 0;
+        int numParsed = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+        if (numParsed < 1)
+            continue;
+        if (numParsed == 1)
+            last = first;
+        for (uint32_t id = first; id <= last; id++)
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+std::string ReadLine(const char* pPath)
+{
+    std::ifstream file(pPath);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// CPU set of every node, read once since every worker of every ParallelForPool pins itself
+const std::vector<cpu_set_t>& GetNodeCpuSets()
+{
+    static const std::vector<cpu_set_t> nodeCpuSets = []() {
+        std::vector<cpu_set_t> cpuSets(GetNumaNodeCount());
+        for (uint32_t node = 0; node < cpuSets.size(); node++)
+        {
+            CPU_ZERO(&cpuSets[node]);
+            char path[64];
+            std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+            for (uint32_t cpu : ParseIdList(ReadLine(path)))
+            {
+                if (cpu < CPU_SETSIZE)
+                    CPU_SET(cpu, &cpuSets[node]);
+            }
+        }
+        return cpuSets;
+    }();
+    return nodeCpuSets;
+}
+
+// Adds the huge page backed bytes of every mapping overlapping [start, end)
+size_t QueryHugePageBytes(uintptr_t start, uintptr_t end)
+{
+    std::ifstream smaps("/proc/self/smaps");
+    size_t hugePageBytes = 0;
+    size_t overlap = 0;
+    std::string line;
+    while (std::getline(smaps, line))
+    {
+        unsigned long mapStart = 0;
+        unsigned long mapEnd = 0;
+        size_t kilobytes = 0;
+        if (std::sscanf(line.c_str(), "%lx-%lx ", &mapStart, &mapEnd) == 2)
+        {
+            // Start of the next mapping
+            uintptr_t overlapStart = std::max<uintptr_t>(start, mapStart);
+            uintptr_t overlapEnd = std::min<uintptr_t>(end, mapEnd);
+            overlap = (overlapEnd > overlapStart) ? overlapEnd - overlapStart : 0;
+        }
+        else if (overlap == 0)
+        {
+            continue;
+        }
+        else if (std::sscanf(line.c_str(), "KernelPageSize: %zu kB", &kilobytes) == 1)
+        {
+            // hugetlbfs mappings only ever have huge pages
+            if (kilobytes * 1024 >= HugePageSize)
+            {
+                hugePageBytes += overlap;
+                overlap = 0;
+            }
+        }
+        else if (std::sscanf(line.c_str(), "AnonHugePages: %zu kB", &kilobytes) == 1)
+        {
+            hugePageBytes += std::min(kilobytes * 1024, overlap);
+        }
+    }
+    return hugePageBytes;
+}
+
+#endif
+
+}
+
+void* AllocateLargeBuffer(size_t size)
+{
+    assert(size > 0);
+    size_t mappedSize = RoundUp(size, HugePageSize);
+
+#if defined(_WIN32)
+    // Needs the lock pages in memory privilege, which most accounts do not have
+    size_t largePageSize = GetLargePageMinimum();
+    if (largePageSize != 0)
+    {
+        void* pBuffer = VirtualAlloc(nullptr, RoundUp(size, largePageSize),
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (pBuffer != nullptr)
+            return pBuffer;
+    }
+    return VirtualAlloc(nullptr, mappedSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+#if defined(MAP_HUGETLB)
+    void* pBuffer = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pBuffer != MAP_FAILED)
+        return pBuffer;
+#endif
+
+    // Over map by a huge page and trim both ends so the buffer starts on a huge page boundary,
+    // which transparent huge pages need
+    uint8_t* pMapping = (uint8_t*)mmap(nullptr, mappedSize + HugePageSize,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMapping == MAP_FAILED)
+        return nullptr;
+
+    uint8_t* pAligned = (uint8_t*)RoundUp((uintptr_t)pMapping, HugePageSize);
+    size_t leading = pAligned - pMapping;
+    if (leading > 0)
+        munmap(pMapping, leading);
+    if (HugePageSize - leading > 0)
+        munmap(pAligned + mappedSize, HugePageSize - leading);
+
+#if defined(MADV_HUGEPAGE)
+    madvise(pAligned, mappedSize, MADV_HUGEPAGE);
+#endif
+    return pAligned;
+#endif
+}
+
+void FreeLargeBuffer(void* pBuffer, size_t size)
+{
+    if (pBuffer == nullptr)
+        return;
+
+#if defined(_WIN32)
+    VirtualFree(pBuffer, 0, MEM_RELEASE);
+#else
+    munmap(pBuffer, RoundUp(size, HugePageSize));
+#endif
+}
+
+uint32_t GetNumaNodeCount()
+{
+#if defined(_WIN32)
+    static const uint32_t numNodes = []() {
+        ULONG highestNode = 0;
+        return GetNumaHighestNodeNumber(&highestNode) ? uint32_t(highestNode) + 1 : 1u;
+    }();
+#else
+    static const uint32_t numNodes = []() {
+        std::vector<uint32_t> nodes = ParseIdList(ReadLine("/sys/devices/system/node/online"));
+        return nodes.empty() ? 1u : *std::max_element(nodes.begin(), nodes.end()) + 1;
+    }();
+#endif
+    return numNodes;
+}
+
+uint32_t GetCurrentNumaNode()
+{
+#if defined(_WIN32)
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT node = 0;
+    return GetNumaProcessorNodeEx(&processor, &node) ? uint32_t(node) : 0;
+#else
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+        return 0;
+    return uint32_t(node);
+#endif
+}
+
+bool PinThreadToNumaNode(uint32_t node)
+{
+    if (node >= GetNumaNodeCount())
+        return false;
+
+#if defined(_WIN32)
+    GROUP_AFFINITY affinity = {};
+    if (!GetNumaNodeProcessorMaskEx(USHORT(node), &affinity))
+        return false;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+    const cpu_set_t& cpuSet = GetNodeCpuSets()[node];
+    if (CPU_COUNT(&cpuSet) == 0)
+        return false;
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#endif
+}
+
+bool BindToNumaNode(void* pAddress, size_t size, uint32_t node, size_t pageSize)
+{
+    if (node >= GetNumaNodeCount())
+        return false;
+
+#if defined(_WIN32)
+    // Windows can only pick the node when memory is allocated (VirtualAllocExNuma)
+    return false;
+#else
+    if (pageSize == 0)
+        pageSize = GetPageSize();
+    uintptr_t start = RoundUp((uintptr_t)pAddress, pageSize);
+    uintptr_t end = RoundUp((uintptr_t)pAddress + size, pageSize);
+    if (end <= start)
+        return true;
+
+    const size_t BitsPerWord = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> nodeMask(node / BitsPerWord + 1, 0);
+    nodeMask[node / BitsPerWord] |= 1ul << (node % BitsPerWord);
+    if (syscall(SYS_mbind, start, end - start, MpolBind, nodeMask.data(),
+        nodeMask.size() * BitsPerWord + 1, MpolMfMove) != 0)
+    {
+        std::fprintf(stderr, "Binding %zu bytes at %p to NUMA node %u failed: %s\n",
+            size_t(end - start), (void*)start, node, std::strerror(errno));
+        return false;
+    }
+    return true;
+#endif
+}
+
+void LargeBufferPlacement::Merge(const LargeBufferPlacement& other)
+{
+    m_size += other.m_size;
+    m_hugePageBytes += other.m_hugePageBytes;
+    m_unplacedBytes += other.m_unplacedBytes;
+    if (m_nodeBytes.size() < other.m_nodeBytes.size())
+        m_nodeBytes.resize(other.m_nodeBytes.size(), 0);
+    for (size_t node = 0; node < other.m_nodeBytes.size(); node++)
+        m_nodeBytes[node] += other.m_nodeBytes[node];
+}
+
+std::string LargeBufferPlacement::ToString() const
+{
+    double size = double(std::max<size_t>(m_size, 1));
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%.1f MB, %.0f%% huge pages",
+        double(m_size) / (1024.0 * 1024.0), 100.0 * double(m_hugePageBytes) / size);
+    std::string text = buffer;
+
+    for (size_t node = 0; node < m_nodeBytes.size(); node++)
+    {
+        std::snprintf(buffer, sizeof(buffer), ", node %zu %.0f%%", node,
+            100.0 * double(m_nodeBytes[node]) / size);
+        text += buffer;
+    }
+    if (m_unplacedBytes > 0)
+    {
+        std::snprintf(buffer, sizeof(buffer), ", unplaced %.0f%%",
+            100.0 * double(m_unplacedBytes) / size);
+        text += buffer;
+    }
+    return text;
+}
+
+LargeBufferPlacement QueryLargeBufferPlacement(const void* pAddress, size_t size)
+{
+    LargeBufferPlacement placement;
+    placement.m_size = size;
+    placement.m_nodeBytes.assign(GetNumaNodeCount(), 0);
+
+#if defined(_WIN32)
+    // Would need QueryWorkingSetEx from psapi; report everything as unknown
+    placement.m_unplacedBytes = size;
+#else
+    uintptr_t start = (uintptr_t)pAddress;
+    uintptr_t end = start + size;
+    placement.m_hugePageBytes = QueryHugePageBytes(start, end);
+
+    // move_pages without target nodes only reports where each page is
+    const size_t BatchSize = 1024;
+    size_t pageSize = GetPageSize();
+    std::vector<void*> pages;
+    std::vector<int> status(BatchSize);
+    std::vector<unsigned char> residency(BatchSize);
+    uintptr_t page = start / pageSize * pageSize;
+    while (page < end)
+    {
+        pages.clear();
+        for (; page < end && pages.size() < BatchSize; page += pageSize)
+            pages.push_back((void*)page);
+
+        bool queried = syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr,
+            status.data(), 0) == 0;
+        if (!queried)
+        {
+            // Kernels without NUMA support: resident pages are all on node 0
+            queried = mincore(pages[0], pages.size() * pageSize, residency.data()) == 0;
+            for (size_t pageIdx = 0; pageIdx < pages.size(); pageIdx++)
+                status[pageIdx] = (queried && (residency[pageIdx] & 1)) ? 0 : -1;
+        }
+
+        for (size_t pageIdx = 0; pageIdx < pages.size(); pageIdx++)
+        {
+            uintptr_t pageStart = std::max((uintptr_t)pages[pageIdx], start);
+            uintptr_t pageEnd = std::min((uintptr_t)pages[pageIdx] + pageSize, end);
+            int node = status[pageIdx];
+            if (node >= 0 && size_t(node) < placement.m_nodeBytes.size())
+                placement.m_nodeBytes[node] += pageEnd - pageStart;
+            else
+                placement.m_unplacedBytes += pageEnd - pageStart;
+        }
+    }
+#endif
+    return placement;
+}
+
+}
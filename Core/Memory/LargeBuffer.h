@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace Farlor {
+
+// Large buffers backed by huge pages and placed on NUMA nodes. The simulation grids are tens of
+// MB each, so with 4 KB pages most of their accesses miss the TLB, and on multi socket hosts a
+// worker reading rows that live on the other socket pays for the interconnect on every miss.
+//
+// Huge pages are requested from the reserved pool first (MAP_HUGETLB, MEM_LARGE_PAGES); when
+// none are available the buffer is aligned to HugePageSize and marked for transparent huge
+// pages instead. Which of these actually happened is only known afterwards, so
+// QueryLargeBufferPlacement reports what the kernel did.
+
+static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+// Buffers smaller than this are not worth a mapping of their own
+static constexpr size_t LargeBufferThreshold = HugePageSize;
+
+// Zeroed and HugePageSize aligned. Returns nullptr on failure.
+void* AllocateLargeBuffer(size_t size);
+// size must be the size that was passed to AllocateLargeBuffer
+void FreeLargeBuffer(void* pBuffer, size_t size);
+
+// 1 on machines without NUMA, or where it cannot be queried
+uint32_t GetNumaNodeCount();
+uint32_t GetCurrentNumaNode();
+
+// Restricts the calling thread to the CPUs of node. Returns false where not supported.
+bool PinThreadToNumaNode(uint32_t node);
+
+// Places the pages of [pAddress, pAddress + size) on node, moving the ones that were already
+// touched. The range is widened to whole pages by rounding both ends up, so adjacent ranges
+// bound to different nodes never fight over a page. pageSize is the base page size when 0; pass
+// GetLargeBufferPageSize for ranges inside large buffers. Returns false where not supported, or
+// when the kernel refuses, which is logged.
+bool BindToNumaNode(void* pAddress, size_t size, uint32_t node, size_t pageSize = 0);
+
+// Page size to bind ranges of a buffer of bufferSize bytes at. Large buffers may be backed by
+// huge pages, which cannot be split between nodes: MAP_HUGETLB ranges fail to bind and
+// transparent huge pages are broken up.
+inline size_t GetLargeBufferPageSize(size_t bufferSize)
+{
+    return (bufferSize >= LargeBufferThreshold) ? HugePageSize : 0;
+}
+
+struct LargeBufferPlacement
+{
+    size_t m_size = 0;
+    // Bytes the kernel backs with pages of HugePageSize or larger
+    size_t m_hugePageBytes = 0;
+    // Resident bytes per NUMA node
+    std::vector<size_t> m_nodeBytes;
+    // Never touched, swapped out, or not queryable on this platform
+    size_t m_unplacedBytes = 0;
+
+    void Merge(const LargeBufferPlacement& other);
+    std::string ToString() const;
+};
+
+LargeBufferPlacement QueryLargeBufferPlacement(const void* pAddress, size_t size);
+
+// Standard allocator that puts allocations of LargeBufferThreshold bytes or more in large
+// buffers, so containers holding grids get huge pages without any other change
+template<class T>
+class LargeBufferAllocator
+{
+public:
+    using value_type = T;
+
+    LargeBufferAllocator() = default;
+    template<class U>
+    LargeBufferAllocator(const LargeBufferAllocator<U>&) {}
+
+    T* allocate(size_t count)
+    {
+        size_t size = count * sizeof(T);
+        if (size < LargeBufferThreshold)
+            return (T*)::operator new(size);
+
+        void* pBuffer = AllocateLargeBuffer(size);
+        if (pBuffer == nullptr)
+            throw std::bad_alloc();
+        return (T*)pBuffer;
+    }
+
+    void deallocate(T* pBuffer, size_t count)
+    {
+        size_t size = count * sizeof(T);
+        if (size < LargeBufferThreshold)
+            ::operator delete(pBuffer);
+        else
+            FreeLargeBuffer(pBuffer, size);
+    }
+
+    template<class U>
+    bool operator==(const LargeBufferAllocator<U>&) const { return true; }
+    template<class U>
+    bool operator!=(const LargeBufferAllocator<U>&) const { return false; }
+};
+
+}
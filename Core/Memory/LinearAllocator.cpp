@@ -29,6 +29,7 @@ void* LinearAllocator::Allocate(size_t size, uint8_t alignment)
     m_pCurrentPosition = (void*)(pAlignedAddress + size);
     m_usedMemory += size + adjustment;
     m_numAllocations++;
+    m_totalAllocations++;
     return (void*) pAlignedAddress;
 }
 
@@ -40,7 +40,7 @@ inline uint8_t AlignForwardAdjustmentWithHeader(const void* pAddress,
     if(adjustment < neededSpace)
     {
         neededSpace -= adjustment;
-        adjustment += adjustment * (neededSpace / alignment);
+        adjustment += alignment * (neededSpace / alignment);
 
         if(neededSpace % alignment > 0)
             adjustment += alignment;
@@ -0,0 +1,40 @@
+#include "MemoryResource.h"
+
+#include <new>
+
+namespace Farlor {
+
+AllocatorResource::AllocatorResource(Allocator& allocator, bool monotonic)
+    : m_allocator(allocator)
+    , m_monotonic(monotonic)
+{
+}
+
+void* AllocatorResource::do_allocate(size_t bytes, size_t alignment)
+{
+    // Engine allocators take the alignment as a uint8_t, larger ones would wrap around
+    if (alignment > 128)
+        throw std::bad_alloc();
+
+    // Containers may ask for 0 bytes, the engine allocators do not accept that
+    void* pMemory = m_allocator.Allocate(bytes != 0 ? bytes : 1, uint8_t(alignment));
+    if (pMemory == nullptr)
+        throw std::bad_alloc();
+    return pMemory;
+}
+
+void AllocatorResource::do_deallocate(void* pMemory, size_t, size_t)
+{
+    if (!m_monotonic)
+        m_allocator.Deallocate(pMemory);
+}
+
+bool AllocatorResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    // Memory from one resource can be freed through another over the same allocator
+    const AllocatorResource* pOther = dynamic_cast<const AllocatorResource*>(&other);
+    return pOther != nullptr && &pOther->m_allocator == &m_allocator
+        && pOther->m_monotonic == m_monotonic;
+}
+
+}
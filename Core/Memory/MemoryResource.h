@@ -0,0 +1,70 @@
+#pragma once
+
+#include "BaseAllocator.h"
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Farlor {
+
+// Lets the standard pmr containers allocate from any engine allocator, so a subsystem can move
+// its containers onto an arena without changing the code that uses them. The allocator has to
+// outlive every container built on the resource.
+//
+// LinearAllocator and the arenas from FrameAllocator::GetThreadArena() cannot free single blocks,
+// so for those pass monotonic = true and frees become no-ops; the memory comes back when the
+// arena is cleared. GetThreadArena() returns a different arena every frame, so a resource over
+// one must not outlive the frame it was created in.
+// A StackAllocator only works for containers that free in reverse order, which most do not.
+class AllocatorResource : public std::pmr::memory_resource
+{
+public:
+    explicit AllocatorResource(Allocator& allocator, bool monotonic = false);
+
+    Allocator& GetAllocator() const { return m_allocator; }
+
+private:
+    AllocatorResource(const AllocatorResource&); // Prevent copies
+    AllocatorResource& operator=(const AllocatorResource&);
+
+    // Throws std::bad_alloc when the allocator is out of memory or cannot meet the alignment,
+    // as memory_resource requires
+    virtual void* do_allocate(size_t bytes, size_t alignment) override;
+    virtual void do_deallocate(void* pMemory, size_t, size_t) override;
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    Allocator& m_allocator;
+    bool m_monotonic;
+};
+
+// Containers that take a memory_resource, e.g.
+//     AllocatorResource resource(*frameAllocator.GetThreadArena(), true);
+//     pmr::vector<Contact> contacts(&resource);
+namespace pmr {
+
+template<class T>
+using vector = std::pmr::vector<T>;
+
+template<class T>
+using deque = std::pmr::deque<T>;
+
+template<class T>
+using list = std::pmr::list<T>;
+
+template<class Key, class T, class Compare = std::less<Key>>
+using map = std::pmr::map<Key, T, Compare>;
+
+template<class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+using unordered_map = std::pmr::unordered_map<Key, T, Hash, KeyEqual>;
+
+using string = std::pmr::string;
+
+}
+
+}
@@ -54,6 +54,7 @@ void* PoolAllocator::Allocate(size_t size, uint8_t alignment)
     m_ppFreeList = (void**)(*m_ppFreeList);
     m_usedMemory += size;
     m_numAllocations++;
+    m_totalAllocations++;
 
     return freeBlock;
 }
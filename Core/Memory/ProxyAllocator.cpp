@@ -1,24 +1,29 @@
 #include "ProxyAllocator.h"
 
+#include "AllocatorRegistry.h"
+
 #include <cassert>
 #include <cstdint>
 
 namespace Farlor {
 
-ProxyAllocator::ProxyAllocator(Allocator& allocator)
+ProxyAllocator::ProxyAllocator(const std::string& name, Allocator& allocator)
     : Allocator(allocator.m_size, allocator.m_pStart)
     , m_allocator(allocator)
 {
+    AllocatorRegistry::Get().Register(name, *this, &allocator);
 }
 
 ProxyAllocator::~ProxyAllocator()
 {
+    AllocatorRegistry::Get().Unregister(*this);
 }
 
 void* ProxyAllocator::Allocate(size_t size, uint8_t alignment)
 {
     assert(size != 0);
     m_numAllocations++;
+    m_totalAllocations++;
 
     size_t mem = m_allocator.m_usedMemory;
     void* pMemory = m_allocator.Allocate(size, alignment);
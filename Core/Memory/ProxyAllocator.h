@@ -3,13 +3,16 @@
 #include "BaseAllocator.h"
 
 #include <cstdint>
+#include <string>
 
 namespace Farlor {
 
-// Intended to be used per subsystem to access the same memory block
+// Intended to be used per subsystem to access the same memory block. Registers itself under
+// its subsystem name so memory use can be attributed.
 class ProxyAllocator : public Allocator
 {
-    ProxyAllocator(Allocator& allocator);
+public:
+    ProxyAllocator(const std::string& name, Allocator& allocator);
     ~ProxyAllocator();
 
     virtual void* Allocate(size_t size, uint8_t alignment) override;
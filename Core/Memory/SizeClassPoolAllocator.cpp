@@ -0,0 +1,294 @@
+#include "SizeClassPoolAllocator.h"
+
+#include <bit>
+#include <cassert>
+
+namespace Farlor {
+
+namespace {
+
+const uint32_t SizeClassSizes[] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512
+};
+
+const size_t ObjectAlignment = 16;
+
+}
+
+SizeClassPoolAllocator::SizeClassPoolAllocator(Allocator& parent, size_t chunkSize)
+    : Allocator(parent.m_size, parent.m_pStart)
+    , m_parent(parent)
+    , m_chunkSize(chunkSize)
+{
+    static_assert(sizeof(SizeClassSizes) / sizeof(SizeClassSizes[0]) == NumSizeClasses);
+    assert(chunkSize >= 4 * MaxSmallSize && "Chunks should hold a few of the largest objects");
+    assert(chunkSize / ObjectAlignment <= MaxObjectsPerChunk && "Chunk bitmap too small");
+
+    uint32_t sizeClass = 0;
+    for (uint32_t step = 0; step <= MaxSmallSize / 16; step++)
+    {
+        while (SizeClassSizes[sizeClass] < step * 16)
+            sizeClass++;
+        m_sizeClassLookup[step] = uint8_t(sizeClass);
+    }
+
+    for (uint32_t classIdx = 0; classIdx < NumSizeClasses; classIdx++)
+    {
+        m_sizeClasses[classIdx].objectSize = SizeClassSizes[classIdx];
+        m_sizeClasses[classIdx].numChunks = 0;
+        m_sizeClasses[classIdx].pPartial = nullptr;
+    }
+
+    size_t numPages = (parent.m_size + chunkSize - 1) / chunkSize;
+    m_pageTable.assign(2 * numPages, nullptr);
+}
+
+SizeClassPoolAllocator::~SizeClassPoolAllocator()
+{
+    // Only the chunks kept around empty should be left
+    for (SizeClass& sizeClass : m_sizeClasses)
+    {
+        while (sizeClass.pPartial != nullptr)
+            ReleaseChunk(sizeClass.pPartial);
+    }
+}
+
+void* SizeClassPoolAllocator::Allocate(size_t size, uint8_t alignment)
+{
+    assert(size != 0);
+
+    if (size > MaxSmallSize || alignment > ObjectAlignment)
+        return AllocateFromParent(size, alignment);
+
+    uint32_t classIdx = m_sizeClassLookup[(size + 15) / 16];
+    SizeClass& sizeClass = m_sizeClasses[classIdx];
+    Chunk* pChunk = sizeClass.pPartial;
+    if (pChunk == nullptr)
+    {
+        pChunk = NewChunk(classIdx);
+        if (pChunk == nullptr)
+            return nullptr;
+    }
+
+    // Lowest free slot of the lowest chunk with room
+    uint32_t word = uint32_t(std::countr_zero(pChunk->summary));
+    uint32_t bit = uint32_t(std::countr_zero(pChunk->pFreeBits[word]));
+    pChunk->pFreeBits[word] &= ~(uint64_t(1) << bit);
+    if (pChunk->pFreeBits[word] == 0)
+        pChunk->summary &= ~(uint64_t(1) << word);
+
+    pChunk->numUsed++;
+    if (pChunk->numUsed == pChunk->numObjects)
+        RemovePartial(pChunk);
+
+    m_usedMemory += pChunk->objectSize;
+    m_numAllocations++;
+    m_totalAllocations++;
+    return pChunk->pObjects + size_t(word * 64 + bit) * pChunk->objectSize;
+}
+
+void SizeClassPoolAllocator::Deallocate(void* pMemory)
+{
+    assert(pMemory != nullptr);
+
+    Chunk* pChunk = FindChunk(pMemory);
+    if (pChunk == nullptr)
+    {
+        DeallocateFromParent(pMemory);
+        return;
+    }
+
+    size_t slot = size_t((uint8_t*)pMemory - pChunk->pObjects) / pChunk->objectSize;
+    uint32_t word = uint32_t(slot / 64);
+    uint64_t mask = uint64_t(1) << (slot % 64);
+    assert((pChunk->pFreeBits[word] & mask) == 0 && "Object freed twice");
+    pChunk->pFreeBits[word] |= mask;
+    pChunk->summary |= uint64_t(1) << word;
+
+    bool wasFull = pChunk->numUsed == pChunk->numObjects;
+    pChunk->numUsed--;
+    m_usedMemory -= pChunk->objectSize;
+    m_numAllocations--;
+
+    if (wasFull)
+        InsertPartial(pChunk);
+
+    // Keep the last chunk of a class around so a size that is allocated and freed in a loop
+    // does not go to the parent every time
+    if (pChunk->numUsed == 0 && m_sizeClasses[pChunk->sizeClass].numChunks > 1)
+        ReleaseChunk(pChunk);
+}
+
+SizeClassPoolAllocator::Statistics SizeClassPoolAllocator::GetStatistics() const
+{
+    Statistics statistics = {};
+    for (const SizeClass& sizeClass : m_sizeClasses)
+        statistics.m_numChunks += sizeClass.numChunks;
+    statistics.m_chunkBytes = statistics.m_numChunks * m_chunkSize;
+
+    // Every chunk starts in exactly one page
+    for (size_t pageSlot = 0; pageSlot < m_pageTable.size(); pageSlot += 2)
+    {
+        const Chunk* pChunk = m_pageTable[pageSlot];
+        if (pChunk != nullptr)
+        {
+            statistics.m_numSmallObjects += pChunk->numUsed;
+            statistics.m_wastedBytes += m_chunkSize - size_t(pChunk->numUsed) * pChunk->objectSize;
+        }
+    }
+    return statistics;
+}
+
+float SizeClassPoolAllocator::GetFragmentation() const
+{
+    Statistics statistics = GetStatistics();
+    if (statistics.m_chunkBytes == 0)
+        return 0.0f;
+    return float(statistics.m_wastedBytes) / float(statistics.m_chunkBytes);
+}
+
+SizeClassPoolAllocator::Chunk* SizeClassPoolAllocator::NewChunk(uint32_t sizeClass)
+{
+    void* pMemory = m_parent.Allocate(m_chunkSize, uint8_t(ObjectAlignment));
+    if (pMemory == nullptr)
+        return nullptr;
+
+    uintptr_t start = (uintptr_t)pMemory;
+    uintptr_t parentStart = (uintptr_t)m_parent.m_pStart;
+    assert(start >= parentStart && start + m_chunkSize <= parentStart + m_parent.m_size
+        && "Parent allocated a chunk outside its memory range");
+
+    // Header and bitmap first, sized for the most objects that could follow them
+    uint32_t objectSize = SizeClassSizes[sizeClass];
+    size_t maxObjects = m_chunkSize / objectSize;
+    size_t numWords = (maxObjects + 63) / 64;
+    size_t headerSize = (sizeof(Chunk) + numWords * sizeof(uint64_t) + ObjectAlignment - 1)
+        & ~(ObjectAlignment - 1);
+
+    Chunk* pChunk = (Chunk*)pMemory;
+    pChunk->pNextPartial = nullptr;
+    pChunk->pPrevPartial = nullptr;
+    pChunk->pFreeBits = (uint64_t*)(start + sizeof(Chunk));
+    pChunk->pObjects = (uint8_t*)(start + headerSize);
+    pChunk->sizeClass = sizeClass;
+    pChunk->objectSize = objectSize;
+    pChunk->numObjects = uint32_t((m_chunkSize - headerSize) / objectSize);
+    pChunk->numUsed = 0;
+    pChunk->summary = 0;
+    for (size_t word = 0; word < numWords; word++)
+    {
+        size_t firstSlot = word * 64;
+        size_t numSlots = (pChunk->numObjects > firstSlot) ? pChunk->numObjects - firstSlot : 0;
+        pChunk->pFreeBits[word] = (numSlots >= 64) ? ~uint64_t(0)
+            : ((uint64_t(1) << numSlots) - 1);
+        if (pChunk->pFreeBits[word] != 0)
+            pChunk->summary |= uint64_t(1) << word;
+    }
+
+    size_t firstPage = (start - parentStart) / m_chunkSize;
+    size_t lastPage = (start + m_chunkSize - 1 - parentStart) / m_chunkSize;
+    m_pageTable[2 * firstPage] = pChunk;
+    if (lastPage != firstPage)
+        m_pageTable[2 * lastPage + 1] = pChunk;
+
+    m_sizeClasses[sizeClass].numChunks++;
+    InsertPartial(pChunk);
+    return pChunk;
+}
+
+void SizeClassPoolAllocator::ReleaseChunk(Chunk* pChunk)
+{
+    assert(pChunk->numUsed == 0);
+
+    uintptr_t start = (uintptr_t)pChunk;
+    uintptr_t parentStart = (uintptr_t)m_parent.m_pStart;
+    size_t firstPage = (start - parentStart) / m_chunkSize;
+    size_t lastPage = (start + m_chunkSize - 1 - parentStart) / m_chunkSize;
+    m_pageTable[2 * firstPage] = nullptr;
+    if (lastPage != firstPage)
+        m_pageTable[2 * lastPage + 1] = nullptr;
+
+    RemovePartial(pChunk);
+    m_sizeClasses[pChunk->sizeClass].numChunks--;
+    m_parent.Deallocate(pChunk);
+}
+
+SizeClassPoolAllocator::Chunk* SizeClassPoolAllocator::FindChunk(const void* pMemory) const
+{
+    uintptr_t address = (uintptr_t)pMemory;
+    uintptr_t parentStart = (uintptr_t)m_parent.m_pStart;
+    if (address < parentStart || address >= parentStart + m_parent.m_size)
+        return nullptr;
+
+    size_t page = (address - parentStart) / m_chunkSize;
+    for (uint32_t pageSlot = 0; pageSlot < 2; pageSlot++)
+    {
+        Chunk* pChunk = m_pageTable[2 * page + pageSlot];
+        if (pChunk != nullptr && address >= (uintptr_t)pChunk->pObjects
+            && address < (uintptr_t)pChunk + m_chunkSize)
+        {
+            return pChunk;
+        }
+    }
+    return nullptr;
+}
+
+void SizeClassPoolAllocator::InsertPartial(Chunk* pChunk)
+{
+    // Chunks only join the list when they get their first free slot, so a linear walk here
+    // keeps the list sorted without slowing the common paths down
+    SizeClass& sizeClass = m_sizeClasses[pChunk->sizeClass];
+    Chunk* pPrev = nullptr;
+    Chunk* pNext = sizeClass.pPartial;
+    while (pNext != nullptr && pNext < pChunk)
+    {
+        pPrev = pNext;
+        pNext = pNext->pNextPartial;
+    }
+
+    pChunk->pPrevPartial = pPrev;
+    pChunk->pNextPartial = pNext;
+    if (pNext != nullptr)
+        pNext->pPrevPartial = pChunk;
+    if (pPrev != nullptr)
+        pPrev->pNextPartial = pChunk;
+    else
+        sizeClass.pPartial = pChunk;
+}
+
+void SizeClassPoolAllocator::RemovePartial(Chunk* pChunk)
+{
+    SizeClass& sizeClass = m_sizeClasses[pChunk->sizeClass];
+    if (pChunk->pNextPartial != nullptr)
+        pChunk->pNextPartial->pPrevPartial = pChunk->pPrevPartial;
+    if (pChunk->pPrevPartial != nullptr)
+        pChunk->pPrevPartial->pNextPartial = pChunk->pNextPartial;
+    else
+        sizeClass.pPartial = pChunk->pNextPartial;
+
+    pChunk->pNextPartial = nullptr;
+    pChunk->pPrevPartial = nullptr;
+}
+
+void* SizeClassPoolAllocator::AllocateFromParent(size_t size, uint8_t alignment)
+{
+    size_t mem = m_parent.m_usedMemory;
+    void* pMemory = m_parent.Allocate(size, alignment);
+    if (pMemory == nullptr)
+        return nullptr;
+
+    m_usedMemory += m_parent.m_usedMemory - mem;
+    m_numAllocations++;
+    m_totalAllocations++;
+    return pMemory;
+}
+
+void SizeClassPoolAllocator::DeallocateFromParent(void* pMemory)
+{
+    size_t mem = m_parent.m_usedMemory;
+    m_parent.Deallocate(pMemory);
+    m_usedMemory -= mem - m_parent.m_usedMemory;
+    m_numAllocations--;
+}
+
+}
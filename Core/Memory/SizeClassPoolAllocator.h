@@ -0,0 +1,99 @@
+#pragma once
+
+#include "BaseAllocator.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// Small object allocator with one growable pool per size class, 16 to 512 bytes in steps that
+// widen with the size. Each pool is a list of fixed size chunks taken from the parent allocator
+// as needed, and chunks that empty out go back to the parent. Inside a chunk free slots are
+// tracked in a two level bitmap and the lowest address is always handed out first, and chunks
+// with free slots are kept in address order, so live objects pack into the fewest, lowest chunks.
+// Requests above 512 bytes or aligned past 16 bytes go straight to the parent.
+class SizeClassPoolAllocator : public Allocator
+{
+public:
+    static constexpr size_t MaxSmallSize = 512;
+    static constexpr size_t DefaultChunkSize = 16 * 1024;
+
+    struct Statistics
+    {
+        size_t m_numChunks;
+        size_t m_chunkBytes;
+        size_t m_numSmallObjects;
+        // Bytes of the chunks not holding objects, including chunk headers and partly
+        // filled size class slots
+        size_t m_wastedBytes;
+    };
+
+public:
+    // Chunks are found from an object address through a table over the parent's memory range,
+    // so the parent must hand out memory from inside [m_pStart, m_pStart + m_size)
+    SizeClassPoolAllocator(Allocator& parent, size_t chunkSize = DefaultChunkSize);
+    ~SizeClassPoolAllocator();
+
+    virtual void* Allocate(size_t size, uint8_t alignment = 4) override;
+    virtual void Deallocate(void* pMemory) override;
+
+    // Walks the page table, so meant for reporting rather than per frame use
+    Statistics GetStatistics() const;
+    // Share of the chunk memory not holding objects
+    virtual float GetFragmentation() const override;
+
+private:
+    SizeClassPoolAllocator(const SizeClassPoolAllocator&); // Prevent copies
+    SizeClassPoolAllocator& operator=(const SizeClassPoolAllocator&);
+
+    // Lives at the start of the chunk memory, followed by the free slot bitmap and then the
+    // objects
+    struct Chunk
+    {
+        Chunk* pNextPartial;
+        Chunk* pPrevPartial;
+        uint8_t* pObjects;
+        uint32_t sizeClass;
+        uint32_t objectSize;
+        uint32_t numObjects;
+        uint32_t numUsed;
+        // Bit w is set while word w of the free bitmap has a free slot
+        uint64_t summary;
+        uint64_t* pFreeBits;
+    };
+
+    struct SizeClass
+    {
+        uint32_t objectSize;
+        uint32_t numChunks;
+        // Chunks with at least one free slot, in address order
+        Chunk* pPartial;
+    };
+
+    static constexpr uint32_t NumSizeClasses = 16;
+    static constexpr uint32_t MaxObjectsPerChunk = 64 * 64;
+
+    Chunk* NewChunk(uint32_t sizeClass);
+    void ReleaseChunk(Chunk* pChunk);
+    Chunk* FindChunk(const void* pMemory) const;
+
+    void InsertPartial(Chunk* pChunk);
+    void RemovePartial(Chunk* pChunk);
+
+    void* AllocateFromParent(size_t size, uint8_t alignment);
+    void DeallocateFromParent(void* pMemory);
+
+    Allocator& m_parent;
+    size_t m_chunkSize;
+
+    SizeClass m_sizeClasses[NumSizeClasses];
+    // Size class of each request size, in 16 byte steps
+    uint8_t m_sizeClassLookup[MaxSmallSize / 16 + 1];
+
+    // Two slots per chunk sized page of the parent's range: the chunk that starts in the page,
+    // and the chunk that starts in the page before and runs into it
+    std::vector<Chunk*> m_pageTable;
+};
+
+}
@@ -7,10 +7,13 @@ namespace Farlor {
 StackAllocator::StackAllocator(size_t size, void* pStart)
     : Allocator(size, pStart)
     , m_pCurrentPosition(pStart)
+    , m_pTopPosition((void*)((uintptr_t)pStart + size))
+    , m_numBottomAllocations(0)
 {
     assert(size > 0);
     #if _DEBUG
     m_pPrevPosition = nullptr;
+    m_pPrevTopAddress = nullptr;
     #endif
 }
 
@@ -18,9 +21,11 @@ StackAllocator::~StackAllocator()
 {
     #if _DEBUG
     m_pPrevPosition = nullptr;
+    m_pPrevTopAddress = nullptr;
     #endif
 
     m_pCurrentPosition = nullptr;
+    m_pTopPosition = nullptr;
 }
 
 void* StackAllocator::Allocate(size_t size, uint8_t alignment)
@@ -28,7 +33,7 @@ void* StackAllocator::Allocate(size_t size, uint8_t alignment)
     assert(size != 0);
 
     uint8_t adjustment = AlignForwardAdjustmentWithHeader(m_pCurrentPosition, alignment, sizeof(StackAllocationHeader));
-    if (m_usedMemory + adjustment + size > m_size)
+    if (adjustment + size > GetFreeMemory())
         return nullptr;
 
     void* pAlignedAddress = (void*)((uintptr_t)m_pCurrentPosition + adjustment);
@@ -43,12 +48,22 @@ void* StackAllocator::Allocate(size_t size, uint8_t alignment)
     m_pCurrentPosition = (void*)((uintptr_t)pAlignedAddress + size);
     m_usedMemory += size + adjustment;
     m_numAllocations++;
+    m_numBottomAllocations++;
+    m_totalAllocations++;
     return pAlignedAddress;
 }
 
 void StackAllocator::Deallocate(void* pMemory)
 {
-    assert(pMemory == m_pPrevPosition);
+    if ((uintptr_t)pMemory >= (uintptr_t)m_pTopPosition)
+    {
+        DeallocateTop(pMemory);
+        return;
+    }
+
+    #if _DEBUG
+    assert(pMemory == m_pPrevPosition && "Stack allocations must be freed in reverse order");
+    #endif
 
     StackAllocationHeader* header = (StackAllocationHeader*)((uintptr_t)pMemory - sizeof(StackAllocationHeader));
     m_usedMemory -= (uintptr_t)m_pCurrentPosition - (uintptr_t)pMemory + header->adjustment;
@@ -58,7 +73,111 @@ void StackAllocator::Deallocate(void* pMemory)
     m_pPrevPosition = header->pPrevAddress;
     #endif
 
+    m_numAllocations--;
+    m_numBottomAllocations--;
+}
+
+void* StackAllocator::AllocateTop(size_t size, uint8_t alignment)
+{
+    assert(size != 0);
+
+    // Aligned down from the top, with the header below the allocation
+    uintptr_t top = (uintptr_t)m_pTopPosition;
+    uintptr_t bottom = (uintptr_t)m_pCurrentPosition;
+    uintptr_t minimum = bottom + sizeof(TopAllocationHeader);
+    if (top < minimum || top - minimum < size)
+        return nullptr;
+
+    uintptr_t alignedAddress = (top - size) & ~uintptr_t(alignment - 1);
+    uintptr_t headerAddress = (alignedAddress - sizeof(TopAllocationHeader))
+        & ~uintptr_t(alignof(TopAllocationHeader) - 1);
+    if (alignedAddress < minimum || headerAddress < bottom)
+        return nullptr;
+
+    TopAllocationHeader* header = (TopAllocationHeader*)headerAddress;
+    header->pPrevTop = m_pTopPosition;
+    #if _DEBUG
+    header->pPrevAddress = m_pPrevTopAddress;
+    m_pPrevTopAddress = (void*)alignedAddress;
+    #endif
+
+    m_pTopPosition = (void*)headerAddress;
+    m_usedMemory += top - headerAddress;
+    m_numAllocations++;
+    m_totalAllocations++;
+    return (void*)alignedAddress;
+}
+
+void StackAllocator::DeallocateTop([[maybe_unused]] void* pMemory)
+{
+    #if _DEBUG
+    assert(pMemory == m_pPrevTopAddress && "Stack allocations must be freed in reverse order");
+    #endif
+
+    // The header sits at the current top, just below the allocation
+    TopAllocationHeader* header = (TopAllocationHeader*)m_pTopPosition;
+    assert((uintptr_t)pMemory > (uintptr_t)header && (uintptr_t)pMemory < (uintptr_t)header->pPrevTop);
+    m_usedMemory -= (uintptr_t)header->pPrevTop - (uintptr_t)m_pTopPosition;
+    m_pTopPosition = header->pPrevTop;
+
+    #if _DEBUG
+    m_pPrevTopAddress = header->pPrevAddress;
+    #endif
+
     m_numAllocations--;
 }
 
-}
\ No newline at end of file
+StackAllocator::Marker StackAllocator::GetMarker(End end) const
+{
+    Marker marker;
+    marker.end = end;
+    if (end == End::Bottom)
+    {
+        marker.pPosition = m_pCurrentPosition;
+        marker.numAllocations = m_numBottomAllocations;
+        #if _DEBUG
+        marker.pPrevAddress = m_pPrevPosition;
+        #endif
+    }
+    else
+    {
+        marker.pPosition = m_pTopPosition;
+        marker.numAllocations = m_numAllocations - m_numBottomAllocations;
+        #if _DEBUG
+        marker.pPrevAddress = m_pPrevTopAddress;
+        #endif
+    }
+    return marker;
+}
+
+void StackAllocator::FreeToMarker(const Marker& marker)
+{
+    if (marker.end == End::Bottom)
+    {
+        assert((uintptr_t)marker.pPosition <= (uintptr_t)m_pCurrentPosition
+            && marker.numAllocations <= m_numBottomAllocations && "Marker was already freed past");
+
+        m_usedMemory -= (uintptr_t)m_pCurrentPosition - (uintptr_t)marker.pPosition;
+        m_numAllocations -= m_numBottomAllocations - marker.numAllocations;
+        m_numBottomAllocations = marker.numAllocations;
+        m_pCurrentPosition = marker.pPosition;
+        #if _DEBUG
+        m_pPrevPosition = marker.pPrevAddress;
+        #endif
+    }
+    else
+    {
+        size_t numTopAllocations = m_numAllocations - m_numBottomAllocations;
+        assert((uintptr_t)marker.pPosition >= (uintptr_t)m_pTopPosition
+            && marker.numAllocations <= numTopAllocations && "Marker was already freed past");
+
+        m_usedMemory -= (uintptr_t)marker.pPosition - (uintptr_t)m_pTopPosition;
+        m_numAllocations -= numTopAllocations - marker.numAllocations;
+        m_pTopPosition = marker.pPosition;
+        #if _DEBUG
+        m_pPrevTopAddress = marker.pPrevAddress;
+        #endif
+    }
+}
+
+}
@@ -6,18 +6,53 @@
 
 namespace Farlor {
 
+// Allocations are freed in reverse order, either one at a time or all at once back to a
+// marker. The block can be used from both ends: Allocate grows up from the bottom, AllocateTop
+// grows down from the top, and the allocator is full when the two meet. Long lived data such
+// as a loaded level can then sit at the top while temporaries come and go at the bottom.
 class StackAllocator : public Allocator
 {
+public:
+    enum class End
+    {
+        Bottom,
+        Top
+    };
+
+    // Position of one end of the stack, to free everything allocated there since
+    struct Marker
+    {
+        End end;
+        void* pPosition;
+        size_t numAllocations;
+        #if _DEBUG
+        void* pPrevAddress;
+        #endif
+    };
+
+public:
     StackAllocator(size_t size, void* pStart);
     ~StackAllocator();
 
-    virtual void* Allocate(size_t size, uint8_t alignment) override;
+    virtual void* Allocate(size_t size, uint8_t alignment = 4) override;
+    // Frees the last allocation of either end
     virtual void Deallocate(void* pMemory) override;
 
+    void* AllocateTop(size_t size, uint8_t alignment = 4);
+
+    Marker GetMarker(End end = End::Bottom) const;
+    // Frees everything allocated at the marker's end since it was taken
+    void FreeToMarker(const Marker& marker);
+
+    // Bytes left between the two ends
+    size_t GetFreeMemory() const { return (uintptr_t)m_pTopPosition - (uintptr_t)m_pCurrentPosition; }
+
 private:
     StackAllocator(const StackAllocator&); // Prevent copies
     StackAllocator& operator=(const StackAllocator&);
 
+    void DeallocateTop(void* pMemory);
+
     struct StackAllocationHeader
     {
         #if _DEBUG
@@ -26,11 +61,48 @@ private:
         uint8_t adjustment;
     };
 
+    // Top allocations can need more padding than fits in a byte, so they keep the old top
+    struct TopAllocationHeader
+    {
+        #if _DEBUG
+        void* pPrevAddress;
+        #endif
+        void* pPrevTop;
+    };
+
     #if _DEBUG
     void* m_pPrevPosition;
+    void* m_pPrevTopAddress;
     #endif
 
     void* m_pCurrentPosition;
+    void* m_pTopPosition;
+    size_t m_numBottomAllocations;
+};
+
+// Frees everything allocated from one end of a StackAllocator during its lifetime. Destructors
+// are not run, so use it for plain data or destroy objects before the scope ends.
+class StackAllocatorScope
+{
+public:
+    explicit StackAllocatorScope(StackAllocator& allocator,
+        StackAllocator::End end = StackAllocator::End::Bottom)
+        : m_allocator(allocator)
+        , m_marker(allocator.GetMarker(end))
+    {
+    }
+
+    ~StackAllocatorScope()
+    {
+        m_allocator.FreeToMarker(m_marker);
+    }
+
+private:
+    StackAllocatorScope(const StackAllocatorScope&); // Prevent copies
+    StackAllocatorScope& operator=(const StackAllocatorScope&);
+
+    StackAllocator& m_allocator;
+    StackAllocator::Marker m_marker;
 };
 
-}
\ No newline at end of file
+}
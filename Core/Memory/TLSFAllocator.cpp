@@ -0,0 +1,334 @@
+#include "TLSFAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace Farlor {
+
+TLSFAllocator::TLSFAllocator(size_t size, void* pStart)
+    : Allocator(size, pStart)
+    , m_firstLevelBitmap(0)
+    , m_pFirstBlock(nullptr)
+{
+    for (uint32_t firstLevel = 0; firstLevel < FirstLevelCount; firstLevel++)
+    {
+        m_secondLevelBitmaps[firstLevel] = 0;
+        for (uint32_t secondLevel = 0; secondLevel < SecondLevelCount; secondLevel++)
+            m_pFreeLists[firstLevel][secondLevel] = nullptr;
+    }
+
+    // One free block spanning the memory, followed by an empty used block that stops merges
+    // and walks at the end
+    uint8_t adjustment = AlignForwardAdjustment(pStart, Granularity);
+    assert(size > adjustment + 2 * BlockOverhead + MinBlockSize && "TLSF memory block too small");
+    size_t blockSize = (size - adjustment - 2 * BlockOverhead) & ~(Granularity - 1);
+    assert(blockSize < (size_t(1) << FirstLevelMax) && "TLSF memory block too large");
+
+    m_pFirstBlock = (BlockHeader*)((uintptr_t)pStart + adjustment);
+    m_pFirstBlock->pPrevPhysical = nullptr;
+    m_pFirstBlock->sizeAndFlags = blockSize | FreeFlag;
+
+    BlockHeader* pSentinel = NextPhysical(m_pFirstBlock);
+    pSentinel->pPrevPhysical = m_pFirstBlock;
+    pSentinel->sizeAndFlags = 0;
+
+    InsertFreeBlock(m_pFirstBlock);
+}
+
+TLSFAllocator::~TLSFAllocator()
+{
+    m_pFirstBlock = nullptr;
+}
+
+void* TLSFAllocator::Allocate(size_t size, uint8_t alignment)
+{
+    assert(size != 0);
+
+    size_t adjustedSize = std::max((size + Granularity - 1) & ~(Granularity - 1), MinBlockSize);
+
+    // Over aligned requests ask for enough slack to cut a free block off the front
+    bool overAligned = alignment > Granularity;
+    size_t searchSize = adjustedSize;
+    if (overAligned)
+        searchSize += alignment + BlockOverhead + MinBlockSize;
+
+    BlockHeader* pBlock = FindFreeBlock(searchSize);
+    if (pBlock == nullptr)
+        return nullptr;
+    RemoveFreeBlock(pBlock);
+
+    uintptr_t payload = (uintptr_t)BlockPayload(pBlock);
+    if (overAligned && (payload & (alignment - 1)) != 0)
+    {
+        uintptr_t alignedPayload = (uintptr_t)AlignForward(
+            (void*)(payload + BlockOverhead + MinBlockSize), alignment);
+        size_t gap = alignedPayload - payload;
+
+        BlockHeader* pAligned = PayloadBlock((void*)alignedPayload);
+        pAligned->pPrevPhysical = pBlock;
+        pAligned->sizeAndFlags = BlockSize(pBlock) - gap;
+        NextPhysical(pAligned)->pPrevPhysical = pAligned;
+
+        // The block was free, so the block before it is used and the front stays on its own
+        pBlock->sizeAndFlags = (gap - BlockOverhead) | FreeFlag;
+        InsertFreeBlock(pBlock);
+        pBlock = pAligned;
+    }
+
+    TrimTail(pBlock, adjustedSize);
+    pBlock->sizeAndFlags &= ~FreeFlag;
+
+    m_usedMemory += BlockSize(pBlock);
+    m_numAllocations++;
+    m_totalAllocations++;
+    return BlockPayload(pBlock);
+}
+
+void TLSFAllocator::Deallocate(void* pMemory)
+{
+    assert(pMemory != nullptr);
+
+    BlockHeader* pBlock = PayloadBlock(pMemory);
+    assert(!IsFree(pBlock) && "Block freed twice");
+
+    m_usedMemory -= BlockSize(pBlock);
+    m_numAllocations--;
+    pBlock->sizeAndFlags |= FreeFlag;
+
+    BlockHeader* pPrev = pBlock->pPrevPhysical;
+    if (pPrev != nullptr && IsFree(pPrev))
+    {
+        RemoveFreeBlock(pPrev);
+        pBlock = MergeWithNext(pPrev);
+    }
+
+    BlockHeader* pNext = NextPhysical(pBlock);
+    if (IsFree(pNext))
+    {
+        RemoveFreeBlock(pNext);
+        pBlock = MergeWithNext(pBlock);
+    }
+
+    InsertFreeBlock(pBlock);
+}
+
+TLSFAllocator::Statistics TLSFAllocator::GetStatistics() const
+{
+    Statistics statistics = {};
+    for (const BlockHeader* pBlock = m_pFirstBlock; BlockSize(pBlock) != 0;
+        pBlock = NextPhysical(pBlock))
+    {
+        statistics.m_overheadBytes += BlockOverhead;
+        if (IsFree(pBlock))
+        {
+            statistics.m_freeBytes += BlockSize(pBlock);
+            statistics.m_largestFreeBlock = std::max(statistics.m_largestFreeBlock,
+                BlockSize(pBlock));
+            statistics.m_numFreeBlocks++;
+        }
+        else
+        {
+            statistics.m_numUsedBlocks++;
+        }
+    }
+    return statistics;
+}
+
+float TLSFAllocator::GetFragmentation() const
+{
+    Statistics statistics = GetStatistics();
+    if (statistics.m_freeBytes == 0)
+        return 0.0f;
+    return 1.0f - float(statistics.m_largestFreeBlock) / float(statistics.m_freeBytes);
+}
+
+bool TLSFAllocator::CheckConsistency() const
+{
+    size_t numFreeBlocks = 0;
+    const BlockHeader* pPrev = nullptr;
+    for (const BlockHeader* pBlock = m_pFirstBlock; ; pBlock = NextPhysical(pBlock))
+    {
+        if (pBlock->pPrevPhysical != pPrev)
+            return false;
+        if (BlockSize(pBlock) == 0)
+            break;
+        if (IsFree(pBlock))
+        {
+            // Free neighbours should always have been merged
+            if (pPrev != nullptr && IsFree(pPrev))
+                return false;
+
+            uint32_t firstLevel = 0;
+            uint32_t secondLevel = 0;
+            MappingInsert(BlockSize(pBlock), firstLevel, secondLevel);
+            const BlockHeader* pListed = m_pFreeLists[firstLevel][secondLevel];
+            while (pListed != nullptr && pListed != pBlock)
+                pListed = pListed->pNextFree;
+            if (pListed == nullptr)
+                return false;
+            numFreeBlocks++;
+        }
+        pPrev = pBlock;
+    }
+
+    size_t numListedBlocks = 0;
+    for (uint32_t firstLevel = 0; firstLevel < FirstLevelCount; firstLevel++)
+    {
+        bool firstLevelSet = (m_firstLevelBitmap >> firstLevel) & 1;
+        if (firstLevelSet != (m_secondLevelBitmaps[firstLevel] != 0))
+            return false;
+        for (uint32_t secondLevel = 0; secondLevel < SecondLevelCount; secondLevel++)
+        {
+            const BlockHeader* pListed = m_pFreeLists[firstLevel][secondLevel];
+            bool secondLevelSet = (m_secondLevelBitmaps[firstLevel] >> secondLevel) & 1;
+            if (secondLevelSet != (pListed != nullptr))
+                return false;
+            for (; pListed != nullptr; pListed = pListed->pNextFree)
+                numListedBlocks++;
+        }
+    }
+    return numListedBlocks == numFreeBlocks;
+}
+
+size_t TLSFAllocator::BlockSize(const BlockHeader* pBlock)
+{
+    return pBlock->sizeAndFlags & ~FreeFlag;
+}
+
+bool TLSFAllocator::IsFree(const BlockHeader* pBlock)
+{
+    return (pBlock->sizeAndFlags & FreeFlag) != 0;
+}
+
+void* TLSFAllocator::BlockPayload(const BlockHeader* pBlock)
+{
+    return (void*)((uintptr_t)pBlock + BlockOverhead);
+}
+
+TLSFAllocator::BlockHeader* TLSFAllocator::PayloadBlock(const void* pMemory)
+{
+    return (BlockHeader*)((uintptr_t)pMemory - BlockOverhead);
+}
+
+TLSFAllocator::BlockHeader* TLSFAllocator::NextPhysical(const BlockHeader* pBlock)
+{
+    return (BlockHeader*)((uintptr_t)BlockPayload(pBlock) + BlockSize(pBlock));
+}
+
+void TLSFAllocator::MappingInsert(size_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+    if (size < SmallBlockSize)
+    {
+        // Small blocks get linear buckets of Granularity bytes in the first list
+        firstLevel = 0;
+        secondLevel = uint32_t(size / (SmallBlockSize / SecondLevelCount));
+        return;
+    }
+
+    uint32_t topBit = uint32_t(std::bit_width(size)) - 1;
+    secondLevel = uint32_t(size >> (topBit - SecondLevelLog2)) ^ SecondLevelCount;
+    firstLevel = topBit - (FirstLevelShift - 1);
+}
+
+void TLSFAllocator::MappingSearch(size_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+    // Round up to the next bucket so any block found there is big enough
+    if (size >= SmallBlockSize)
+    {
+        uint32_t topBit = uint32_t(std::bit_width(size)) - 1;
+        size += (size_t(1) << (topBit - SecondLevelLog2)) - 1;
+    }
+    MappingInsert(size, firstLevel, secondLevel);
+}
+
+void TLSFAllocator::InsertFreeBlock(BlockHeader* pBlock)
+{
+    uint32_t firstLevel = 0;
+    uint32_t secondLevel = 0;
+    MappingInsert(BlockSize(pBlock), firstLevel, secondLevel);
+
+    BlockHeader* pHead = m_pFreeLists[firstLevel][secondLevel];
+    pBlock->pNextFree = pHead;
+    pBlock->pPrevFree = nullptr;
+    if (pHead != nullptr)
+        pHead->pPrevFree = pBlock;
+    m_pFreeLists[firstLevel][secondLevel] = pBlock;
+
+    m_firstLevelBitmap |= 1u << firstLevel;
+    m_secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void TLSFAllocator::RemoveFreeBlock(BlockHeader* pBlock)
+{
+    uint32_t firstLevel = 0;
+    uint32_t secondLevel = 0;
+    MappingInsert(BlockSize(pBlock), firstLevel, secondLevel);
+
+    if (pBlock->pNextFree != nullptr)
+        pBlock->pNextFree->pPrevFree = pBlock->pPrevFree;
+    if (pBlock->pPrevFree != nullptr)
+    {
+        pBlock->pPrevFree->pNextFree = pBlock->pNextFree;
+        return;
+    }
+
+    m_pFreeLists[firstLevel][secondLevel] = pBlock->pNextFree;
+    if (pBlock->pNextFree == nullptr)
+    {
+        m_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+        if (m_secondLevelBitmaps[firstLevel] == 0)
+            m_firstLevelBitmap &= ~(1u << firstLevel);
+    }
+}
+
+TLSFAllocator::BlockHeader* TLSFAllocator::FindFreeBlock(size_t size)
+{
+    uint32_t firstLevel = 0;
+    uint32_t secondLevel = 0;
+    MappingSearch(size, firstLevel, secondLevel);
+    if (firstLevel >= FirstLevelCount)
+        return nullptr;
+
+    // A bigger bucket in the same power of two, or else the smallest non empty larger one
+    uint32_t secondLevelMap = m_secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0)
+    {
+        uint32_t firstLevelMap = 0;
+        if (firstLevel + 1 < FirstLevelCount)
+            firstLevelMap = m_firstLevelBitmap & (~0u << (firstLevel + 1));
+        if (firstLevelMap == 0)
+            return nullptr;
+
+        firstLevel = uint32_t(std::countr_zero(firstLevelMap));
+        secondLevelMap = m_secondLevelBitmaps[firstLevel];
+    }
+    secondLevel = uint32_t(std::countr_zero(secondLevelMap));
+    return m_pFreeLists[firstLevel][secondLevel];
+}
+
+void TLSFAllocator::TrimTail(BlockHeader* pBlock, size_t size)
+{
+    if (BlockSize(pBlock) < size + BlockOverhead + MinBlockSize)
+        return;
+
+    BlockHeader* pRemainder = (BlockHeader*)((uintptr_t)BlockPayload(pBlock) + size);
+    pRemainder->pPrevPhysical = pBlock;
+    pRemainder->sizeAndFlags = (BlockSize(pBlock) - size - BlockOverhead) | FreeFlag;
+    NextPhysical(pRemainder)->pPrevPhysical = pRemainder;
+    pBlock->sizeAndFlags = size | (pBlock->sizeAndFlags & FreeFlag);
+
+    // Blocks are only trimmed straight out of a free list, so the next block is used
+    InsertFreeBlock(pRemainder);
+}
+
+TLSFAllocator::BlockHeader* TLSFAllocator::MergeWithNext(BlockHeader* pBlock)
+{
+    BlockHeader* pNext = NextPhysical(pBlock);
+    size_t mergedSize = BlockSize(pBlock) + BlockOverhead + BlockSize(pNext);
+    pBlock->sizeAndFlags = mergedSize | (pBlock->sizeAndFlags & FreeFlag);
+    NextPhysical(pBlock)->pPrevPhysical = pBlock;
+    return pBlock;
+}
+
+}
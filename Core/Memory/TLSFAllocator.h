@@ -0,0 +1,93 @@
+#pragma once
+
+#include "BaseAllocator.h"
+
+#include <cstdint>
+
+namespace Farlor {
+
+// Two level segregated fit allocator over one memory block. Free blocks are kept in lists
+// bucketed by a power of two (first level) split into 32 linear steps (second level), with a
+// bitmap per level, so finding a fitting block and freeing are both O(1). Neighbouring free
+// blocks are merged on free, and a request never takes a block from a bucket more than one
+// step larger than it needs, which bounds fragmentation.
+class TLSFAllocator : public Allocator
+{
+public:
+    struct Statistics
+    {
+        size_t m_freeBytes;
+        size_t m_largestFreeBlock;
+        size_t m_numFreeBlocks;
+        size_t m_numUsedBlocks;
+        // Bytes taken by block headers, used or free
+        size_t m_overheadBytes;
+    };
+
+public:
+    TLSFAllocator(size_t size, void* pStart);
+    ~TLSFAllocator();
+
+    virtual void* Allocate(size_t size, uint8_t alignment = 4) override;
+    virtual void Deallocate(void* pMemory) override;
+
+    // Walks every block, so meant for reporting rather than per frame use
+    Statistics GetStatistics() const;
+    // One minus the largest free block over all free bytes; walks every block as well
+    virtual float GetFragmentation() const override;
+
+    // Walks every block and checks the free lists and bitmaps agree with them
+    bool CheckConsistency() const;
+
+private:
+    TLSFAllocator(const TLSFAllocator&); // Prevent copies
+    TLSFAllocator& operator=(const TLSFAllocator&);
+
+    // Header in front of every block. The free list links overlap the payload, so they only
+    // exist while the block is free.
+    struct BlockHeader
+    {
+        BlockHeader* pPrevPhysical;
+        size_t sizeAndFlags;
+        BlockHeader* pNextFree;
+        BlockHeader* pPrevFree;
+    };
+
+    static constexpr size_t Granularity = 16;
+    static constexpr size_t BlockOverhead = 2 * sizeof(void*);
+    static constexpr size_t MinBlockSize = 2 * sizeof(void*);
+
+    static constexpr uint32_t SecondLevelLog2 = 5;
+    static constexpr uint32_t SecondLevelCount = 1u << SecondLevelLog2;
+    static constexpr uint32_t FirstLevelShift = SecondLevelLog2 + 4;
+    static constexpr uint32_t FirstLevelMax = 40;
+    static constexpr uint32_t FirstLevelCount = FirstLevelMax - FirstLevelShift + 1;
+    static constexpr size_t SmallBlockSize = size_t(1) << FirstLevelShift;
+
+    static constexpr size_t FreeFlag = 1;
+
+    static size_t BlockSize(const BlockHeader* pBlock);
+    static bool IsFree(const BlockHeader* pBlock);
+    static void* BlockPayload(const BlockHeader* pBlock);
+    static BlockHeader* PayloadBlock(const void* pMemory);
+    static BlockHeader* NextPhysical(const BlockHeader* pBlock);
+
+    static void MappingInsert(size_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+    static void MappingSearch(size_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+
+    void InsertFreeBlock(BlockHeader* pBlock);
+    void RemoveFreeBlock(BlockHeader* pBlock);
+    BlockHeader* FindFreeBlock(size_t size);
+
+    // Splits the tail past size off as a new free block, if it is big enough to be one
+    void TrimTail(BlockHeader* pBlock, size_t size);
+    BlockHeader* MergeWithNext(BlockHeader* pBlock);
+
+    uint32_t m_firstLevelBitmap;
+    uint32_t m_secondLevelBitmaps[FirstLevelCount];
+    BlockHeader* m_pFreeLists[FirstLevelCount][SecondLevelCount];
+
+    BlockHeader* m_pFirstBlock;
+};
+
+}
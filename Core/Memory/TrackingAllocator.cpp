@@ -0,0 +1,320 @@
+#include "TrackingAllocator.h"
+
+#include "AllocatorRegistry.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#if FARLOR_TRACK_ALLOCATIONS
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define FARLOR_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define FARLOR_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+#endif
+
+namespace Farlor {
+
+#if FARLOR_TRACK_ALLOCATIONS
+
+namespace {
+
+struct AllocationSite
+{
+    const char* pFile;
+    const char* pFunction;
+    uint32_t line;
+};
+
+thread_local AllocationSite t_nextSite = {};
+
+const uint32_t LiveMagic = 0x4C495645;
+const uint32_t FreedMagic = 0x46524545;
+const uint32_t MaxStackDepth = 16;
+
+uint32_t HashAddresses(void* const* ppAddresses, uint32_t count)
+{
+    // FNV-1a over the address bytes
+    uint32_t hash = 2166136261u;
+    for (uint32_t addressIdx = 0; addressIdx < count; addressIdx++)
+    {
+        uintptr_t address = (uintptr_t)ppAddresses[addressIdx];
+        for (size_t byteIdx = 0; byteIdx < sizeof(address); byteIdx++)
+        {
+            hash ^= uint32_t((address >> (8 * byteIdx)) & 0xFF);
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+uint32_t HashStack(void* pReturnAddress, uint32_t stackDepth)
+{
+    if (stackDepth == 0)
+        return HashAddresses(&pReturnAddress, 1);
+
+    // Skips this function and TrackingAllocator::Allocate, keeping the caller
+    void* frames[MaxStackDepth + 3];
+    uint32_t numFrames = 0;
+#if defined(_MSC_VER)
+    numFrames = RtlCaptureStackBackTrace(2, std::min(stackDepth + 1, MaxStackDepth + 1), frames,
+        nullptr);
+    return HashAddresses(frames, numFrames);
+#elif defined(__GLIBC__)
+    numFrames = uint32_t(backtrace(frames, int(std::min(stackDepth, MaxStackDepth) + 3)));
+    return (numFrames > 2) ? HashAddresses(frames + 2, numFrames - 2)
+        : HashAddresses(&pReturnAddress, 1);
+#else
+    return HashAddresses(&pReturnAddress, 1);
+#endif
+}
+
+std::string FormatSite(const char* pFile, uint32_t line, const char* pFunction)
+{
+    if (pFile == nullptr)
+        return "untagged site";
+
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer), "%s:%u (%s)", pFile, line, pFunction);
+    return buffer;
+}
+
+}
+
+// Placed right in front of the allocation. Allocators tend to reuse the start of a freed block
+// for their own bookkeeping, so the fields checked on free come last.
+struct TrackingAllocator::AllocationRecord
+{
+    AllocationRecord* pPrev;
+    AllocationRecord* pNext;
+    void* pBase;
+
+    const char* pFile;
+    const char* pFunction;
+    uint32_t line;
+    uint32_t stackHash;
+    size_t size;
+    uint8_t alignment;
+
+    const TrackingAllocator* pOwner;
+    uint32_t magic;
+};
+
+void SetNextAllocationSite(const char* pFile, uint32_t line, const char* pFunction)
+{
+    t_nextSite.pFile = pFile;
+    t_nextSite.pFunction = pFunction;
+    t_nextSite.line = line;
+}
+
+#endif
+
+TrackingAllocator::TrackingAllocator(const std::string& name, Allocator& allocator,
+    [[maybe_unused]] uint32_t stackDepth)
+    : Allocator(allocator.m_size, allocator.m_pStart)
+    , m_name(name)
+    , m_allocator(allocator)
+    , m_numErrors(0)
+{
+    #if FARLOR_TRACK_ALLOCATIONS
+    m_stackDepth = stackDepth;
+    m_pLiveRecords = nullptr;
+    #endif
+
+    AllocatorRegistry::Get().Register(name, *this, &allocator);
+}
+
+TrackingAllocator::~TrackingAllocator()
+{
+    AllocatorRegistry::Get().Unregister(*this);
+
+    #if FARLOR_TRACK_ALLOCATIONS
+    if (m_pLiveRecords != nullptr)
+        std::fprintf(stderr, "%s", GetLeakReport().c_str());
+    #endif
+}
+
+void* TrackingAllocator::Allocate(size_t size, uint8_t alignment)
+{
+    assert(size != 0);
+
+    #if FARLOR_TRACK_ALLOCATIONS
+    AllocationSite site = t_nextSite;
+    t_nextSite = {};
+    uint32_t stackHash = HashStack(FARLOR_RETURN_ADDRESS(), m_stackDepth);
+
+    // The header is padded to the requested alignment so the allocation after it stays aligned
+    uint8_t baseAlignment = std::max<uint8_t>(alignment, alignof(AllocationRecord));
+    size_t headerSize = (sizeof(AllocationRecord) + baseAlignment - 1) & ~size_t(baseAlignment - 1);
+
+    size_t mem = m_allocator.m_usedMemory;
+    uint8_t* pBase = (uint8_t*)m_allocator.Allocate(headerSize + size, baseAlignment);
+    if (pBase == nullptr)
+        return nullptr;
+    m_usedMemory += m_allocator.m_usedMemory - mem;
+    m_numAllocations++;
+    m_totalAllocations++;
+
+    AllocationRecord* pRecord = (AllocationRecord*)(pBase + headerSize - sizeof(AllocationRecord));
+    pRecord->pPrev = nullptr;
+    pRecord->pNext = m_pLiveRecords;
+    if (m_pLiveRecords != nullptr)
+        m_pLiveRecords->pPrev = pRecord;
+    m_pLiveRecords = pRecord;
+
+    pRecord->pBase = pBase;
+    pRecord->pFile = site.pFile;
+    pRecord->pFunction = site.pFunction;
+    pRecord->line = site.line;
+    pRecord->stackHash = stackHash;
+    pRecord->size = size;
+    pRecord->alignment = alignment;
+    pRecord->pOwner = this;
+    pRecord->magic = LiveMagic;
+    return pBase + headerSize;
+    #else
+    size_t mem = m_allocator.m_usedMemory;
+    void* pMemory = m_allocator.Allocate(size, alignment);
+    if (pMemory == nullptr)
+        return nullptr;
+    m_usedMemory += m_allocator.m_usedMemory - mem;
+    m_numAllocations++;
+    m_totalAllocations++;
+    return pMemory;
+    #endif
+}
+
+void TrackingAllocator::Deallocate(void* pMemory)
+{
+    assert(pMemory != nullptr);
+
+    #if FARLOR_TRACK_ALLOCATIONS
+    AllocationRecord* pRecord = (AllocationRecord*)pMemory - 1;
+    if (pRecord->magic == FreedMagic)
+    {
+        ReportError("freed twice", pMemory, pRecord);
+        return;
+    }
+    if (pRecord->magic != LiveMagic)
+    {
+        ReportError("was not allocated by a TrackingAllocator", pMemory, nullptr);
+        return;
+    }
+    if (pRecord->pOwner != this)
+    {
+        ReportError("freed through the wrong allocator", pMemory, pRecord);
+        return;
+    }
+
+    if (pRecord->pPrev != nullptr)
+        pRecord->pPrev->pNext = pRecord->pNext;
+    else
+        m_pLiveRecords = pRecord->pNext;
+    if (pRecord->pNext != nullptr)
+        pRecord->pNext->pPrev = pRecord->pPrev;
+    pRecord->magic = FreedMagic;
+
+    size_t mem = m_allocator.m_usedMemory;
+    m_allocator.Deallocate(pRecord->pBase);
+    #else
+    size_t mem = m_allocator.m_usedMemory;
+    m_allocator.Deallocate(pMemory);
+    #endif
+
+    m_usedMemory -= mem - m_allocator.m_usedMemory;
+    m_numAllocations--;
+}
+
+std::string TrackingAllocator::GetLeakReport() const
+{
+    std::string report;
+
+    #if FARLOR_TRACK_ALLOCATIONS
+    struct LeakGroup
+    {
+        const AllocationRecord* pExample;
+        size_t numAllocations;
+        size_t numBytes;
+    };
+
+    // Grouped by site and stack, since allocations without a site tag only have the stack
+    std::map<std::tuple<const char*, uint32_t, uint32_t>, LeakGroup> groups;
+    size_t numLeaks = 0;
+    size_t numLeakedBytes = 0;
+    for (const AllocationRecord* pRecord = m_pLiveRecords; pRecord != nullptr;
+        pRecord = pRecord->pNext)
+    {
+        LeakGroup& group = groups[std::make_tuple(pRecord->pFile, pRecord->line,
+            pRecord->stackHash)];
+        if (group.pExample == nullptr)
+            group.pExample = pRecord;
+        group.numAllocations++;
+        group.numBytes += pRecord->size;
+        numLeaks++;
+        numLeakedBytes += pRecord->size;
+    }
+    if (numLeaks == 0)
+        return report;
+
+    std::vector<LeakGroup> sortedGroups;
+    for (const auto& group : groups)
+        sortedGroups.push_back(group.second);
+    std::sort(sortedGroups.begin(), sortedGroups.end(), [](const LeakGroup& a, const LeakGroup& b) {
+        return a.numBytes > b.numBytes;
+    });
+
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer), "%s: %zu allocations leaked, %zu bytes\n",
+        m_name.c_str(), numLeaks, numLeakedBytes);
+    report += buffer;
+    for (const LeakGroup& group : sortedGroups)
+    {
+        const AllocationRecord* pExample = group.pExample;
+        std::string site = FormatSite(pExample->pFile, pExample->line, pExample->pFunction);
+        std::snprintf(buffer, sizeof(buffer),
+            "    %zu x, %zu bytes at %s, stack %08x, e.g. %zu bytes aligned to %u\n",
+            group.numAllocations, group.numBytes, site.c_str(), pExample->stackHash,
+            pExample->size, uint32_t(pExample->alignment));
+        report += buffer;
+    }
+    #endif
+
+    return report;
+}
+
+#if FARLOR_TRACK_ALLOCATIONS
+void TrackingAllocator::ReportError(const char* pError, const void* pMemory,
+    const AllocationRecord* pRecord)
+{
+    m_numErrors++;
+
+    if (pRecord != nullptr)
+    {
+        // The owner of a freed record may be gone already
+        const char* pOwnerName = (pRecord->magic == LiveMagic) ? pRecord->pOwner->m_name.c_str()
+            : m_name.c_str();
+        std::string site = FormatSite(pRecord->pFile, pRecord->line, pRecord->pFunction);
+        std::fprintf(stderr, "%s: %p %s, allocated by %s at %s, stack %08x\n", m_name.c_str(),
+            pMemory, pError, pOwnerName, site.c_str(), pRecord->stackHash);
+    }
+    else
+    {
+        std::fprintf(stderr, "%s: %p %s\n", m_name.c_str(), pMemory, pError);
+    }
+
+    assert(false && "Invalid free, see the report above");
+}
+#endif
+
+}
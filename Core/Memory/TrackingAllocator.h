@@ -0,0 +1,76 @@
+#pragma once
+
+#include "BaseAllocator.h"
+
+#include <cstdint>
+#include <string>
+
+// Allocation tracking is compiled into debug builds. Define FARLOR_TRACK_ALLOCATIONS to 1 to keep
+// it in a release build for soak tests, or to 0 to leave it out of a debug build.
+#ifndef FARLOR_TRACK_ALLOCATIONS
+#if _DEBUG
+#define FARLOR_TRACK_ALLOCATIONS 1
+#else
+#define FARLOR_TRACK_ALLOCATIONS 0
+#endif
+#endif
+
+namespace Farlor {
+
+#if FARLOR_TRACK_ALLOCATIONS
+// Tags the next allocation the calling thread makes through a TrackingAllocator
+void SetNextAllocationSite(const char* pFile, uint32_t line, const char* pFunction);
+#define FARLOR_ALLOCATION_SITE() Farlor::SetNextAllocationSite(__FILE__, __LINE__, __func__)
+#else
+#define FARLOR_ALLOCATION_SITE() ((void)0)
+#endif
+
+// Allocate with the call site recorded for leak reports
+#define FARLOR_ALLOCATE(allocator, size, alignment) \
+    (FARLOR_ALLOCATION_SITE(), (allocator).Allocate(size, alignment))
+#define FARLOR_NEW(allocator, T) (FARLOR_ALLOCATION_SITE(), Farlor::AllocateNew<T>(allocator))
+
+// Forwards to another allocator like ProxyAllocator, and with tracking compiled in keeps a
+// record of every live allocation: size, alignment, call site and a hash of the stack. The
+// record lives in a header in front of the allocation, so tracking costs the header and a few
+// pointer writes per call rather than a lookup. Frees are checked against the header, and
+// freeing twice or through the wrong allocator is reported with where the memory came from.
+// Allocations still live when the allocator is destroyed are reported grouped by call site.
+class TrackingAllocator : public Allocator
+{
+public:
+    // stackDepth frames above the caller are hashed into each record. 0 only hashes the
+    // caller's return address, which is close to free; deeper hashes tell apart allocations
+    // made through a shared helper, but unwind the stack on every allocation.
+    TrackingAllocator(const std::string& name, Allocator& allocator, uint32_t stackDepth = 0);
+    ~TrackingAllocator();
+
+    virtual void* Allocate(size_t size, uint8_t alignment = 4) override;
+    virtual void Deallocate(void* pMemory) override;
+
+    // Live allocations grouped by call site, most bytes first. Empty when there are none or
+    // tracking is compiled out.
+    std::string GetLeakReport() const;
+
+    // Double frees and frees of memory this allocator did not hand out
+    size_t GetNumErrors() const { return m_numErrors; }
+
+private:
+    TrackingAllocator(const TrackingAllocator&); // Prevent copies
+    TrackingAllocator& operator=(const TrackingAllocator&);
+
+    std::string m_name;
+    Allocator& m_allocator;
+    size_t m_numErrors;
+
+    #if FARLOR_TRACK_ALLOCATIONS
+    struct AllocationRecord;
+
+    void ReportError(const char* pError, const void* pMemory, const AllocationRecord* pRecord);
+
+    uint32_t m_stackDepth;
+    AllocationRecord* m_pLiveRecords;
+    #endif
+};
+
+}
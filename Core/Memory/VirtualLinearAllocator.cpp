@@ -0,0 +1,53 @@
+#include "VirtualLinearAllocator.h"
+
+#include <cassert>
+
+namespace Farlor {
+
+VirtualLinearAllocator::VirtualLinearAllocator(size_t capacity, size_t retainSize,
+    size_t commitGranularity, bool guardPages)
+    : Allocator(0, nullptr)
+    , m_range(capacity, commitGranularity, guardPages)
+    , m_retainSize(retainSize)
+{
+    m_pStart = m_range.GetStart();
+    m_size = m_range.GetCapacity();
+    m_pCurrentPosition = m_pStart;
+}
+
+VirtualLinearAllocator::~VirtualLinearAllocator()
+{
+    Clear();
+    m_pCurrentPosition = nullptr;
+}
+
+void* VirtualLinearAllocator::Allocate(size_t size, uint8_t alignment)
+{
+    assert(size != 0);
+    uint8_t adjustment = AlignForwardAdjustment(m_pCurrentPosition, alignment);
+    size_t newUsedMemory = m_usedMemory + adjustment + size;
+    if (newUsedMemory > m_size || !m_range.EnsureCommitted(newUsedMemory))
+        return nullptr;
+
+    uintptr_t pAlignedAddress = (uintptr_t)m_pCurrentPosition + adjustment;
+    m_pCurrentPosition = (void*)(pAlignedAddress + size);
+    m_usedMemory = newUsedMemory;
+    m_numAllocations++;
+    m_totalAllocations++;
+    return (void*)pAlignedAddress;
+}
+
+void VirtualLinearAllocator::Deallocate(void*)
+{
+    assert(false && "Use Clear() instead");
+}
+
+void VirtualLinearAllocator::Clear()
+{
+    m_numAllocations = 0;
+    m_usedMemory = 0;
+    m_pCurrentPosition = m_pStart;
+    m_range.Trim(m_retainSize);
+}
+
+}
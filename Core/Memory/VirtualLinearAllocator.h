@@ -0,0 +1,39 @@
+#pragma once
+
+#include "BaseAllocator.h"
+#include "VirtualMemory.h"
+
+#include <cstdint>
+
+namespace Farlor {
+
+// LinearAllocator over its own reserved address range instead of a caller provided block.
+// The capacity can be made generous since pages are only committed as the allocator reaches
+// them; Clear gives back whatever was committed past retainSize.
+class VirtualLinearAllocator : public Allocator
+{
+public:
+    static constexpr size_t DefaultCommitGranularity = 64 * 1024;
+
+public:
+    VirtualLinearAllocator(size_t capacity, size_t retainSize = 0,
+        size_t commitGranularity = DefaultCommitGranularity,
+        bool guardPages = VirtualMemoryRange::DefaultGuardPages);
+    ~VirtualLinearAllocator();
+
+    virtual void* Allocate(size_t size, uint8_t alignment = 4) override;
+    virtual void Deallocate(void* pMemory) override;
+    void Clear();
+
+    size_t GetCommittedSize() const { return m_range.GetCommittedSize(); }
+
+private:
+    VirtualLinearAllocator(const VirtualLinearAllocator&); // Prevent copies
+    VirtualLinearAllocator& operator=(const VirtualLinearAllocator&);
+
+    VirtualMemoryRange m_range;
+    size_t m_retainSize;
+    void* m_pCurrentPosition;
+};
+
+}
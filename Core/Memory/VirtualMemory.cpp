@@ -0,0 +1,137 @@
+#include "VirtualMemory.h"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Farlor {
+
+namespace {
+
+size_t RoundUp(size_t size, size_t granularity)
+{
+    return (size + granularity - 1) / granularity * granularity;
+}
+
+}
+
+size_t GetVirtualPageSize()
+{
+#if defined(_WIN32)
+    static const size_t pageSize = []() {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        return size_t(systemInfo.dwPageSize);
+    }();
+#else
+    static const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+#endif
+    return pageSize;
+}
+
+void* ReserveVirtualMemory(size_t size)
+{
+#if defined(_WIN32)
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void* pAddress = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1, 0);
+    return (pAddress == MAP_FAILED) ? nullptr : pAddress;
+#endif
+}
+
+void ReleaseVirtualMemory(void* pAddress, size_t size)
+{
+#if defined(_WIN32)
+    VirtualFree(pAddress, 0, MEM_RELEASE);
+#else
+    munmap(pAddress, size);
+#endif
+}
+
+bool CommitVirtualMemory(void* pAddress, size_t size)
+{
+    assert((uintptr_t)pAddress % GetVirtualPageSize() == 0 && size % GetVirtualPageSize() == 0);
+#if defined(_WIN32)
+    return VirtualAlloc(pAddress, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    return mprotect(pAddress, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void DecommitVirtualMemory(void* pAddress, size_t size)
+{
+    assert((uintptr_t)pAddress % GetVirtualPageSize() == 0 && size % GetVirtualPageSize() == 0);
+#if defined(_WIN32)
+    VirtualFree(pAddress, size, MEM_DECOMMIT);
+#else
+    madvise(pAddress, size, MADV_DONTNEED);
+    mprotect(pAddress, size, PROT_NONE);
+#endif
+}
+
+VirtualMemoryRange::VirtualMemoryRange(size_t capacity, size_t commitGranularity,
+    bool guardPages)
+    : m_pReservation(nullptr)
+    , m_reservationSize(0)
+    , m_pStart(nullptr)
+    , m_capacity(0)
+    , m_committedSize(0)
+    , m_commitGranularity(0)
+{
+    assert(capacity > 0);
+
+    size_t pageSize = GetVirtualPageSize();
+    size_t guardSize = guardPages ? pageSize : 0;
+    m_capacity = RoundUp(capacity, pageSize);
+    m_commitGranularity = RoundUp(std::max<size_t>(commitGranularity, 1), pageSize);
+    m_reservationSize = m_capacity + 2 * guardSize;
+
+    m_pReservation = (uint8_t*)ReserveVirtualMemory(m_reservationSize);
+    assert(m_pReservation != nullptr && "Could not reserve address space");
+    if (m_pReservation == nullptr)
+    {
+        m_capacity = 0;
+        return;
+    }
+    m_pStart = m_pReservation + guardSize;
+}
+
+VirtualMemoryRange::~VirtualMemoryRange()
+{
+    if (m_pReservation != nullptr)
+        ReleaseVirtualMemory(m_pReservation, m_reservationSize);
+}
+
+void VirtualMemoryRange::Trim(size_t keepSize)
+{
+    size_t keepCommitted = std::min(RoundUp(keepSize, m_commitGranularity), m_capacity);
+    if (keepCommitted >= m_committedSize)
+        return;
+
+    DecommitVirtualMemory(m_pStart + keepCommitted, m_committedSize - keepCommitted);
+    m_committedSize = keepCommitted;
+}
+
+bool VirtualMemoryRange::Grow(size_t size)
+{
+    if (size > m_capacity)
+        return false;
+
+    size_t newCommitted = std::min(RoundUp(size, m_commitGranularity), m_capacity);
+    if (!CommitVirtualMemory(m_pStart + m_committedSize, newCommitted - m_committedSize))
+        return false;
+
+    m_committedSize = newCommitted;
+    return true;
+}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Farlor {
+
+// Thin layer over the OS virtual memory calls (VirtualAlloc on Windows, mmap elsewhere).
+// Reserved address space costs no memory until it is committed, and only the pages actually
+// touched after that are backed by physical memory.
+
+size_t GetVirtualPageSize();
+
+// Reserves size bytes of address space with no access. Returns nullptr on failure.
+void* ReserveVirtualMemory(size_t size);
+void ReleaseVirtualMemory(void* pAddress, size_t size);
+
+// pAddress and size must be page aligned and inside a reservation
+bool CommitVirtualMemory(void* pAddress, size_t size);
+// Gives the physical pages back; the range stays reserved and faults if it is touched
+void DecommitVirtualMemory(void* pAddress, size_t size);
+
+// A reserved range that is committed from the front as it is used. With guard pages an
+// uncommitted page is kept on either side of it, so running off either end faults
+// instead of silently corrupting the neighbouring memory.
+class VirtualMemoryRange
+{
+public:
+#if _DEBUG
+    static constexpr bool DefaultGuardPages = true;
+#else
+    static constexpr bool DefaultGuardPages = false;
+#endif
+
+    // Commits in multiples of commitGranularity, rounded up to whole pages
+    VirtualMemoryRange(size_t capacity, size_t commitGranularity, bool guardPages);
+    ~VirtualMemoryRange();
+
+    void* GetStart() const { return m_pStart; }
+    size_t GetCapacity() const { return m_capacity; }
+    size_t GetCommittedSize() const { return m_committedSize; }
+
+    // Makes sure the first size bytes are committed. Returns false if that is more than the
+    // capacity or the OS refuses.
+    bool EnsureCommitted(size_t size)
+    {
+        if (size <= m_committedSize)
+            return true;
+        return Grow(size);
+    }
+
+    // Decommits everything past the first keepSize bytes
+    void Trim(size_t keepSize);
+
+private:
+    VirtualMemoryRange(const VirtualMemoryRange&); // Prevent copies
+    VirtualMemoryRange& operator=(const VirtualMemoryRange&);
+
+    bool Grow(size_t size);
+
+    uint8_t* m_pReservation;
+    size_t m_reservationSize;
+    uint8_t* m_pStart;
+    size_t m_capacity;
+    size_t m_committedSize;
+    size_t m_commitGranularity;
+};
+
+}
@@ -0,0 +1,81 @@
+#include "VirtualStackAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Farlor {
+
+VirtualStackAllocator::VirtualStackAllocator(size_t capacity, size_t retainSize,
+    size_t commitGranularity, bool guardPages)
+    : Allocator(0, nullptr)
+    , m_range(capacity, commitGranularity, guardPages)
+    , m_retainSize(retainSize)
+{
+    m_pStart = m_range.GetStart();
+    m_size = m_range.GetCapacity();
+    m_pCurrentPosition = m_pStart;
+    #if _DEBUG
+    m_pPrevPosition = nullptr;
+    #endif
+}
+
+VirtualStackAllocator::~VirtualStackAllocator()
+{
+    #if _DEBUG
+    m_pPrevPosition = nullptr;
+    #endif
+
+    m_pCurrentPosition = nullptr;
+}
+
+void* VirtualStackAllocator::Allocate(size_t size, uint8_t alignment)
+{
+    assert(size != 0);
+
+    uint8_t adjustment = AlignForwardAdjustmentWithHeader(m_pCurrentPosition, alignment,
+        sizeof(StackAllocationHeader));
+    size_t newUsedMemory = m_usedMemory + adjustment + size;
+    if (newUsedMemory > m_size || !m_range.EnsureCommitted(newUsedMemory))
+        return nullptr;
+
+    void* pAlignedAddress = (void*)((uintptr_t)m_pCurrentPosition + adjustment);
+
+    StackAllocationHeader* header = (StackAllocationHeader*)((uintptr_t)pAlignedAddress
+        - sizeof(StackAllocationHeader));
+    header->adjustment = adjustment;
+    #if _DEBUG
+    header->pPrevAddress = m_pPrevPosition;
+    m_pPrevPosition = pAlignedAddress;
+    #endif
+
+    m_pCurrentPosition = (void*)((uintptr_t)pAlignedAddress + size);
+    m_usedMemory = newUsedMemory;
+    m_numAllocations++;
+    m_totalAllocations++;
+    return pAlignedAddress;
+}
+
+void VirtualStackAllocator::Deallocate(void* pMemory)
+{
+    #if _DEBUG
+    assert(pMemory == m_pPrevPosition && "Stack allocations must be freed in reverse order");
+    #endif
+
+    StackAllocationHeader* header = (StackAllocationHeader*)((uintptr_t)pMemory
+        - sizeof(StackAllocationHeader));
+    m_usedMemory -= (uintptr_t)m_pCurrentPosition - (uintptr_t)pMemory + header->adjustment;
+    m_pCurrentPosition = (void*)((uintptr_t)pMemory - header->adjustment);
+
+    #if _DEBUG
+    m_pPrevPosition = header->pPrevAddress;
+    #endif
+
+    m_numAllocations--;
+}
+
+void VirtualStackAllocator::Trim()
+{
+    m_range.Trim(std::max(m_usedMemory, m_retainSize));
+}
+
+}
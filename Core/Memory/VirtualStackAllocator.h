@@ -0,0 +1,54 @@
+#pragma once
+
+#include "BaseAllocator.h"
+#include "VirtualMemory.h"
+
+#include <cstdint>
+
+namespace Farlor {
+
+// StackAllocator over its own reserved address range, committing pages as the stack grows.
+// Popping does not decommit, so a stack that goes up and down every frame does not keep
+// calling into the OS; Trim gives back what is committed past the current top, keeping at
+// least retainSize.
+class VirtualStackAllocator : public Allocator
+{
+public:
+    static constexpr size_t DefaultCommitGranularity = 64 * 1024;
+
+public:
+    VirtualStackAllocator(size_t capacity, size_t retainSize = 0,
+        size_t commitGranularity = DefaultCommitGranularity,
+        bool guardPages = VirtualMemoryRange::DefaultGuardPages);
+    ~VirtualStackAllocator();
+
+    virtual void* Allocate(size_t size, uint8_t alignment = 4) override;
+    virtual void Deallocate(void* pMemory) override;
+
+    void Trim();
+
+    size_t GetCommittedSize() const { return m_range.GetCommittedSize(); }
+
+private:
+    VirtualStackAllocator(const VirtualStackAllocator&); // Prevent copies
+    VirtualStackAllocator& operator=(const VirtualStackAllocator&);
+
+    struct StackAllocationHeader
+    {
+        #if _DEBUG
+        void* pPrevAddress;
+        #endif
+        uint8_t adjustment;
+    };
+
+    VirtualMemoryRange m_range;
+    size_t m_retainSize;
+
+    #if _DEBUG
+    void* m_pPrevPosition;
+    #endif
+
+    void* m_pCurrentPosition;
+};
+
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <emmintrin.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Farlor {
+
+// Square grid of booleans packed 64 cells per word, one row after another. Bits past the end of
+// a row are always clear, so whole words can be tested and counted without masking the tail.
+// Used for per cell flags such as obstacles, where a uint32_t per cell wastes 31 bits.
+class BitGrid {
+   public:
+    static constexpr uint32_t CellsPerWord = 64;
+
+   public:
+    explicit BitGrid(const uint32_t resolution = 0)
+        : m_resolution(resolution)
+        , m_wordsPerRow((resolution + CellsPerWord - 1) / CellsPerWord)
+        , m_words(size_t(m_wordsPerRow) * resolution, 0)
+    {
+    }
+
+    // Any non zero cell is set
+    BitGrid(const uint32_t resolution, const std::vector<uint32_t> &cellMask)
+        : BitGrid(resolution)
+    {
+        assert(cellMask.size() == size_t(resolution) * resolution);
+        for (uint32_t y = 0; y < m_resolution; y++) {
+            const uint32_t *pCells = cellMask.data() + size_t(y) * m_resolution;
+            uint64_t *pRow = AccessRow(y);
+            for (uint32_t x = 0; x < m_resolution; x++) {
+                pRow[x / CellsPerWord] |= uint64_t(pCells[x] != 0) << (x % CellsPerWord);
+            }
+        }
+    }
+
+    uint32_t GetResolution() const { return m_resolution; }
+    uint32_t GetWordsPerRow() const { return m_wordsPerRow; }
+    size_t GetSizeBytes() const { return m_words.size() * sizeof(uint64_t); }
+
+    const uint64_t *GetRow(const uint32_t y) const { return &m_words[size_t(y) * m_wordsPerRow]; }
+    uint64_t *AccessRow(const uint32_t y) { return &m_words[size_t(y) * m_wordsPerRow]; }
+
+    bool Get(const uint32_t x, const uint32_t y) const
+    {
+        return (GetRow(y)[x / CellsPerWord] >> (x % CellsPerWord)) & 1;
+    }
+
+    void Set(const uint32_t x, const uint32_t y, const bool value)
+    {
+        uint64_t &word = AccessRow(y)[x / CellsPerWord];
+        const uint64_t bit = uint64_t(1) << (x % CellsPerWord);
+        word = value ? (word | bit) : (word & ~bit);
+    }
+
+    // Sets or clears count cells of row y starting at x0, a word at a time
+    void SetRange(const uint32_t y, const uint32_t x0, const uint32_t count, const bool value)
+    {
+        assert(x0 + count <= m_resolution);
+        uint64_t *pRow = AccessRow(y);
+        for (uint32_t x = x0; x < x0 + count;) {
+            const uint32_t bitIdx = x % CellsPerWord;
+            const uint32_t numBits = std::min(CellsPerWord - bitIdx, x0 + count - x);
+            const uint64_t bits = LowBits(numBits) << bitIdx;
+            uint64_t &word = pRow[x / CellsPerWord];
+            word = value ? (word | bits) : (word & ~bits);
+            x += numBits;
+        }
+    }
+
+    void Clear() { std::fill(m_words.begin(), m_words.end(), 0); }
+
+    // Up to 64 cells of row y starting at x, cell x in bit 0. Cells past the row end read as clear.
+    uint64_t GetLanes(const uint32_t x, const uint32_t y) const
+    {
+        if (x >= m_resolution) {
+            return 0;
+        }
+
+        const uint64_t *pRow = GetRow(y);
+        const uint32_t wordIdx = x / CellsPerWord;
+        const uint32_t bitIdx = x % CellsPerWord;
+        uint64_t lanes = pRow[wordIdx] >> bitIdx;
+        if ((bitIdx != 0) && (wordIdx + 1 < m_wordsPerRow)) {
+            lanes |= pRow[wordIdx + 1] << (CellsPerWord - bitIdx);
+        }
+        return lanes;
+    }
+
+    // True if no cell of row y in [x0, x0 + count) is set; a single compare per 64 cells
+    bool IsRangeClear(const uint32_t y, const uint32_t x0, const uint32_t count) const
+    {
+        assert(x0 + count <= m_resolution);
+        for (uint32_t x = x0; x < x0 + count; x += CellsPerWord) {
+            const uint32_t numBits = std::min(CellsPerWord, x0 + count - x);
+            if ((GetLanes(x, y) & LowBits(numBits)) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsRowClear(const uint32_t y) const
+    {
+        const uint64_t *pRow = GetRow(y);
+        return std::all_of(pRow, pRow + m_wordsPerRow, [](uint64_t word) { return word == 0; });
+    }
+
+    bool IsEmpty() const
+    {
+        return std::all_of(m_words.begin(), m_words.end(), [](uint64_t word) { return word == 0; });
+    }
+
+    size_t CountSet() const
+    {
+        size_t count = 0;
+        for (uint64_t word : m_words) {
+            count += std::popcount(word);
+        }
+        return count;
+    }
+
+    // First set / clear cell in row y at or after x, or the resolution if there is none. Lets
+    // kernels jump over whole runs of blocked or free cells instead of testing each one.
+    uint32_t FindNextSet(const uint32_t x, const uint32_t y) const
+    {
+        return FindNext(x, y, 0);
+    }
+
+    uint32_t FindNextClear(const uint32_t x, const uint32_t y) const
+    {
+        return FindNext(x, y, ~uint64_t(0));
+    }
+
+    // Calls func(x) for every clear cell of row y in [x0, x0 + count)
+    template<typename Func>
+    void ForEachClear(
+          const uint32_t y, const uint32_t x0, const uint32_t count, const Func &func) const
+    {
+        assert(x0 + count <= m_resolution);
+        for (uint32_t x = x0; x < x0 + count; x += CellsPerWord) {
+            const uint32_t numBits = std::min(CellsPerWord, x0 + count - x);
+            uint64_t clearLanes = ~GetLanes(x, y) & LowBits(numBits);
+            while (clearLanes != 0) {
+                func(x + std::countr_zero(clearLanes));
+                clearLanes &= clearLanes - 1;
+            }
+        }
+    }
+
+    // Writes value into every set cell of a row of count values starting at x0, leaving the
+    // others alone. Processes four cells per iteration with SSE2 masks (eight with AVX2).
+    void ApplyToSetCells(const uint32_t y, const uint32_t x0, const uint32_t count,
+          int32_t *pValues, const int32_t value) const
+    {
+        assert(x0 + count <= m_resolution);
+        uint32_t idx = 0;
+#if defined(__AVX2__)
+        const __m256i value8 = _mm256_set1_epi32(value);
+        for (; idx + 8 <= count; idx += 8) {
+            const __m256i mask = LaneMask8(static_cast<uint32_t>(GetLanes(x0 + idx, y)));
+            __m256i *pDest = reinterpret_cast<__m256i *>(pValues + idx);
+            _mm256_storeu_si256(
+                  pDest, _mm256_blendv_epi8(_mm256_loadu_si256(pDest), value8, mask));
+        }
+#endif
+        const __m128i value4 = _mm_set1_epi32(value);
+        for (; idx + 4 <= count; idx += 4) {
+            const __m128i mask = LaneMask4(static_cast<uint32_t>(GetLanes(x0 + idx, y)));
+            __m128i *pDest = reinterpret_cast<__m128i *>(pValues + idx);
+            const __m128i kept = _mm_andnot_si128(mask, _mm_loadu_si128(pDest));
+            _mm_storeu_si128(pDest, _mm_or_si128(kept, _mm_and_si128(mask, value4)));
+        }
+        for (; idx < count; idx++) {
+            pValues[idx] = Get(x0 + idx, y) ? value : pValues[idx];
+        }
+    }
+
+    // Expands the low 4 bits of lanes to 32 bit lane masks, all ones where the bit is set
+    static __m128i LaneMask4(const uint32_t lanes)
+    {
+        const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+        const __m128i bits = _mm_and_si128(_mm_set1_epi32(static_cast<int32_t>(lanes)), laneBits);
+        return _mm_cmpeq_epi32(bits, laneBits);
+    }
+
+#if defined(__AVX2__)
+    static __m256i LaneMask8(const uint32_t lanes)
+    {
+        const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256i bits
+              = _mm256_and_si256(_mm256_set1_epi32(static_cast<int32_t>(lanes)), laneBits);
+        return _mm256_cmpeq_epi32(bits, laneBits);
+    }
+#endif
+
+    // Unpacks to one uint32_t per cell, 1 for set cells, as the simulation textures expect
+    void CopyTo(std::vector<uint32_t> &cellMask) const
+    {
+        cellMask.resize(size_t(m_resolution) * m_resolution);
+        for (uint32_t y = 0; y < m_resolution; y++) {
+            uint32_t *pCells = cellMask.data() + size_t(y) * m_resolution;
+            for (uint32_t x = 0; x < m_resolution; x++) {
+                pCells[x] = Get(x, y) ? 1 : 0;
+            }
+        }
+    }
+
+   private:
+    static uint64_t LowBits(const uint32_t numBits)
+    {
+        return (numBits >= CellsPerWord) ? ~uint64_t(0) : ((uint64_t(1) << numBits) - 1);
+    }
+
+    // Scans for the first bit differing from invert; invert is 0 to find set bits, ~0 for clear
+    uint32_t FindNext(const uint32_t x, const uint32_t y, const uint64_t invert) const
+    {
+        if (x >= m_resolution) {
+            return m_resolution;
+        }
+
+        const uint64_t *pRow = GetRow(y);
+        uint32_t wordIdx = x / CellsPerWord;
+        uint64_t word = (pRow[wordIdx] ^ invert) & ~LowBits(x % CellsPerWord);
+        while (true) {
+            if (word != 0) {
+                return std::min(
+                      m_resolution, wordIdx * CellsPerWord + uint32_t(std::countr_zero(word)));
+            }
+            if (++wordIdx >= m_wordsPerRow) {
+                return m_resolution;
+            }
+            word = pRow[wordIdx] ^ invert;
+        }
+    }
+
+   private:
+    uint32_t m_resolution = 0;
+    uint32_t m_wordsPerRow = 0;
+    std::vector<uint64_t> m_words;
+};
+
+}
@@ -0,0 +1,370 @@
+#include "DesertHistory.h"
+
+#include "GridCodec.h"
+#include "VarintCoding.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace Farlor {
+
+DesertHistory::DesertHistory(uint32_t keyframeInterval, size_t memoryBudgetBytes)
+    : m_keyframeInterval(keyframeInterval)
+    , m_memoryBudgetBytes(memoryBudgetBytes)
+{
+    assert(keyframeInterval > 0);
+    m_recorderThread = std::thread(&DesertHistory::RecorderLoop, this);
+}
+
+DesertHistory::~DesertHistory()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_recordAvailable.notify_one();
+    m_recorderThread.join();
+}
+
+void DesertHistory::Record(const DesertState &state)
+{
+    Record(state, std::vector<int32_t>(), std::vector<int32_t>());
+}
+
+void DesertHistory::Record(const DesertState &state, std::vector<int32_t> sandBlocks,
+      std::vector<int32_t> bedrockBlocks)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Never hold up the simulation, skip the record if the recorder has fallen behind
+        if (m_pendingRecords.size() >= MaxPendingRecords) {
+            m_droppedRecords++;
+            return;
+        }
+        m_pendingRecords.push_back(
+              PendingRecord{state, std::move(sandBlocks), std::move(bedrockBlocks)});
+    }
+    m_recordAvailable.notify_one();
+}
+
+void DesertHistory::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queueDrained.wait(lock, [this]() { return m_pendingRecords.empty() && !m_encoding; });
+}
+
+bool DesertHistory::Seek(uint64_t stepIdx, DesertState &state) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Find the last keyframe at or before the requested step
+    const Segment *pSegment = nullptr;
+    for (const Segment &segment : m_segments) {
+        if (segment.m_upKeyframe->GetStepIdx() > stepIdx) {
+            break;
+        }
+        pSegment = &segment;
+    }
+
+    if (pSegment == nullptr) {
+        return false;
+    }
+
+    if (!DecodeKeyframe(*pSegment, state)) {
+        return false;
+    }
+    for (const DeltaFrame &frame : pSegment->m_deltas) {
+        if (frame.m_stepIdx > stepIdx) {
+            break;
+        }
+        if (!ApplyFrame(frame, state)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DesertHistory::IsEmpty() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_segments.empty();
+}
+
+uint64_t DesertHistory::GetFirstStep() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_segments.empty() ? 0 : m_segments.front().m_upKeyframe->GetStepIdx();
+}
+
+uint64_t DesertHistory::GetLastStep() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_segments.empty()) {
+        return 0;
+    }
+
+    const Segment &segment = m_segments.back();
+    return segment.m_deltas.empty() ? segment.m_upKeyframe->GetStepIdx()
+                                    : segment.m_deltas.back().m_stepIdx;
+}
+
+size_t DesertHistory::GetUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_usedBytes;
+}
+
+uint64_t DesertHistory::GetDroppedRecordCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_droppedRecords;
+}
+
+void DesertHistory::RecorderLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_recordAvailable.wait(lock, [this]() { return m_shutdown || !m_pendingRecords.empty(); });
+        if (m_shutdown) {
+            return;
+        }
+
+        PendingRecord record = std::move(m_pendingRecords.front());
+        m_pendingRecords.pop_front();
+        m_encoding = true;
+
+        lock.unlock();
+        if (!record.m_sandBlocks.empty()) {
+            const uint32_t resolution = record.m_state.GetGridResolution();
+            const uint32_t tileSize = record.m_state.GetSandBlocks().GetTileSize();
+            record.m_state.AccessSandBlocks()
+                  = TiledGrid<int32_t>(resolution, tileSize, record.m_sandBlocks);
+            record.m_state.AccessBedrockBlocks()
+                  = TiledGrid<int32_t>(resolution, tileSize, record.m_bedrockBlocks);
+        }
+        Encode(record.m_state);
+        lock.lock();
+
+        m_encoding = false;
+        if (m_pendingRecords.empty()) {
+            m_queueDrained.notify_all();
+        }
+    }
+}
+
+void DesertHistory::Encode(const DesertState &state)
+{
+    // A step at or before the last record means the simulation was rewound, so the records after
+    // it belong to the abandoned timeline
+    if ((m_upPrevious != nullptr) && (m_upPrevious->GetStepIdx() >= state.GetStepIdx())) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        TruncateFrom(state.GetStepIdx());
+    }
+
+    bool needsKeyframe = (m_upPrevious == nullptr)
+          || (m_upPrevious->GetGridResolution() != state.GetGridResolution())
+          || (m_upPrevious->GetStepIdx() >= state.GetStepIdx());
+    if (!needsKeyframe) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        needsKeyframe = m_segments.empty()
+              || ((m_segments.back().m_deltas.size() + 1) >= m_keyframeInterval);
+    }
+
+    if (needsKeyframe) {
+        const uint32_t resolution = state.GetGridResolution();
+        std::vector<int32_t> values;
+
+        Segment segment;
+        state.GetSandBlocks().CopyTo(values);
+        segment.m_sandKeyframe = GridCodec::Encode(values.data(), resolution, resolution);
+        state.GetBedrockBlocks().CopyTo(values);
+        segment.m_bedrockKeyframe = GridCodec::Encode(values.data(), resolution, resolution);
+
+        segment.m_upKeyframe = std::make_unique<DesertState>(resolution, state.GetCellSizeMeters(),
+              state.GetBlockHeightMeters(), state.GetSandBlocks().GetTileSize());
+        segment.m_upKeyframe->SetBranchName(state.GetBranchName());
+        segment.m_upKeyframe->SetStepIdx(state.GetStepIdx());
+        segment.m_upKeyframe->AccessParameters() = state.GetParameters();
+        segment.m_upKeyframe->SetObstacles(state.GetSharedObstacles());
+
+        segment.m_bytes = segment.m_sandKeyframe.size() + segment.m_bedrockKeyframe.size();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_usedBytes += segment.m_bytes;
+        m_segments.push_back(std::move(segment));
+    } else {
+        DeltaFrame frame;
+        frame.m_stepIdx = state.GetStepIdx();
+        frame.m_parameters = state.GetParameters();
+
+        const TiledGrid<int32_t> &previousSand = m_upPrevious->GetSandBlocks();
+        const TiledGrid<int32_t> &previousBedrock = m_upPrevious->GetBedrockBlocks();
+        const TiledGrid<int32_t> &sand = state.GetSandBlocks();
+        const TiledGrid<int32_t> &bedrock = state.GetBedrockBlocks();
+
+        const uint32_t cellsPerTile = sand.GetTileSize() * sand.GetTileSize();
+        const size_t tileBytes = cellsPerTile * sizeof(int32_t);
+        for (uint32_t tileIdx = 0; tileIdx < sand.GetTileCount(); tileIdx++) {
+            // Shared tiles are unchanged by construction, otherwise compare contents
+            const bool sandChanged = !sand.SharesTile(previousSand, tileIdx)
+                  && std::memcmp(sand.GetTileData(tileIdx), previousSand.GetTileData(tileIdx),
+                           tileBytes) != 0;
+            const bool bedrockChanged = !bedrock.SharesTile(previousBedrock, tileIdx)
+                  && std::memcmp(bedrock.GetTileData(tileIdx),
+                           previousBedrock.GetTileData(tileIdx), tileBytes) != 0;
+            if (!sandChanged && !bedrockChanged) {
+                continue;
+            }
+
+            TileDelta tileDelta;
+            tileDelta.m_tileIdx = tileIdx;
+            if (sandChanged) {
+                EncodeTileDelta(previousSand.GetTileData(tileIdx), sand.GetTileData(tileIdx),
+                      cellsPerTile, tileDelta.m_sandDelta);
+            }
+            if (bedrockChanged) {
+                EncodeTileDelta(previousBedrock.GetTileData(tileIdx),
+                      bedrock.GetTileData(tileIdx), cellsPerTile, tileDelta.m_bedrockDelta);
+            }
+
+            frame.m_bytes += sizeof(TileDelta) + tileDelta.m_sandDelta.size()
+                  + tileDelta.m_bedrockDelta.size();
+            frame.m_tiles.push_back(std::move(tileDelta));
+        }
+        frame.m_bytes += sizeof(DeltaFrame);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_segments.back().m_bytes += frame.m_bytes;
+        m_usedBytes += frame.m_bytes;
+        m_segments.back().m_deltas.push_back(std::move(frame));
+    }
+
+    m_upPrevious = std::make_unique<DesertState>(state);
+
+    // Drop the oldest keyframe and its deltas until the history fits, always keeping the newest
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while ((m_usedBytes > m_memoryBudgetBytes) && (m_segments.size() > 1)) {
+        m_usedBytes -= m_segments.front().m_bytes;
+        m_segments.pop_front();
+    }
+}
+
+void DesertHistory::TruncateFrom(uint64_t stepIdx)
+{
+    while (!m_segments.empty() && (m_segments.back().m_upKeyframe->GetStepIdx() >= stepIdx)) {
+        m_usedBytes -= m_segments.back().m_bytes;
+        m_segments.pop_back();
+    }
+    if (m_segments.empty()) {
+        return;
+    }
+
+    Segment &segment = m_segments.back();
+    while (!segment.m_deltas.empty() && (segment.m_deltas.back().m_stepIdx >= stepIdx)) {
+        segment.m_bytes -= segment.m_deltas.back().m_bytes;
+        m_usedBytes -= segment.m_deltas.back().m_bytes;
+        segment.m_deltas.pop_back();
+    }
+}
+
+// Deltas are zigzag varints of the per cell change, with runs of unchanged cells written as a
+// zero followed by the run length
+void DesertHistory::EncodeTileDelta(const int32_t *pPrevious, const int32_t *pCurrent,
+      uint32_t numCells, std::vector<uint8_t> &encoded)
+{
+    uint32_t cellIdx = 0;
+    while (cellIdx < numCells) {
+        const int32_t delta = static_cast<int32_t>(
+              static_cast<uint32_t>(pCurrent[cellIdx]) - static_cast<uint32_t>(pPrevious[cellIdx]));
+        if (delta != 0) {
+            WriteVarint(ZigZagEncode(delta), encoded);
+            cellIdx++;
+            continue;
+        }
+
+        uint32_t runLength = 0;
+        while ((cellIdx < numCells) && (pCurrent[cellIdx] == pPrevious[cellIdx])) {
+            runLength++;
+            cellIdx++;
+        }
+        encoded.push_back(0);
+        WriteVarint(runLength, encoded);
+    }
+}
+
+bool DesertHistory::ApplyTileDelta(
+      const std::vector<uint8_t> &encoded, int32_t *pValues, uint32_t numCells)
+{
+    const uint8_t *pData = encoded.data();
+    const uint8_t *pDataEnd = encoded.data() + encoded.size();
+    uint32_t cellIdx = 0;
+    while (cellIdx < numCells) {
+        uint64_t code = 0;
+        if (!ReadVarint(pData, pDataEnd, code) || (code > UINT32_MAX)) {
+            return false;
+        }
+        if (code == 0) {
+            uint64_t runLength = 0;
+            if (!ReadVarint(pData, pDataEnd, runLength) || (runLength > numCells - cellIdx)) {
+                return false;
+            }
+            cellIdx += static_cast<uint32_t>(runLength);
+            continue;
+        }
+
+        pValues[cellIdx] = static_cast<int32_t>(
+              static_cast<uint32_t>(pValues[cellIdx])
+              + static_cast<uint32_t>(ZigZagDecode(static_cast<uint32_t>(code))));
+        cellIdx++;
+    }
+    return true;
+}
+
+bool DesertHistory::DecodeKeyframe(const Segment &segment, DesertState &state)
+{
+    std::vector<int32_t> sandBlocks;
+    std::vector<int32_t> bedrockBlocks;
+    if (!GridCodec::Decode(segment.m_sandKeyframe, sandBlocks)
+          || !GridCodec::Decode(segment.m_bedrockKeyframe, bedrockBlocks)) {
+        return false;
+    }
+
+    const DesertState &keyframe = *segment.m_upKeyframe;
+    DesertState decoded(keyframe.GetGridResolution(), keyframe.GetCellSizeMeters(),
+          keyframe.GetBlockHeightMeters(), sandBlocks, bedrockBlocks,
+          keyframe.GetSandBlocks().GetTileSize());
+    decoded.SetStepIdx(keyframe.GetStepIdx());
+    decoded.AccessParameters() = keyframe.GetParameters();
+    decoded.SetObstacles(keyframe.GetSharedObstacles());
+    decoded.SetBranchName(keyframe.GetBranchName());
+
+    state = std::move(decoded);
+    return true;
+}
+
+bool DesertHistory::ApplyFrame(const DeltaFrame &frame, DesertState &state)
+{
+    TiledGrid<int32_t> &sand = state.AccessSandBlocks();
+    TiledGrid<int32_t> &bedrock = state.AccessBedrockBlocks();
+    const uint32_t cellsPerTile = sand.GetTileSize() * sand.GetTileSize();
+
+    for (const TileDelta &tileDelta : frame.m_tiles) {
+        if (!tileDelta.m_sandDelta.empty()
+              && !ApplyTileDelta(tileDelta.m_sandDelta, sand.AccessTileData(tileDelta.m_tileIdx),
+                    cellsPerTile)) {
+            return false;
+        }
+        if (!tileDelta.m_bedrockDelta.empty()
+              && !ApplyTileDelta(tileDelta.m_bedrockDelta,
+                    bedrock.AccessTileData(tileDelta.m_tileIdx), cellsPerTile)) {
+            return false;
+        }
+    }
+
+    state.AccessParameters() = frame.m_parameters;
+    state.SetStepIdx(frame.m_stepIdx);
+    return true;
+}
+
+}
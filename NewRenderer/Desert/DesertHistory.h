@@ -0,0 +1,114 @@
+#pragma once
+
+#include "DesertState.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Farlor {
+
+// Records the history of a desert simulation for scrubbing and replay. Every keyframeInterval
+// records a full keyframe is kept, and the records in between only store the tiles that changed
+// as compact per cell block count deltas. Recording hands the state to a background thread, and
+// the oldest keyframes are dropped to stay inside the memory budget. Keyframes are stored
+// compressed with GridCodec.
+class DesertHistory {
+   public:
+    DesertHistory(uint32_t keyframeInterval, size_t memoryBudgetBytes);
+    ~DesertHistory();
+
+    // O(1) for the caller, the state is forked and encoded on the recorder thread. Recording a
+    // step at or before the last recorded one drops every record after it first, so recording
+    // after restoring an earlier step starts a new timeline from there.
+    void Record(const DesertState &state);
+    // Takes the block grids as row major arrays straight from a readback and tiles them on the
+    // recorder thread. Everything else is taken from state.
+    void Record(const DesertState &state, std::vector<int32_t> sandBlocks,
+          std::vector<int32_t> bedrockBlocks);
+
+    // Blocks until every queued record has been encoded
+    void Flush();
+
+    // Rebuilds the state recorded at or just before stepIdx, decoding at most
+    // keyframeInterval - 1 deltas. Returns false if that step is no longer in the history.
+    bool Seek(uint64_t stepIdx, DesertState &state) const;
+
+    bool IsEmpty() const;
+    uint64_t GetFirstStep() const;
+    uint64_t GetLastStep() const;
+    size_t GetUsedBytes() const;
+    uint64_t GetDroppedRecordCount() const;
+
+   private:
+    struct TileDelta {
+        uint32_t m_tileIdx = 0;
+        std::vector<uint8_t> m_sandDelta;
+        std::vector<uint8_t> m_bedrockDelta;
+    };
+
+    struct DeltaFrame {
+        uint64_t m_stepIdx = 0;
+        DesertParameters m_parameters;
+        std::vector<TileDelta> m_tiles;
+        size_t m_bytes = 0;
+    };
+
+    struct PendingRecord {
+        DesertState m_state;
+        // Flat grids still to be tiled into m_state, empty if it already holds them
+        std::vector<int32_t> m_sandBlocks;
+        std::vector<int32_t> m_bedrockBlocks;
+    };
+
+    struct Segment {
+        // Holds everything but the block grids, which are kept compressed
+        std::unique_ptr<DesertState> m_upKeyframe = nullptr;
+        std::vector<uint8_t> m_sandKeyframe;
+        std::vector<uint8_t> m_bedrockKeyframe;
+        std::vector<DeltaFrame> m_deltas;
+        size_t m_bytes = 0;
+    };
+
+    DesertHistory(const DesertHistory &);  // Prevent copies
+    DesertHistory &operator=(const DesertHistory &);
+
+    void RecorderLoop();
+    void Encode(const DesertState &state);
+    // Drops every record at or after stepIdx. Expects m_mutex to be held.
+    void TruncateFrom(uint64_t stepIdx);
+
+    static void EncodeTileDelta(const int32_t *pPrevious, const int32_t *pCurrent,
+          uint32_t numCells, std::vector<uint8_t> &encoded);
+    static bool ApplyTileDelta(
+          const std::vector<uint8_t> &encoded, int32_t *pValues, uint32_t numCells);
+    static bool DecodeKeyframe(const Segment &segment, DesertState &state);
+    static bool ApplyFrame(const DeltaFrame &frame, DesertState &state);
+
+   private:
+    const uint32_t m_keyframeInterval = 1;
+    const size_t m_memoryBudgetBytes = 0;
+    static constexpr size_t MaxPendingRecords = 8;
+
+    // Owned by the recorder thread
+    std::unique_ptr<DesertState> m_upPrevious = nullptr;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_recordAvailable;
+    std::condition_variable m_queueDrained;
+    std::deque<PendingRecord> m_pendingRecords;
+    bool m_encoding = false;
+    bool m_shutdown = false;
+    uint64_t m_droppedRecords = 0;
+
+    std::deque<Segment> m_segments;
+    size_t m_usedBytes = 0;
+
+    std::thread m_recorderThread;
+};
+
+}
@@ -0,0 +1,74 @@
+#include "DesertKernels.h"
+
+#include "DesertTables.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Farlor {
+
+namespace {
+
+constexpr uint64_t DesertSeed = 0x5EED5A4D;
+
+}
+
+const char *DesertStageName(const DesertStage stage)
+{
+    switch (stage) {
+        case DesertStage::WindShadow:
+            return "WindShadow";
+        case DesertStage::Transport:
+            return "Transport";
+        case DesertStage::Cascade:
+            return "Cascade";
+        default:
+            return "Unknown";
+    }
+}
+
+DesertStepSettings BuildDesertStepSettings(const DesertState &state)
+{
+    const DesertParameters &parameters = state.GetParameters();
+    const uint32_t resolution = state.GetGridResolution();
+    const SlopeTable slopes
+          = GetSlopeTable(state.GetCellSizeMeters(), state.GetBlockHeightMeters());
+
+    DesertStepSettings settings;
+    settings.m_seed = DesertSeed;
+
+    // Snap the wind to the nearest of the 8 grid directions
+    constexpr std::array<int32_t, 8> octantX = { 1, 1, 0, -1, -1, -1, 0, 1 };
+    constexpr std::array<int32_t, 8> octantY = { 0, 1, 1, 1, 0, -1, -1, -1 };
+    const float windAngle = std::atan2(parameters.m_windDirectionZ, parameters.m_windDirectionX);
+    const int32_t octant
+          = (static_cast<int32_t>(std::lround(windAngle / (ConstexprMath::Pi / 4.0))) + 8) % 8;
+    settings.m_windStepX = octantX[octant];
+    settings.m_windStepY = octantY[octant];
+
+    const uint32_t shadowDistance = std::min(MaxShadowDistance, resolution);
+    const auto &shadowThresholds = slopes.m_shadowThresholds[octant % 2];
+    settings.m_shadowThresholds.assign(
+          shadowThresholds.begin(), shadowThresholds.begin() + shadowDistance);
+
+    // Spread the target number of moved blocks over the grid, scaled by wind strength
+    const double numCells = double(resolution) * resolution;
+    const double liftChance = std::clamp(
+          parameters.m_targetBlocksToMove * parameters.m_windSpeed / numCells, 0.0, 1.0);
+    settings.m_liftThreshold = static_cast<uint32_t>(
+          std::min(liftChance * 4294967296.0, double(std::numeric_limits<uint32_t>::max())));
+    settings.m_liftProbability = static_cast<float>(liftChance);
+
+    const uint32_t maxHop = std::clamp(parameters.m_maxTransportSteps, 1u, resolution);
+    GetHopDistribution(
+          parameters.m_windSpeed, maxHop, settings.m_hopProbabilities, settings.m_hopCdf);
+
+    settings.m_reposeThreshold = slopes.m_reposeThreshold;
+    settings.m_reposeThresholdDiagonal = slopes.m_reposeThresholdDiagonal;
+    settings.m_cascadePasses = parameters.m_numSandCascadePasses;
+
+    return settings;
+}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "DesertState.h"
+#include "DesertStatistics.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// Stages of one CPU desert step, run in this order
+enum class DesertStage : uint32_t {
+    WindShadow,
+    Transport,
+    Cascade,
+    Count,
+};
+
+const char *DesertStageName(DesertStage stage);
+
+// How the transport stage moves sand
+enum class DesertTransportMode : uint32_t {
+    // Every cell rolls for a lift and a hop length, like the GPU simulation
+    Stochastic,
+    // Moves the expected sand flux along the wind instead. Branch free and much faster, but
+    // no longer whole blocks, so it cannot match the stochastic reference.
+    MeanField,
+};
+
+// Per step constants derived from a DesertState, shared by every kernel implementation so they
+// all agree bit for bit
+struct DesertStepSettings {
+    // Wind snapped to one of the 8 grid directions
+    int32_t m_windStepX = 1;
+    int32_t m_windStepY = 0;
+
+    // A cell is in shadow if the cell d steps upwind is at least m_shadowThresholds[d - 1]
+    // blocks taller
+    std::vector<int32_t> m_shadowThresholds;
+
+    // Chance a sand block lifts, in 1/2^32, and cumulative hop length chances for hops of
+    // 1..m_hopCdf.size() cells
+    uint32_t m_liftThreshold = 0;
+    std::vector<uint32_t> m_hopCdf;
+
+    // The same distributions as plain probabilities, for the mean field transport
+    float m_liftProbability = 0.0f;
+    std::vector<float> m_hopProbabilities;
+
+    // Height difference in blocks above which sand slides to an axis / diagonal neighbour
+    int32_t m_reposeThreshold = 1;
+    int32_t m_reposeThresholdDiagonal = 1;
+    uint32_t m_cascadePasses = 0;
+
+    uint64_t m_seed = 0;
+};
+
+DesertStepSettings BuildDesertStepSettings(const DesertState &state);
+
+// Neighbour order used by the cascade; direction k + 1 is stored for a move to neighbour k
+constexpr std::array<int32_t, 8> CascadeOffsetsX = { 1, -1, 0, 0, 1, -1, 1, -1 };
+constexpr std::array<int32_t, 8> CascadeOffsetsY = { 0, 0, 1, -1, 1, -1, -1, 1 };
+constexpr std::array<uint8_t, 8> CascadeOpposite = { 1, 0, 3, 2, 5, 4, 7, 6 };
+
+// Counter based random number for a cell, so results do not depend on visiting order
+inline uint32_t DesertCellRandom(
+      const uint64_t seed, const uint64_t stepIdx, const uint32_t cellIdx, const uint32_t stream)
+{
+    uint64_t value = seed ^ (stepIdx * 0x9E3779B97F4A7C15ull)
+          ^ ((uint64_t(cellIdx) << 2 | stream) * 0xD1B54A32D192ED03ull);
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    return static_cast<uint32_t>(value);
+}
+
+// Hop length in cells for the sand lifted from a cell this step, or 0 if nothing lifts. The
+// caller still has to reject hops that land on an obstacle.
+inline uint32_t SampleDesertHop(const DesertStepSettings &settings, const uint64_t stepIdx,
+      const uint32_t cellIdx, const int32_t sandBlocks, const bool inShadow)
+{
+    if ((sandBlocks <= 0) || inShadow
+          || (DesertCellRandom(settings.m_seed, stepIdx, cellIdx, 0) >= settings.m_liftThreshold)) {
+        return 0;
+    }
+
+    const uint32_t hopRandom = DesertCellRandom(settings.m_seed, stepIdx, cellIdx, 1);
+    uint32_t hop = 1;
+    while ((hop < settings.m_hopCdf.size()) && (hopRandom > settings.m_hopCdf[hop - 1])) {
+        hop++;
+    }
+    return hop;
+}
+
+// CPU implementation of the desert step. Implementations must produce identical results for
+// the same input; DesertValidator checks this stage by stage.
+class DesertKernels {
+   public:
+    virtual ~DesertKernels() = default;
+
+    virtual void Load(const DesertState &state) = 0;
+
+    // Writes the sand back, keeping tiles that did not change shared with other branches
+    virtual void Store(DesertState &state) const = 0;
+
+    virtual void RunStage(DesertStage stage, uint64_t stepIdx) = 0;
+
+    // Row major output of a stage: the shadow flags for WindShadow, the sand blocks otherwise
+    virtual void ReadStageOutput(DesertStage stage, std::vector<int32_t> &values) const = 0;
+
+    void Step(const uint64_t stepIdx)
+    {
+        for (uint32_t stageIdx = 0; stageIdx < uint32_t(DesertStage::Count); stageIdx++) {
+            RunStage(static_cast<DesertStage>(stageIdx), stepIdx);
+        }
+    }
+
+    // Statistics of the last step that ran through the Cascade stage, gathered by the stage
+    // sweeps themselves
+    const DesertStatistics &GetStepStatistics() const { return m_stepStatistics; }
+
+   protected:
+    DesertStatistics m_stepStatistics;
+};
+
+}
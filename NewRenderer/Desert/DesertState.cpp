@@ -0,0 +1,60 @@
+#include "DesertState.h"
+
+#include <cassert>
+
+namespace Farlor {
+
+DesertState::DesertState(uint32_t gridResolution, float cellSizeMeters, float blockHeightMeters,
+      uint32_t tileSize)
+    : m_gridResolution(gridResolution)
+    , m_cellSizeMeters(cellSizeMeters)
+    , m_blockHeightMeters(blockHeightMeters)
+    , m_sandBlocks(gridResolution, tileSize, 0)
+    , m_bedrockBlocks(gridResolution, tileSize, 0)
+    , m_spObstacles(std::make_shared<BitGrid>(gridResolution))
+{
+}
+
+DesertState::DesertState(uint32_t gridResolution, float cellSizeMeters, float blockHeightMeters,
+      const std::vector<int32_t> &sandBlocks, const std::vector<int32_t> &bedrockBlocks,
+      uint32_t tileSize)
+    : m_gridResolution(gridResolution)
+    , m_cellSizeMeters(cellSizeMeters)
+    , m_blockHeightMeters(blockHeightMeters)
+    , m_sandBlocks(gridResolution, tileSize, sandBlocks)
+    , m_bedrockBlocks(gridResolution, tileSize, bedrockBlocks)
+    , m_spObstacles(std::make_shared<BitGrid>(gridResolution))
+{
+}
+
+DesertState DesertState::Fork(const std::string &branchName) const
+{
+    DesertState branch(*this);
+    branch.m_branchName = branchName;
+    return branch;
+}
+
+uint32_t DesertState::ShareUnchangedTiles(const DesertState &parent)
+{
+    assert(parent.m_gridResolution == m_gridResolution && "Parent resolution mismatch");
+    return m_sandBlocks.ShareUnchangedTiles(parent.m_sandBlocks)
+          + m_bedrockBlocks.ShareUnchangedTiles(parent.m_bedrockBlocks);
+}
+
+void DesertState::SetObstacles(std::shared_ptr<const BitGrid> spObstacles)
+{
+    assert(spObstacles->GetResolution() == m_gridResolution);
+    m_spObstacles = std::move(spObstacles);
+}
+
+size_t DesertState::GetSharedBytes() const
+{
+    return m_sandBlocks.GetSharedBytes() + m_bedrockBlocks.GetSharedBytes();
+}
+
+uint32_t DesertState::GetUniqueTileCount() const
+{
+    return m_sandBlocks.GetUniqueTileCount() + m_bedrockBlocks.GetUniqueTileCount();
+}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "BitGrid.h"
+#include "TiledGrid.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Farlor {
+
+// Parameters a simulation branch may change independently of its parent
+struct DesertParameters {
+    float m_windDirectionX = 1.0f;
+    float m_windDirectionZ = 0.0f;
+    float m_windSpeed = 1.0f;
+    uint32_t m_maxTransportSteps = 10;
+    uint32_t m_targetBlocksToMove = 100;
+    uint32_t m_numSandCascadePasses = 50;
+};
+
+// CPU side snapshot of a block based desert simulation. Fork() is O(1): the branch shares every
+// tile with its parent and only allocates the tiles it modifies.
+class DesertState {
+   public:
+    static constexpr uint32_t DefaultTileSize = 64;
+
+   public:
+    DesertState(uint32_t gridResolution, float cellSizeMeters, float blockHeightMeters,
+          uint32_t tileSize = DefaultTileSize);
+    DesertState(uint32_t gridResolution, float cellSizeMeters, float blockHeightMeters,
+          const std::vector<int32_t> &sandBlocks, const std::vector<int32_t> &bedrockBlocks,
+          uint32_t tileSize = DefaultTileSize);
+
+    DesertState Fork(const std::string &branchName) const;
+
+    // Shares every tile whose contents match the parent's. Returns the number of shared tiles.
+    uint32_t ShareUnchangedTiles(const DesertState &parent);
+
+    const std::string &GetBranchName() const { return m_branchName; }
+    void SetBranchName(const std::string &branchName) { m_branchName = branchName; }
+    uint32_t GetGridResolution() const { return m_gridResolution; }
+    float GetCellSizeMeters() const { return m_cellSizeMeters; }
+    float GetBlockHeightMeters() const { return m_blockHeightMeters; }
+
+    uint64_t GetStepIdx() const { return m_stepIdx; }
+    void AdvanceStep() { m_stepIdx++; }
+    void SetStepIdx(const uint64_t stepIdx) { m_stepIdx = stepIdx; }
+
+    const DesertParameters &GetParameters() const { return m_parameters; }
+    DesertParameters &AccessParameters() { return m_parameters; }
+
+    const TiledGrid<int32_t> &GetSandBlocks() const { return m_sandBlocks; }
+    TiledGrid<int32_t> &AccessSandBlocks() { return m_sandBlocks; }
+
+    const TiledGrid<int32_t> &GetBedrockBlocks() const { return m_bedrockBlocks; }
+    TiledGrid<int32_t> &AccessBedrockBlocks() { return m_bedrockBlocks; }
+
+    // Obstacles are static, so every branch shares the same mask
+    const BitGrid &GetObstacles() const { return *m_spObstacles; }
+    const std::shared_ptr<const BitGrid> &GetSharedObstacles() const { return m_spObstacles; }
+    void SetObstacles(std::shared_ptr<const BitGrid> spObstacles);
+
+    // Tile memory attributed to this branch, with shared tiles split between their owners
+    size_t GetSharedBytes() const;
+    uint32_t GetUniqueTileCount() const;
+
+   private:
+    std::string m_branchName = "root";
+
+    uint32_t m_gridResolution = 1;
+    float m_cellSizeMeters = 1.0f;
+    float m_blockHeightMeters = 1.0f;
+
+    uint64_t m_stepIdx = 0;
+    DesertParameters m_parameters;
+
+    TiledGrid<int32_t> m_sandBlocks;
+    TiledGrid<int32_t> m_bedrockBlocks;
+    std::shared_ptr<const BitGrid> m_spObstacles = nullptr;
+};
+
+}
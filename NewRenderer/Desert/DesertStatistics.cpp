@@ -0,0 +1,35 @@
+#include "DesertStatistics.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace Farlor {
+
+std::string DesertStatistics::ToString() const
+{
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer),
+          "sand %.3f blocks, height min %d / mean %.3f / max %d, moved %.1f transport + %" PRIu64
+          " cascade",
+          GetTotalSand(), (m_numCells > 0) ? m_minHeight : 0, GetMeanHeight(),
+          (m_numCells > 0) ? m_maxHeight : 0, m_transportedBlocks, m_cascadedBlocks);
+    return buffer;
+}
+
+DesertStatistics DesertStatisticsAccumulator::Reduce() const
+{
+    if (m_tiles.empty()) {
+        return DesertStatistics();
+    }
+
+    // Level by level, tile i absorbs tile i + span
+    std::vector<DesertStatistics> partials = m_tiles;
+    for (size_t span = 1; span < partials.size(); span *= 2) {
+        for (size_t idx = 0; idx + span < partials.size(); idx += 2 * span) {
+            partials[idx].Merge(partials[idx + span]);
+        }
+    }
+    return partials[0];
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace Farlor {
+
+// Conservation and terrain statistics for one desert step, folded in by the kernels during the
+// sweeps they already make rather than in separate passes
+struct DesertStatistics {
+    uint64_t m_numCells = 0;
+
+    // Sand volume at the end of the step. The mean field transport also keeps sand below one
+    // block per cell, so the conserved total is m_sandBlocks + m_sandFraction.
+    int64_t m_sandBlocks = 0;
+    double m_sandFraction = 0.0;
+
+    // Surface height (sand plus bedrock) in blocks at the end of the step
+    int64_t m_heightSum = 0;
+    int32_t m_minHeight = std::numeric_limits<int32_t>::max();
+    int32_t m_maxHeight = std::numeric_limits<int32_t>::min();
+
+    // Blocks moved during the step; fractional under the mean field transport
+    double m_transportedBlocks = 0.0;
+    uint64_t m_cascadedBlocks = 0;
+
+    void AddCell(const int32_t sand, const int32_t bedrock)
+    {
+        const int32_t height = sand + bedrock;
+        m_numCells++;
+        m_sandBlocks += sand;
+        m_heightSum += height;
+        m_minHeight = std::min(m_minHeight, height);
+        m_maxHeight = std::max(m_maxHeight, height);
+    }
+
+    void Merge(const DesertStatistics &other)
+    {
+        m_numCells += other.m_numCells;
+        m_sandBlocks += other.m_sandBlocks;
+        m_sandFraction += other.m_sandFraction;
+        m_heightSum += other.m_heightSum;
+        m_minHeight = std::min(m_minHeight, other.m_minHeight);
+        m_maxHeight = std::max(m_maxHeight, other.m_maxHeight);
+        m_transportedBlocks += other.m_transportedBlocks;
+        m_cascadedBlocks += other.m_cascadedBlocks;
+    }
+
+    double GetTotalSand() const { return double(m_sandBlocks) + m_sandFraction; }
+    double GetMeanHeight() const
+    {
+        return (m_numCells > 0) ? double(m_heightSum) / double(m_numCells) : 0.0;
+    }
+
+    std::string ToString() const;
+};
+
+// One partial DesertStatistics per tile of a sweep. Each tile is only written by the task that
+// processes it, and Reduce() merges the partials in a fixed pairwise tree, so the floating point
+// totals are bit identical for any thread count or schedule.
+class DesertStatisticsAccumulator {
+   public:
+    void Reset(const uint32_t numTiles) { m_tiles.assign(numTiles, DesertStatistics()); }
+
+    DesertStatistics &AccessTile(const uint32_t tileIdx) { return m_tiles[tileIdx]; }
+
+    DesertStatistics Reduce() const;
+
+   private:
+    std::vector<DesertStatistics> m_tiles;
+};
+
+}
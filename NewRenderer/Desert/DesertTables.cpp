@@ -0,0 +1,37 @@
+#include "DesertTables.h"
+
+#include <algorithm>
+
+namespace Farlor {
+
+SlopeTable GetSlopeTable(float cellSizeMeters, float blockHeightMeters)
+{
+    for (const SlopeTable &table : StandardSlopeTables) {
+        if ((table.m_cellSizeMeters == cellSizeMeters)
+              && (table.m_blockHeightMeters == blockHeightMeters)) {
+            return table;
+        }
+    }
+    return MakeSlopeTable(cellSizeMeters, blockHeightMeters);
+}
+
+void GetHopDistribution(float windSpeed, uint32_t maxHop, std::vector<float> &probabilities,
+      std::vector<uint32_t> &cdf)
+{
+    probabilities.resize(maxHop);
+    cdf.resize(maxHop);
+
+    const float speedSteps = windSpeed * WindSpeedStepsPerUnit;
+    const uint32_t speedIdx = static_cast<uint32_t>(speedSteps);
+    const bool isStandard = (maxHop == StandardMaxHop) && (speedSteps >= 0.0f)
+          && (float(speedIdx) == speedSteps) && (speedIdx < NumStandardWindSpeeds);
+    if (isStandard) {
+        const StandardHopTable &table = StandardHopTables[speedIdx];
+        std::copy(table.m_probabilities.begin(), table.m_probabilities.end(), probabilities.begin());
+        std::copy(table.m_cdf.begin(), table.m_cdf.end(), cdf.begin());
+        return;
+    }
+    GenerateHopDistribution(windSpeed, maxHop, probabilities.data(), cdf.data());
+}
+
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// Minimal constexpr math so the tables below can be built by the compiler. Accurate to well
+// below float precision over the ranges used here.
+namespace ConstexprMath {
+
+constexpr double Pi = 3.14159265358979323846;
+constexpr double Ln2 = 0.69314718055994530942;
+
+constexpr double DegreesToRadians(const double degrees) { return degrees * Pi / 180.0; }
+
+constexpr double Exp(const double x)
+{
+    // e^x = 2^n * e^r with |r| <= ln(2) / 2
+    const int64_t n = static_cast<int64_t>(x / Ln2 + ((x < 0.0) ? -0.5 : 0.5));
+    const double r = x - double(n) * Ln2;
+
+    double term = 1.0;
+    double sum = 1.0;
+    for (int32_t k = 1; k < 20; k++) {
+        term *= r / k;
+        sum += term;
+    }
+
+    const double base = (n < 0) ? 0.5 : 2.0;
+    for (int64_t i = 0; i < ((n < 0) ? -n : n); i++) {
+        sum *= base;
+    }
+    return sum;
+}
+
+// Taylor series, for |x| up to about pi / 2
+constexpr double Sin(const double x)
+{
+    double term = x;
+    double sum = x;
+    for (int32_t k = 1; k < 12; k++) {
+        term *= -x * x / ((2 * k) * (2 * k + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double Cos(const double x)
+{
+    double term = 1.0;
+    double sum = 1.0;
+    for (int32_t k = 1; k < 12; k++) {
+        term *= -x * x / ((2 * k - 1) * (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double Tan(const double x) { return Sin(x) / Cos(x); }
+
+constexpr double Sqrt(const double x)
+{
+    if (x <= 0.0) {
+        return 0.0;
+    }
+    double estimate = (x > 1.0) ? x : 1.0;
+    for (int32_t i = 0; i < 64; i++) {
+        estimate = 0.5 * (estimate + x / estimate);
+    }
+    return estimate;
+}
+
+constexpr double Ceil(const double x)
+{
+    const double truncated = double(static_cast<int64_t>(x));
+    return (truncated < x) ? truncated + 1.0 : truncated;
+}
+
+}
+
+constexpr uint32_t MaxShadowDistance = 8;
+constexpr double ShadowAngleDegrees = 15.0;
+constexpr double ReposeAngleDegrees = 33.0;
+
+// Slope limits converted to whole blocks for one cell size and block height
+struct SlopeTable {
+    float m_cellSizeMeters = 0.0f;
+    float m_blockHeightMeters = 0.0f;
+
+    // Height difference above which sand slides to an axis / diagonal neighbour
+    int32_t m_reposeThreshold = 1;
+    int32_t m_reposeThresholdDiagonal = 1;
+
+    // Height difference at which a cell d steps upwind shadows this one, indexed by
+    // [diagonal][d - 1]
+    std::array<std::array<int32_t, MaxShadowDistance>, 2> m_shadowThresholds = {};
+};
+
+// Heights are whole blocks, so slope limits round up to at least one block
+constexpr int32_t SlopeThresholdBlocks(
+      const double slope, const double distanceMeters, const double blockHeightMeters)
+{
+    const int32_t blocks
+          = static_cast<int32_t>(ConstexprMath::Ceil(slope * distanceMeters / blockHeightMeters));
+    return (blocks > 1) ? blocks : 1;
+}
+
+constexpr SlopeTable MakeSlopeTable(const float cellSizeMeters, const float blockHeightMeters)
+{
+    using namespace ConstexprMath;
+    const double reposeSlope = Tan(DegreesToRadians(ReposeAngleDegrees));
+    const double shadowSlope = Tan(DegreesToRadians(ShadowAngleDegrees));
+    const double diagonal = Sqrt(2.0);
+
+    SlopeTable table;
+    table.m_cellSizeMeters = cellSizeMeters;
+    table.m_blockHeightMeters = blockHeightMeters;
+    table.m_reposeThreshold = SlopeThresholdBlocks(reposeSlope, cellSizeMeters, blockHeightMeters);
+    table.m_reposeThresholdDiagonal
+          = SlopeThresholdBlocks(reposeSlope, cellSizeMeters * diagonal, blockHeightMeters);
+    for (uint32_t distance = 1; distance <= MaxShadowDistance; distance++) {
+        table.m_shadowThresholds[0][distance - 1]
+              = SlopeThresholdBlocks(shadowSlope, distance * cellSizeMeters, blockHeightMeters);
+        table.m_shadowThresholds[1][distance - 1] = SlopeThresholdBlocks(
+              shadowSlope, distance * cellSizeMeters * diagonal, blockHeightMeters);
+    }
+    return table;
+}
+
+// The large scale simulation uses a block height of 1 / cellSize
+constexpr std::array<SlopeTable, 5> StandardSlopeTables = {
+    MakeSlopeTable(0.25f, 4.0f),
+    MakeSlopeTable(0.5f, 2.0f),
+    MakeSlopeTable(1.0f, 1.0f),
+    MakeSlopeTable(2.0f, 0.5f),
+    MakeSlopeTable(4.0f, 0.25f),
+};
+
+// Compile time table when the sizes match a standard one, otherwise built at runtime
+SlopeTable GetSlopeTable(float cellSizeMeters, float blockHeightMeters);
+
+// Hop lengths fall off exponentially with a mean of twice the wind speed, clamped to
+// [1, maxHop]. Writes the probability of hops of 1..maxHop cells, and the cumulative chance
+// in 1/2^32 with the last entry forced to UINT32_MAX.
+constexpr void GenerateHopDistribution(
+      const double windSpeed, const uint32_t maxHop, float *pProbabilities, uint32_t *pCdf)
+{
+    double meanHop = windSpeed * 2.0;
+    meanHop = (meanHop < 1.0) ? 1.0 : ((meanHop > double(maxHop)) ? double(maxHop) : meanHop);
+
+    double totalWeight = 0.0;
+    for (uint32_t hop = 0; hop < maxHop; hop++) {
+        totalWeight += ConstexprMath::Exp(-double(hop) / meanHop);
+    }
+
+    double cumulative = 0.0;
+    for (uint32_t hop = 0; hop < maxHop; hop++) {
+        const double probability = ConstexprMath::Exp(-double(hop) / meanHop) / totalWeight;
+        cumulative += probability;
+        pProbabilities[hop] = static_cast<float>(probability);
+        pCdf[hop] = (cumulative >= 1.0) ? UINT32_MAX
+                                        : static_cast<uint32_t>(cumulative * 4294967295.0);
+    }
+    pCdf[maxHop - 1] = UINT32_MAX;
+}
+
+constexpr uint32_t StandardMaxHop = 10;
+constexpr uint32_t WindSpeedStepsPerUnit = 4;
+constexpr uint32_t NumStandardWindSpeeds = 8 * WindSpeedStepsPerUnit + 1;
+
+struct StandardHopTable {
+    std::array<float, StandardMaxHop> m_probabilities = {};
+    std::array<uint32_t, StandardMaxHop> m_cdf = {};
+};
+
+// Hop distributions for the default maximum hop and wind speeds 0, 0.25, ... 8
+constexpr std::array<StandardHopTable, NumStandardWindSpeeds> MakeStandardHopTables()
+{
+    std::array<StandardHopTable, NumStandardWindSpeeds> tables = {};
+    for (uint32_t speedIdx = 0; speedIdx < NumStandardWindSpeeds; speedIdx++) {
+        GenerateHopDistribution(double(speedIdx) / WindSpeedStepsPerUnit, StandardMaxHop,
+              tables[speedIdx].m_probabilities.data(), tables[speedIdx].m_cdf.data());
+    }
+    return tables;
+}
+
+constexpr std::array<StandardHopTable, NumStandardWindSpeeds> StandardHopTables
+      = MakeStandardHopTables();
+
+// Fills the hop distribution from the compile time tables when windSpeed and maxHop match a
+// standard entry, computing it otherwise
+void GetHopDistribution(float windSpeed, uint32_t maxHop, std::vector<float> &probabilities,
+      std::vector<uint32_t> &cdf);
+
+}
@@ -0,0 +1,140 @@
+#include "DesertValidation.h"
+
+#include "ReferenceDesertKernels.h"
+#include "TiledDesertKernels.h"
+
+#include <xxhash.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+namespace Farlor {
+
+std::string DesertValidationResult::ToString() const
+{
+    char buffer[256];
+    if (m_passed) {
+        std::snprintf(buffer, sizeof(buffer), "threads %u, tile size %u: match", m_numThreads,
+              m_tileSize);
+    } else {
+        std::snprintf(buffer, sizeof(buffer),
+              "threads %u, tile size %u: diverged at step %" PRIu64
+              ", stage %s, tile (%u, %u), expected %016" PRIx64 ", got %016" PRIx64,
+              m_numThreads, m_tileSize, m_stepIdx, DesertStageName(m_stage), m_tileX, m_tileY,
+              m_expectedHash, m_actualHash);
+    }
+    return buffer;
+}
+
+DesertValidator::GoldenHashes DesertValidator::RecordGoldenHashes(DesertKernels &kernels,
+      const DesertState &state, uint32_t numSteps, uint32_t hashTileSize)
+{
+    GoldenHashes golden;
+    golden.m_firstStep = state.GetStepIdx();
+    golden.m_numSteps = numSteps;
+    golden.m_hashTileSize = hashTileSize;
+
+    kernels.Load(state);
+    std::vector<int32_t> values;
+    for (uint32_t stepOffset = 0; stepOffset < numSteps; stepOffset++) {
+        for (uint32_t stageIdx = 0; stageIdx < uint32_t(DesertStage::Count); stageIdx++) {
+            const DesertStage stage = static_cast<DesertStage>(stageIdx);
+            kernels.RunStage(stage, golden.m_firstStep + stepOffset);
+            kernels.ReadStageOutput(stage, values);
+
+            golden.m_stageTileHashes.emplace_back();
+            HashTiles(values, state.GetGridResolution(), hashTileSize,
+                  golden.m_stageTileHashes.back());
+        }
+    }
+    return golden;
+}
+
+DesertValidationResult DesertValidator::Compare(
+      DesertKernels &kernels, const DesertState &state, const GoldenHashes &golden)
+{
+    const uint32_t resolution = state.GetGridResolution();
+    const uint32_t tilesPerSide = (resolution + golden.m_hashTileSize - 1) / golden.m_hashTileSize;
+
+    DesertValidationResult result;
+    kernels.Load(state);
+    std::vector<int32_t> values;
+    std::vector<uint64_t> tileHashes;
+    for (uint32_t stepOffset = 0; stepOffset < golden.m_numSteps; stepOffset++) {
+        for (uint32_t stageIdx = 0; stageIdx < uint32_t(DesertStage::Count); stageIdx++) {
+            const DesertStage stage = static_cast<DesertStage>(stageIdx);
+            const uint64_t stepIdx = golden.m_firstStep + stepOffset;
+            kernels.RunStage(stage, stepIdx);
+            kernels.ReadStageOutput(stage, values);
+            HashTiles(values, resolution, golden.m_hashTileSize, tileHashes);
+
+            const std::vector<uint64_t> &expected
+                  = golden.m_stageTileHashes[stepOffset * uint32_t(DesertStage::Count) + stageIdx];
+            const auto mismatch
+                  = std::mismatch(expected.begin(), expected.end(), tileHashes.begin());
+            if (mismatch.first == expected.end()) {
+                continue;
+            }
+
+            const uint32_t tileIdx = static_cast<uint32_t>(mismatch.first - expected.begin());
+            result.m_passed = false;
+            result.m_stepIdx = stepIdx;
+            result.m_stage = stage;
+            result.m_tileX = tileIdx % tilesPerSide;
+            result.m_tileY = tileIdx / tilesPerSide;
+            result.m_expectedHash = *mismatch.first;
+            result.m_actualHash = *mismatch.second;
+            return result;
+        }
+    }
+    return result;
+}
+
+std::vector<DesertValidationResult> DesertValidator::Validate(
+      const DesertState &state, const DesertValidationConfig &config)
+{
+    ReferenceDesertKernels reference;
+    const GoldenHashes golden
+          = RecordGoldenHashes(reference, state, config.m_numSteps, config.m_hashTileSize);
+
+    std::vector<DesertValidationResult> results;
+    for (uint32_t numThreads : config.m_threadCounts) {
+        for (uint32_t tileSize : config.m_tileSizes) {
+            TiledDesertKernels kernels(numThreads, tileSize);
+            DesertValidationResult result = Compare(kernels, state, golden);
+            result.m_numThreads = numThreads;
+            result.m_tileSize = tileSize;
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+void DesertValidator::HashTiles(const std::vector<int32_t> &values, uint32_t resolution,
+      uint32_t hashTileSize, std::vector<uint64_t> &tileHashes)
+{
+    const uint32_t tilesPerSide = (resolution + hashTileSize - 1) / hashTileSize;
+    tileHashes.resize(size_t(tilesPerSide) * tilesPerSide);
+
+    std::vector<int32_t> tileValues;
+    tileValues.reserve(size_t(hashTileSize) * hashTileSize);
+    for (uint32_t tileY = 0; tileY < tilesPerSide; tileY++) {
+        for (uint32_t tileX = 0; tileX < tilesPerSide; tileX++) {
+            const uint32_t x0 = tileX * hashTileSize;
+            const uint32_t x1 = std::min(x0 + hashTileSize, resolution);
+            const uint32_t y0 = tileY * hashTileSize;
+            const uint32_t y1 = std::min(y0 + hashTileSize, resolution);
+
+            tileValues.clear();
+            for (uint32_t y = y0; y < y1; y++) {
+                const auto rowStart = values.begin() + size_t(y) * resolution;
+                tileValues.insert(tileValues.end(), rowStart + x0, rowStart + x1);
+            }
+            tileHashes[tileY * tilesPerSide + tileX]
+                  = XXH3_64bits(tileValues.data(), tileValues.size() * sizeof(int32_t));
+        }
+    }
+}
+
+}
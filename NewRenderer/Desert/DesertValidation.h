@@ -0,0 +1,68 @@
+#pragma once
+
+#include "DesertKernels.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Farlor {
+
+struct DesertValidationConfig {
+    // Every combination of thread count and tile size is checked; 0 threads uses every core
+    std::vector<uint32_t> m_threadCounts = { 1, 4, 0 };
+    std::vector<uint32_t> m_tileSizes = { 16, 64 };
+    uint32_t m_numSteps = 2;
+
+    // Granularity of the hashes, and so of the reported divergence
+    uint32_t m_hashTileSize = 32;
+};
+
+struct DesertValidationResult {
+    uint32_t m_numThreads = 0;
+    uint32_t m_tileSize = 0;
+
+    bool m_passed = true;
+
+    // First divergence, valid when m_passed is false
+    uint64_t m_stepIdx = 0;
+    DesertStage m_stage = DesertStage::WindShadow;
+    uint32_t m_tileX = 0;
+    uint32_t m_tileY = 0;
+    uint64_t m_expectedHash = 0;
+    uint64_t m_actualHash = 0;
+
+    std::string ToString() const;
+};
+
+// Golden hash determinism check for the CPU desert kernels. The reference kernels are run from
+// a starting state and the output of every stage is hashed per tile with xxHash. The tiled
+// kernels are then run from the same state for each configuration and their hashes compared,
+// reporting the first step, stage and tile that differ.
+class DesertValidator {
+   public:
+    struct GoldenHashes {
+        uint64_t m_firstStep = 0;
+        uint32_t m_numSteps = 0;
+        uint32_t m_hashTileSize = 0;
+
+        // Per tile hashes, indexed by step * DesertStage::Count + stage
+        std::vector<std::vector<uint64_t>> m_stageTileHashes;
+    };
+
+   public:
+    static GoldenHashes RecordGoldenHashes(DesertKernels &kernels, const DesertState &state,
+          uint32_t numSteps, uint32_t hashTileSize);
+
+    // Runs kernels from state and compares against golden, stopping at the first difference
+    static DesertValidationResult Compare(
+          DesertKernels &kernels, const DesertState &state, const GoldenHashes &golden);
+
+    static std::vector<DesertValidationResult> Validate(
+          const DesertState &state, const DesertValidationConfig &config);
+
+    static void HashTiles(const std::vector<int32_t> &values, uint32_t resolution,
+          uint32_t hashTileSize, std::vector<uint64_t> &tileHashes);
+};
+
+}
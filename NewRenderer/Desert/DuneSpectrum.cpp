@@ -0,0 +1,163 @@
+#include "DuneSpectrum.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+namespace Farlor {
+
+namespace {
+
+// Rows past the middle of the spectrum hold the negative wavenumbers
+int32_t SignedWavenumber(const uint32_t row, const uint32_t resolution)
+{
+    return (row < resolution / 2) ? int32_t(row) : int32_t(row) - int32_t(resolution);
+}
+
+uint32_t RadialBin(const uint32_t kx, const int32_t ky)
+{
+    return static_cast<uint32_t>(std::lround(std::sqrt(double(kx) * kx + double(ky) * ky)));
+}
+
+double ModePower(const std::vector<float> &real, const std::vector<float> &imag, const size_t idx)
+{
+    return double(real[idx]) * real[idx] + double(imag[idx]) * imag[idx];
+}
+
+}
+
+std::string DuneSpectrumReport::ToString() const
+{
+    char buffer[256];
+    if (!m_valid) {
+        std::snprintf(buffer, sizeof(buffer),
+              "step %" PRIu64 ": no spectrum, resolution %u is not a power of two", m_stepIdx,
+              m_resolution);
+    } else {
+        std::snprintf(buffer, sizeof(buffer),
+              "step %" PRIu64 ": mean height %.3f m, rms %.3f m, dominant wavelength %.2f m "
+              "(bin %u), direction %.1f deg",
+              m_stepIdx, m_meanHeightMeters, m_rmsHeightMeters, m_dominantWavelengthMeters,
+              m_peakBin, m_dominantDirectionDegrees);
+    }
+    return buffer;
+}
+
+DuneSpectrumAnalyzer::DuneSpectrumAnalyzer(uint32_t numThreads)
+    : m_numThreads(numThreads)
+{
+}
+
+DuneSpectrumReport DuneSpectrumAnalyzer::Analyze(const DesertState &state)
+{
+    const uint32_t resolution = state.GetGridResolution();
+
+    DuneSpectrumReport report;
+    report.m_stepIdx = state.GetStepIdx();
+    report.m_resolution = resolution;
+    report.m_cellSizeMeters = state.GetCellSizeMeters();
+    if (resolution < 2 || (resolution & (resolution - 1)) != 0) {
+        return report;
+    }
+    report.m_valid = true;
+
+    // Surface height in meters, read a tile at a time
+    const TiledGrid<int32_t> &sand = state.GetSandBlocks();
+    const TiledGrid<int32_t> &bedrock = state.GetBedrockBlocks();
+    const uint32_t tileSize = sand.GetTileSize();
+    const float blockHeight = state.GetBlockHeightMeters();
+    m_heights.resize(size_t(resolution) * resolution);
+    double heightSum = 0.0;
+    for (uint32_t tileY = 0; tileY < sand.GetTilesPerSide(); tileY++) {
+        for (uint32_t tileX = 0; tileX < sand.GetTilesPerSide(); tileX++) {
+            const uint32_t tileIdx = sand.TileIndex(tileX, tileY);
+            const int32_t *pSand = sand.GetTileData(tileIdx);
+            const int32_t *pBedrock = bedrock.GetTileData(tileIdx);
+            for (uint32_t localY = 0; localY < tileSize; localY++) {
+                float *pRow = &m_heights[size_t(tileY * tileSize + localY) * resolution
+                      + tileX * tileSize];
+                for (uint32_t localX = 0; localX < tileSize; localX++) {
+                    const size_t localIdx = size_t(localY) * tileSize + localX;
+                    pRow[localX] = float(pSand[localIdx] + pBedrock[localIdx]) * blockHeight;
+                    heightSum += pRow[localX];
+                }
+            }
+        }
+    }
+
+    // Remove the mean so it does not leak into the low wavenumbers
+    const double numCells = double(resolution) * resolution;
+    const float meanHeight = static_cast<float>(heightSum / numCells);
+    for (float &height : m_heights) {
+        height -= meanHeight;
+    }
+    report.m_meanHeightMeters = meanHeight;
+
+    if (!m_upFFT || m_upFFT->GetSize() != resolution) {
+        m_upFFT = std::make_unique<RealFFT2D>(resolution, m_numThreads);
+    }
+    m_upFFT->Forward(m_heights.data(), m_real, m_imag);
+
+    // Parseval: the normalized power of all modes adds up to the variance. Columns other than
+    // kx = 0 and kx = resolution / 2 stand in for their mirrored half as well.
+    const uint32_t width = m_upFFT->GetSpectrumWidth();
+    const uint32_t numBins = resolution / 2 + 1;
+    const double normalization = 1.0 / (numCells * numCells);
+    std::vector<double> binPower(numBins, 0.0);
+    std::vector<double> binWeight(numBins, 0.0);
+    double variance = 0.0;
+    for (uint32_t row = 0; row < resolution; row++) {
+        const int32_t ky = SignedWavenumber(row, resolution);
+        for (uint32_t kx = 0; kx < width; kx++) {
+            const double power
+                  = ModePower(m_real, m_imag, size_t(row) * width + kx) * normalization;
+            const double weight = (kx == 0 || kx == width - 1) ? 1.0 : 2.0;
+            if (kx != 0 || ky != 0) {
+                variance += weight * power;
+            }
+
+            const uint32_t bin = RadialBin(kx, ky);
+            if (bin < numBins) {
+                binPower[bin] += weight * power;
+                binWeight[bin] += weight;
+            }
+        }
+    }
+
+    report.m_radialPower.resize(numBins);
+    for (uint32_t bin = 0; bin < numBins; bin++) {
+        report.m_radialPower[bin] = (binWeight[bin] > 0.0) ? binPower[bin] / binWeight[bin] : 0.0;
+        const bool stronger = (report.m_peakBin == 0)
+              || (report.m_radialPower[bin] > report.m_radialPower[report.m_peakBin]);
+        if (bin > 0 && stronger) {
+            report.m_peakBin = bin;
+        }
+    }
+    report.m_rmsHeightMeters = static_cast<float>(std::sqrt(variance));
+    if (report.m_peakBin == 0) {
+        return report;
+    }
+    report.m_dominantWavelengthMeters
+          = float(resolution) * report.m_cellSizeMeters / float(report.m_peakBin);
+
+    // Strongest single mode inside the peak bin gives the orientation
+    double bestPower = -1.0;
+    for (uint32_t row = 0; row < resolution; row++) {
+        const int32_t ky = SignedWavenumber(row, resolution);
+        for (uint32_t kx = 0; kx < width; kx++) {
+            if (RadialBin(kx, ky) != report.m_peakBin) {
+                continue;
+            }
+            const double power = ModePower(m_real, m_imag, size_t(row) * width + kx);
+            if (power > bestPower) {
+                bestPower = power;
+                report.m_dominantDirectionDegrees = static_cast<float>(
+                      std::atan2(double(ky), double(kx)) * 180.0 / 3.14159265358979323846);
+            }
+        }
+    }
+
+    return report;
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "DesertState.h"
+#include "FFT.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Farlor {
+
+// Morphology statistics from the power spectrum of the surface height (sand plus bedrock)
+struct DuneSpectrumReport {
+    // False when the grid is not a power of two, which the FFT needs
+    bool m_valid = false;
+
+    uint64_t m_stepIdx = 0;
+    uint32_t m_resolution = 0;
+    float m_cellSizeMeters = 1.0f;
+
+    float m_meanHeightMeters = 0.0f;
+    float m_rmsHeightMeters = 0.0f;
+
+    // Mean power per radial wavenumber bin k = 0 .. resolution / 2, where bin k has a
+    // wavelength of resolution / k cells. Normalized so the power of every mode but the mean
+    // adds up to the height variance.
+    std::vector<double> m_radialPower;
+
+    // Strongest bin other than the mean, and the direction of its strongest wave vector in
+    // degrees from +x. Crests run perpendicular to that direction.
+    uint32_t m_peakBin = 0;
+    float m_dominantWavelengthMeters = 0.0f;
+    float m_dominantDirectionDegrees = 0.0f;
+
+    std::string ToString() const;
+};
+
+// Computes DuneSpectrumReports, keeping the FFT plan and buffers between calls so periodic
+// logging does not reallocate
+class DuneSpectrumAnalyzer {
+   public:
+    // numThreads == 0 uses every hardware thread
+    explicit DuneSpectrumAnalyzer(uint32_t numThreads = 0);
+
+    DuneSpectrumReport Analyze(const DesertState &state);
+
+   private:
+    uint32_t m_numThreads = 0;
+    std::unique_ptr<RealFFT2D> m_upFFT = nullptr;
+
+    std::vector<float> m_heights;
+    std::vector<float> m_real;
+    std::vector<float> m_imag;
+};
+
+}
@@ -0,0 +1,192 @@
+#include "FFT.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+#include <xmmintrin.h>
+
+namespace Farlor {
+
+namespace {
+
+constexpr double TwoPi = 6.28318530717958647692;
+
+// Columns transformed per task in the column pass
+constexpr uint32_t ColumnBlock = 8;
+
+}
+
+FFT::FFT(const uint32_t size)
+    : m_size(size)
+    , m_bitReverse(size)
+    , m_twiddleReal(size)
+    , m_twiddleImag(size)
+{
+    assert(size > 0 && (size & (size - 1)) == 0 && "FFT size must be a power of two");
+
+    uint32_t numBits = 0;
+    while ((1u << numBits) < size) {
+        numBits++;
+    }
+    for (uint32_t idx = 0; idx < size; idx++) {
+        uint32_t reversed = 0;
+        for (uint32_t bit = 0; bit < numBits; bit++) {
+            reversed |= ((idx >> bit) & 1) << (numBits - 1 - bit);
+        }
+        m_bitReverse[idx] = reversed;
+    }
+
+    for (uint32_t span = 1; span < size; span *= 2) {
+        for (uint32_t idx = 0; idx < span; idx++) {
+            const double angle = -TwoPi * idx / (2.0 * span);
+            m_twiddleReal[span + idx] = static_cast<float>(std::cos(angle));
+            m_twiddleImag[span + idx] = static_cast<float>(std::sin(angle));
+        }
+    }
+}
+
+void FFT::Forward(float *pReal, float *pImag) const
+{
+    for (uint32_t idx = 0; idx < m_size; idx++) {
+        const uint32_t reversed = m_bitReverse[idx];
+        if (reversed > idx) {
+            std::swap(pReal[idx], pReal[reversed]);
+            std::swap(pImag[idx], pImag[reversed]);
+        }
+    }
+
+    uint32_t span = 1;
+
+    // The first two radix 2 stages only need twiddles of 1 and -i, so run them as one radix 4
+    // pass without multiplies
+    if (m_size >= 4) {
+        for (uint32_t base = 0; base < m_size; base += 4) {
+            float *pRe = pReal + base;
+            float *pIm = pImag + base;
+            const float sumRe01 = pRe[0] + pRe[1];
+            const float sumIm01 = pIm[0] + pIm[1];
+            const float difRe01 = pRe[0] - pRe[1];
+            const float difIm01 = pIm[0] - pIm[1];
+            const float sumRe23 = pRe[2] + pRe[3];
+            const float sumIm23 = pIm[2] + pIm[3];
+            const float difRe23 = pRe[2] - pRe[3];
+            const float difIm23 = pIm[2] - pIm[3];
+
+            // -i * (difRe23, difIm23) = (difIm23, -difRe23)
+            pRe[0] = sumRe01 + sumRe23;
+            pIm[0] = sumIm01 + sumIm23;
+            pRe[2] = sumRe01 - sumRe23;
+            pIm[2] = sumIm01 - sumIm23;
+            pRe[1] = difRe01 + difIm23;
+            pIm[1] = difIm01 - difRe23;
+            pRe[3] = difRe01 - difIm23;
+            pIm[3] = difIm01 + difRe23;
+        }
+        span = 4;
+    }
+
+    for (; span < m_size; span *= 2) {
+        const float *pTwRe = &m_twiddleReal[span];
+        const float *pTwIm = &m_twiddleImag[span];
+        for (uint32_t base = 0; base < m_size; base += 2 * span) {
+            float *pRe0 = pReal + base;
+            float *pIm0 = pImag + base;
+            float *pRe1 = pRe0 + span;
+            float *pIm1 = pIm0 + span;
+
+            uint32_t idx = 0;
+            for (; idx + 4 <= span; idx += 4) {
+                const __m128 twRe = _mm_loadu_ps(pTwRe + idx);
+                const __m128 twIm = _mm_loadu_ps(pTwIm + idx);
+                const __m128 re1 = _mm_loadu_ps(pRe1 + idx);
+                const __m128 im1 = _mm_loadu_ps(pIm1 + idx);
+                const __m128 tRe = _mm_sub_ps(_mm_mul_ps(re1, twRe), _mm_mul_ps(im1, twIm));
+                const __m128 tIm = _mm_add_ps(_mm_mul_ps(re1, twIm), _mm_mul_ps(im1, twRe));
+                const __m128 re0 = _mm_loadu_ps(pRe0 + idx);
+                const __m128 im0 = _mm_loadu_ps(pIm0 + idx);
+                _mm_storeu_ps(pRe0 + idx, _mm_add_ps(re0, tRe));
+                _mm_storeu_ps(pIm0 + idx, _mm_add_ps(im0, tIm));
+                _mm_storeu_ps(pRe1 + idx, _mm_sub_ps(re0, tRe));
+                _mm_storeu_ps(pIm1 + idx, _mm_sub_ps(im0, tIm));
+            }
+            for (; idx < span; idx++) {
+                const float tRe = pRe1[idx] * pTwRe[idx] - pIm1[idx] * pTwIm[idx];
+                const float tIm = pRe1[idx] * pTwIm[idx] + pIm1[idx] * pTwRe[idx];
+                pRe1[idx] = pRe0[idx] - tRe;
+                pIm1[idx] = pIm0[idx] - tIm;
+                pRe0[idx] += tRe;
+                pIm0[idx] += tIm;
+            }
+        }
+    }
+}
+
+RealFFT2D::RealFFT2D(const uint32_t size, const uint32_t numThreads)
+    : m_size(size)
+    , m_numThreads(numThreads)
+    , m_fft(size)
+{
+    assert(size >= 2 && "Real 2D FFT needs at least two rows to pair");
+}
+
+void RealFFT2D::Forward(
+      const float *pValues, std::vector<float> &real, std::vector<float> &imag) const
+{
+    const uint32_t size = m_size;
+    const uint32_t width = GetSpectrumWidth();
+    real.resize(size_t(size) * width);
+    imag.resize(size_t(size) * width);
+
+    // Rows 2r and 2r + 1 go in as the real and imaginary parts of one complex row. With
+    // Z = FFT(a + ib), FFT(a)[k] = (Z[k] + conj(Z[-k])) / 2 and
+    // FFT(b)[k] = (Z[k] - conj(Z[-k])) / 2i.
+    ParallelFor(size / 2, m_numThreads, [&](const uint32_t pairIdx) {
+        std::vector<float> zRe(pValues + size_t(2 * pairIdx) * size,
+              pValues + size_t(2 * pairIdx + 1) * size);
+        std::vector<float> zIm(pValues + size_t(2 * pairIdx + 1) * size,
+              pValues + size_t(2 * pairIdx + 2) * size);
+        m_fft.Forward(zRe.data(), zIm.data());
+
+        float *pRe0 = &real[size_t(2 * pairIdx) * width];
+        float *pIm0 = &imag[size_t(2 * pairIdx) * width];
+        float *pRe1 = pRe0 + width;
+        float *pIm1 = pIm0 + width;
+        for (uint32_t k = 0; k < width; k++) {
+            const uint32_t mirror = (size - k) & (size - 1);
+            pRe0[k] = 0.5f * (zRe[k] + zRe[mirror]);
+            pIm0[k] = 0.5f * (zIm[k] - zIm[mirror]);
+            pRe1[k] = 0.5f * (zIm[k] + zIm[mirror]);
+            pIm1[k] = 0.5f * (zRe[mirror] - zRe[k]);
+        }
+    });
+
+    // Columns are strided, so each task gathers a block of them into contiguous scratch,
+    // reading ColumnBlock neighbouring values from each row at a time
+    const uint32_t numBlocks = (width + ColumnBlock - 1) / ColumnBlock;
+    ParallelFor(numBlocks, m_numThreads, [&](const uint32_t blockIdx) {
+        const uint32_t k0 = blockIdx * ColumnBlock;
+        const uint32_t numColumns = std::min(width - k0, ColumnBlock);
+        std::vector<float> columnsRe(size_t(numColumns) * size);
+        std::vector<float> columnsIm(size_t(numColumns) * size);
+        for (uint32_t row = 0; row < size; row++) {
+            for (uint32_t column = 0; column < numColumns; column++) {
+                columnsRe[size_t(column) * size + row] = real[size_t(row) * width + k0 + column];
+                columnsIm[size_t(column) * size + row] = imag[size_t(row) * width + k0 + column];
+            }
+        }
+        for (uint32_t column = 0; column < numColumns; column++) {
+            m_fft.Forward(&columnsRe[size_t(column) * size], &columnsIm[size_t(column) * size]);
+        }
+        for (uint32_t row = 0; row < size; row++) {
+            for (uint32_t column = 0; column < numColumns; column++) {
+                real[size_t(row) * width + k0 + column] = columnsRe[size_t(column) * size + row];
+                imag[size_t(row) * width + k0 + column] = columnsIm[size_t(column) * size + row];
+            }
+        }
+    });
+}
+
+}
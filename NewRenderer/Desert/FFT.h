@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// In place complex FFT of a power of two length, on split real and imaginary arrays so every
+// butterfly stage runs over contiguous lanes. Twiddles and the bit reversal permutation are
+// built once per size; a plan is read only afterwards and can be shared between threads.
+class FFT {
+   public:
+    explicit FFT(uint32_t size);
+
+    uint32_t GetSize() const { return m_size; }
+
+    // Unscaled forward transform, X[k] = sum x[n] e^(-2 pi i k n / size)
+    void Forward(float *pReal, float *pImag) const;
+
+   private:
+    uint32_t m_size = 0;
+    std::vector<uint32_t> m_bitReverse;
+
+    // Twiddles for the stage with butterfly span h start at offset h, so each stage reads them
+    // with unit stride
+    std::vector<float> m_twiddleReal;
+    std::vector<float> m_twiddleImag;
+};
+
+// 2D FFT of a square real grid. The rows are transformed two at a time as one complex row,
+// then the columns of the half spectrum; both passes are spread over numThreads threads.
+class RealFFT2D {
+   public:
+    // size must be a power of two; numThreads == 0 uses every hardware thread
+    explicit RealFFT2D(uint32_t size, uint32_t numThreads = 0);
+
+    uint32_t GetSize() const { return m_size; }
+
+    // Columns of the half spectrum, kx = 0 .. size / 2. The other half is the complex conjugate
+    // mirror, F(-kx, -ky) = conj(F(kx, ky)).
+    uint32_t GetSpectrumWidth() const { return m_size / 2 + 1; }
+
+    // Transforms a row major size x size grid into real and imaginary half spectra of
+    // size rows (ky) by GetSpectrumWidth() columns (kx)
+    void Forward(const float *pValues, std::vector<float> &real, std::vector<float> &imag) const;
+
+   private:
+    uint32_t m_size = 0;
+    uint32_t m_numThreads = 0;
+    FFT m_fft;
+};
+
+}
@@ -0,0 +1,450 @@
+#include "GridCodec.h"
+
+#include "ParallelFor.h"
+#include "VarintCoding.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+namespace Farlor {
+
+namespace {
+
+constexpr uint32_t CodecMagic = 0x31434746;  // "FGC1"
+constexpr uint32_t HeaderBytes = 4 + 1 + 4 + 4 + 4;
+
+constexpr uint8_t TileModeStored = 0;
+constexpr uint8_t TileModeRans = 1;
+
+// rANS with 32 bit state and byte wise renormalization
+constexpr uint32_t RansScaleBits = 12;
+constexpr uint32_t RansScale = 1u << RansScaleBits;
+constexpr uint32_t RansLowerBound = 1u << 23;
+
+void WriteU32(uint32_t value, uint8_t *pData)
+{
+    pData[0] = static_cast<uint8_t>(value);
+    pData[1] = static_cast<uint8_t>(value >> 8);
+    pData[2] = static_cast<uint8_t>(value >> 16);
+    pData[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t ReadU32(const uint8_t *pData)
+{
+    return uint32_t(pData[0]) | (uint32_t(pData[1]) << 8) | (uint32_t(pData[2]) << 16)
+          | (uint32_t(pData[3]) << 24);
+}
+
+// Order preserving mapping of float bits to integers, so nearby heights give small residuals
+int64_t ToCodecValue(const int32_t value) { return value; }
+
+int64_t ToCodecValue(const float value)
+{
+    uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? int64_t(~bits) : int64_t(bits | 0x80000000u);
+}
+
+void FromCodecValue(const int64_t codecValue, int32_t &value)
+{
+    value = static_cast<int32_t>(codecValue);
+}
+
+void FromCodecValue(const int64_t codecValue, float &value)
+{
+    const uint32_t ordered = static_cast<uint32_t>(codecValue);
+    const uint32_t bits = (ordered & 0x80000000u) ? (ordered & 0x7FFFFFFFu) : ~ordered;
+    std::memcpy(&value, &bits, sizeof(value));
+}
+
+// Median edge detector from LOCO-I: picks min/max of left and top at edges, else the planar guess
+int64_t PredictMED(const int64_t left, const int64_t top, const int64_t topLeft)
+{
+    if (topLeft >= std::max(left, top)) {
+        return std::min(left, top);
+    }
+    if (topLeft <= std::min(left, top)) {
+        return std::max(left, top);
+    }
+    return left + top - topLeft;
+}
+
+int64_t Predict(const int64_t *pRow, const int64_t *pPreviousRow, const uint32_t x, const uint32_t y)
+{
+    if (y == 0) {
+        return (x == 0) ? 0 : pRow[x - 1];
+    }
+    if (x == 0) {
+        return pPreviousRow[0];
+    }
+    return PredictMED(pRow[x - 1], pPreviousRow[x], pPreviousRow[x - 1]);
+}
+
+void NormalizeFrequencies(
+      const std::array<uint32_t, 256> &counts, uint32_t total, std::array<uint32_t, 256> &freqs)
+{
+    uint32_t sum = 0;
+    uint32_t largestSymbol = 0;
+    for (uint32_t symbol = 0; symbol < 256; symbol++) {
+        freqs[symbol] = 0;
+        if (counts[symbol] == 0) {
+            continue;
+        }
+        freqs[symbol] = std::max(1u, uint32_t((uint64_t(counts[symbol]) * RansScale) / total));
+        sum += freqs[symbol];
+        if (freqs[symbol] > freqs[largestSymbol]) {
+            largestSymbol = symbol;
+        }
+    }
+
+    // Rounding leaves the table slightly off, settle the difference on the most common symbols
+    while (sum < RansScale) {
+        freqs[largestSymbol]++;
+        sum++;
+    }
+    while (sum > RansScale) {
+        uint32_t symbol = static_cast<uint32_t>(
+              std::max_element(freqs.begin(), freqs.end()) - freqs.begin());
+        freqs[symbol]--;
+        sum--;
+    }
+}
+
+void RansCompress(const std::vector<uint8_t> &raw, std::vector<uint8_t> &payload)
+{
+    std::array<uint32_t, 256> counts = {};
+    for (uint8_t symbol : raw) {
+        counts[symbol]++;
+    }
+
+    std::array<uint32_t, 256> freqs = {};
+    NormalizeFrequencies(counts, static_cast<uint32_t>(raw.size()), freqs);
+
+    std::array<uint32_t, 256> starts = {};
+    uint32_t numSymbols = 0;
+    for (uint32_t symbol = 0, start = 0; symbol < 256; symbol++) {
+        starts[symbol] = start;
+        start += freqs[symbol];
+        numSymbols += (freqs[symbol] > 0) ? 1 : 0;
+    }
+
+    WriteVarint(numSymbols, payload);
+    for (uint32_t symbol = 0; symbol < 256; symbol++) {
+        if (freqs[symbol] > 0) {
+            payload.push_back(static_cast<uint8_t>(symbol));
+            WriteVarint(freqs[symbol], payload);
+        }
+    }
+
+    // rANS encodes back to front; a symbol never costs more than two bytes
+    std::vector<uint8_t> buffer(raw.size() * 2 + 8);
+    uint8_t *pEnd = buffer.data() + buffer.size();
+    uint8_t *pCursor = pEnd;
+    uint32_t state = RansLowerBound;
+    for (size_t idx = raw.size(); idx-- > 0;) {
+        const uint32_t freq = freqs[raw[idx]];
+        const uint32_t stateMax = ((RansLowerBound >> RansScaleBits) << 8) * freq;
+        while (state >= stateMax) {
+            *--pCursor = static_cast<uint8_t>(state & 0xFF);
+            state >>= 8;
+        }
+        state = ((state / freq) << RansScaleBits) + (state % freq) + starts[raw[idx]];
+    }
+    pCursor -= 4;
+    WriteU32(state, pCursor);
+
+    payload.insert(payload.end(), pCursor, pEnd);
+}
+
+bool RansDecompress(
+      const uint8_t *pData, const uint8_t *pDataEnd, size_t rawLength, std::vector<uint8_t> &raw)
+{
+    uint64_t numSymbols = 0;
+    if (!ReadVarint(pData, pDataEnd, numSymbols) || (numSymbols > 256)) {
+        return false;
+    }
+    std::array<uint32_t, 256> freqs = {};
+    for (uint32_t symbolIdx = 0; symbolIdx < numSymbols; symbolIdx++) {
+        if (pData >= pDataEnd) {
+            return false;
+        }
+        const uint8_t symbol = *pData++;
+        uint64_t freq = 0;
+        if (!ReadVarint(pData, pDataEnd, freq) || (freq > RansScale)) {
+            return false;
+        }
+        freqs[symbol] = static_cast<uint32_t>(freq);
+    }
+
+    std::array<uint32_t, 256> starts = {};
+    std::vector<uint8_t> slotToSymbol(RansScale);
+    uint32_t start = 0;
+    for (uint32_t symbol = 0; symbol < 256; symbol++) {
+        starts[symbol] = start;
+        if (start + freqs[symbol] > RansScale) {
+            return false;
+        }
+        std::fill_n(slotToSymbol.begin() + start, freqs[symbol], static_cast<uint8_t>(symbol));
+        start += freqs[symbol];
+    }
+    if ((start != RansScale) || (pDataEnd - pData) < 4) {
+        return false;
+    }
+
+    uint32_t state = ReadU32(pData);
+    pData += 4;
+
+    raw.resize(rawLength);
+    for (size_t idx = 0; idx < rawLength; idx++) {
+        const uint32_t slot = state & (RansScale - 1);
+        const uint8_t symbol = slotToSymbol[slot];
+        raw[idx] = symbol;
+        state = freqs[symbol] * (state >> RansScaleBits) + slot - starts[symbol];
+        while ((state < RansLowerBound) && (pData < pDataEnd)) {
+            state = (state << 8) | *pData++;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+void EncodeTile(const T *pValues, const GridCodec::Header &header, uint32_t tileIdx,
+      std::vector<uint8_t> &payload)
+{
+    const uint32_t tileX = tileIdx % header.m_tilesX;
+    const uint32_t tileY = tileIdx / header.m_tilesX;
+    const uint32_t originX = tileX * header.m_tileSize;
+    const uint32_t originY = tileY * header.m_tileSize;
+    const uint32_t tileWidth = std::min(header.m_tileSize, header.m_width - originX);
+    const uint32_t tileHeight = std::min(header.m_tileSize, header.m_height - originY);
+
+    std::vector<int64_t> previousRow(tileWidth);
+    std::vector<int64_t> row(tileWidth);
+    std::vector<uint8_t> residuals;
+    residuals.reserve(size_t(tileWidth) * tileHeight * 2);
+
+    for (uint32_t y = 0; y < tileHeight; y++) {
+        const T *pSourceRow = pValues + size_t(originY + y) * header.m_width + originX;
+        for (uint32_t x = 0; x < tileWidth; x++) {
+            row[x] = ToCodecValue(pSourceRow[x]);
+            const int64_t prediction = Predict(row.data(), previousRow.data(), x, y);
+            WriteVarint(ZigZagEncode64(row[x] - prediction), residuals);
+        }
+        std::swap(row, previousRow);
+    }
+
+    std::vector<uint8_t> compressed;
+    RansCompress(residuals, compressed);
+
+    WriteVarint(residuals.size(), payload);
+    if (compressed.size() < residuals.size()) {
+        payload.push_back(TileModeRans);
+        payload.insert(payload.end(), compressed.begin(), compressed.end());
+    } else {
+        payload.push_back(TileModeStored);
+        payload.insert(payload.end(), residuals.begin(), residuals.end());
+    }
+}
+
+// Decodes a tile into pValues, which has rowPitch values per row
+template<typename T>
+bool DecodeTileInto(const std::vector<uint8_t> &encoded, const GridCodec::Header &header,
+      uint32_t tileIdx, T *pValues, size_t rowPitch)
+{
+    const size_t tileCount = size_t(header.m_tilesX) * header.m_tilesY;
+    const uint8_t *pOffsets = encoded.data() + HeaderBytes;
+    const uint8_t *pPayloads = pOffsets + (tileCount + 1) * 4;
+    const uint8_t *pData = pPayloads + ReadU32(pOffsets + size_t(tileIdx) * 4);
+    const uint8_t *pDataEnd = pPayloads + ReadU32(pOffsets + size_t(tileIdx + 1) * 4);
+    if ((pDataEnd > encoded.data() + encoded.size()) || (pData >= pDataEnd)) {
+        return false;
+    }
+
+    const uint32_t tileX = tileIdx % header.m_tilesX;
+    const uint32_t tileY = tileIdx / header.m_tilesX;
+    const uint32_t tileWidth = std::min(header.m_tileSize, header.m_width - tileX * header.m_tileSize);
+    const uint32_t tileHeight
+          = std::min(header.m_tileSize, header.m_height - tileY * header.m_tileSize);
+
+    // Every residual is a varint of at most MaxVarintBytes, which bounds the stream length
+    uint64_t rawLength = 0;
+    if (!ReadVarint(pData, pDataEnd, rawLength)
+          || (rawLength > uint64_t(tileWidth) * tileHeight * MaxVarintBytes)
+          || (pData >= pDataEnd)) {
+        return false;
+    }
+    const uint8_t mode = *pData++;
+
+    std::vector<uint8_t> residuals;
+    if (mode == TileModeRans) {
+        if (!RansDecompress(pData, pDataEnd, rawLength, residuals)) {
+            return false;
+        }
+    } else {
+        residuals.assign(pData, pDataEnd);
+    }
+
+    std::vector<int64_t> previousRow(tileWidth);
+    std::vector<int64_t> row(tileWidth);
+    const uint8_t *pResidual = residuals.data();
+    const uint8_t *pResidualEnd = residuals.data() + residuals.size();
+    for (uint32_t y = 0; y < tileHeight; y++) {
+        for (uint32_t x = 0; x < tileWidth; x++) {
+            uint64_t residual = 0;
+            if (!ReadVarint(pResidual, pResidualEnd, residual)) {
+                return false;
+            }
+            const int64_t prediction = Predict(row.data(), previousRow.data(), x, y);
+            row[x] = prediction + ZigZagDecode64(residual);
+            FromCodecValue(row[x], pValues[size_t(y) * rowPitch + x]);
+        }
+        std::swap(row, previousRow);
+    }
+    return true;
+}
+
+template<typename T>
+std::vector<uint8_t> EncodeGrid(const T *pValues, uint32_t width, uint32_t height,
+      uint32_t tileSize, uint32_t numThreads, bool isFloat)
+{
+    assert(tileSize > 0 && width > 0 && height > 0);
+
+    GridCodec::Header header;
+    header.m_width = width;
+    header.m_height = height;
+    header.m_tileSize = tileSize;
+    header.m_tilesX = (width + tileSize - 1) / tileSize;
+    header.m_tilesY = (height + tileSize - 1) / tileSize;
+    header.m_isFloat = isFloat;
+
+    const uint32_t tileCount = header.m_tilesX * header.m_tilesY;
+    std::vector<std::vector<uint8_t>> tilePayloads(tileCount);
+    ParallelFor(tileCount, numThreads, [&](uint32_t tileIdx) {
+        EncodeTile(pValues, header, tileIdx, tilePayloads[tileIdx]);
+    });
+
+    size_t payloadBytes = 0;
+    for (const auto &tilePayload : tilePayloads) {
+        payloadBytes += tilePayload.size();
+    }
+
+    std::vector<uint8_t> encoded(HeaderBytes + (size_t(tileCount) + 1) * 4);
+    encoded.reserve(encoded.size() + payloadBytes);
+    WriteU32(CodecMagic, &encoded[0]);
+    encoded[4] = isFloat ? 1 : 0;
+    WriteU32(width, &encoded[5]);
+    WriteU32(height, &encoded[9]);
+    WriteU32(tileSize, &encoded[13]);
+
+    uint32_t offset = 0;
+    for (uint32_t tileIdx = 0; tileIdx < tileCount; tileIdx++) {
+        WriteU32(offset, &encoded[HeaderBytes + size_t(tileIdx) * 4]);
+        offset += static_cast<uint32_t>(tilePayloads[tileIdx].size());
+        encoded.insert(encoded.end(), tilePayloads[tileIdx].begin(), tilePayloads[tileIdx].end());
+    }
+    WriteU32(offset, &encoded[HeaderBytes + size_t(tileCount) * 4]);
+
+    return encoded;
+}
+
+template<typename T>
+bool DecodeGrid(
+      const std::vector<uint8_t> &encoded, std::vector<T> &values, uint32_t numThreads, bool isFloat)
+{
+    GridCodec::Header header;
+    if (!GridCodec::ReadHeader(encoded, header) || (header.m_isFloat != isFloat)) {
+        return false;
+    }
+
+    values.resize(size_t(header.m_width) * header.m_height);
+
+    const uint32_t tileCount = header.m_tilesX * header.m_tilesY;
+    std::atomic<bool> succeeded = true;
+    ParallelFor(tileCount, numThreads, [&](uint32_t tileIdx) {
+        const uint32_t originX = (tileIdx % header.m_tilesX) * header.m_tileSize;
+        const uint32_t originY = (tileIdx / header.m_tilesX) * header.m_tileSize;
+        T *pTileOrigin = values.data() + size_t(originY) * header.m_width + originX;
+        if (!DecodeTileInto(encoded, header, tileIdx, pTileOrigin, header.m_width)) {
+            succeeded = false;
+        }
+    });
+    return succeeded;
+}
+
+template<typename T>
+bool DecodeSingleTile(const std::vector<uint8_t> &encoded, uint32_t tileIdx,
+      std::vector<T> &tileValues, bool isFloat)
+{
+    GridCodec::Header header;
+    if (!GridCodec::ReadHeader(encoded, header) || (header.m_isFloat != isFloat)
+          || (tileIdx >= header.m_tilesX * header.m_tilesY)) {
+        return false;
+    }
+
+    tileValues.assign(size_t(header.m_tileSize) * header.m_tileSize, T(0));
+    return DecodeTileInto(encoded, header, tileIdx, tileValues.data(), header.m_tileSize);
+}
+
+}
+
+std::vector<uint8_t> GridCodec::Encode(const int32_t *pValues, uint32_t width, uint32_t height,
+      uint32_t tileSize, uint32_t numThreads)
+{
+    return EncodeGrid(pValues, width, height, tileSize, numThreads, false);
+}
+
+std::vector<uint8_t> GridCodec::Encode(const float *pValues, uint32_t width, uint32_t height,
+      uint32_t tileSize, uint32_t numThreads)
+{
+    return EncodeGrid(pValues, width, height, tileSize, numThreads, true);
+}
+
+bool GridCodec::ReadHeader(const std::vector<uint8_t> &encoded, Header &header)
+{
+    if ((encoded.size() < HeaderBytes) || (ReadU32(&encoded[0]) != CodecMagic)) {
+        return false;
+    }
+
+    header.m_isFloat = (encoded[4] != 0);
+    header.m_width = ReadU32(&encoded[5]);
+    header.m_height = ReadU32(&encoded[9]);
+    header.m_tileSize = ReadU32(&encoded[13]);
+    if ((header.m_width == 0) || (header.m_height == 0) || (header.m_tileSize == 0)) {
+        return false;
+    }
+
+    header.m_tilesX = (header.m_width + header.m_tileSize - 1) / header.m_tileSize;
+    header.m_tilesY = (header.m_height + header.m_tileSize - 1) / header.m_tileSize;
+
+    const size_t tileCount = size_t(header.m_tilesX) * header.m_tilesY;
+    return encoded.size() >= HeaderBytes + (tileCount + 1) * 4;
+}
+
+bool GridCodec::Decode(
+      const std::vector<uint8_t> &encoded, std::vector<int32_t> &values, uint32_t numThreads)
+{
+    return DecodeGrid(encoded, values, numThreads, false);
+}
+
+bool GridCodec::Decode(
+      const std::vector<uint8_t> &encoded, std::vector<float> &values, uint32_t numThreads)
+{
+    return DecodeGrid(encoded, values, numThreads, true);
+}
+
+bool GridCodec::DecodeTile(
+      const std::vector<uint8_t> &encoded, uint32_t tileIdx, std::vector<int32_t> &tileValues)
+{
+    return DecodeSingleTile(encoded, tileIdx, tileValues, false);
+}
+
+bool GridCodec::DecodeTile(
+      const std::vector<uint8_t> &encoded, uint32_t tileIdx, std::vector<float> &tileValues)
+{
+    return DecodeSingleTile(encoded, tileIdx, tileValues, true);
+}
+
+}
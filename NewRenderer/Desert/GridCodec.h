@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// Lossless codec for 2D block count grids and float heightmaps.
+//
+// The grid is split into square tiles that are encoded independently, so tiles can be encoded,
+// decoded, or streamed on their own and in parallel. Each cell is predicted from its left, top
+// and top left neighbours with the MED predictor (LOCO-I), and the residuals are zigzag varint
+// coded and then entropy coded with a static order 0 rANS coder. Floats are mapped to
+// order preserving integers first so the same predictor applies to heightmaps.
+class GridCodec {
+   public:
+    static constexpr uint32_t DefaultTileSize = 128;
+
+    struct Header {
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_tileSize = 0;
+        uint32_t m_tilesX = 0;
+        uint32_t m_tilesY = 0;
+        bool m_isFloat = false;
+    };
+
+   public:
+    // numThreads == 0 uses every hardware thread
+    static std::vector<uint8_t> Encode(const int32_t *pValues, uint32_t width, uint32_t height,
+          uint32_t tileSize = DefaultTileSize, uint32_t numThreads = 0);
+    static std::vector<uint8_t> Encode(const float *pValues, uint32_t width, uint32_t height,
+          uint32_t tileSize = DefaultTileSize, uint32_t numThreads = 0);
+
+    static bool ReadHeader(const std::vector<uint8_t> &encoded, Header &header);
+
+    // Decodes into a row major array of header.m_width * header.m_height values
+    static bool Decode(
+          const std::vector<uint8_t> &encoded, std::vector<int32_t> &values, uint32_t numThreads = 0);
+    static bool Decode(
+          const std::vector<uint8_t> &encoded, std::vector<float> &values, uint32_t numThreads = 0);
+
+    // Decodes a single tile into a tileSize * tileSize array. Cells outside the grid are zero.
+    static bool DecodeTile(const std::vector<uint8_t> &encoded, uint32_t tileIdx,
+          std::vector<int32_t> &tileValues);
+    static bool DecodeTile(
+          const std::vector<uint8_t> &encoded, uint32_t tileIdx, std::vector<float> &tileValues);
+};
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "TiledGrid.h"
+
+#include "../../Core/Memory/LargeBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// Square grid surrounded by a ring of ghost cells holding copies of the cells on the opposite
+// edge, so the grid wraps like a torus. After RefreshHalo() any neighbour within haloWidth of
+// an interior cell is a plain offset from it: +-1 along x and +-GetStride() along y. Stencils
+// can then walk rows with unit stride and no modulo arithmetic.
+//
+// Grids of a few MB and up are stored in huge pages, and bands of rows can be moved to the NUMA
+// node of the threads that process them.
+template<typename T>
+class HaloGrid {
+   public:
+    HaloGrid(const uint32_t resolution, const uint32_t haloWidth, const T &defaultValue = T())
+        : m_resolution(resolution)
+        , m_haloWidth(haloWidth)
+        , m_stride(resolution + 2 * haloWidth)
+        , m_values(size_t(m_stride) * m_stride, defaultValue)
+    {
+        assert(haloWidth <= resolution && "Halo cannot be wider than the grid it wraps");
+    }
+
+    uint32_t GetResolution() const { return m_resolution; }
+    uint32_t GetHaloWidth() const { return m_haloWidth; }
+
+    // Distance in elements between vertically adjacent cells
+    uint32_t GetStride() const { return m_stride; }
+
+    // Pointer to cell (0, y); valid from x = -haloWidth to resolution + haloWidth - 1
+    const T *GetRow(const int32_t y) const { return &m_values[Offset(0, y)]; }
+    T *AccessRow(const int32_t y) { return &m_values[Offset(0, y)]; }
+
+    // Coordinates may reach haloWidth cells outside the grid
+    const T &Get(const int32_t x, const int32_t y) const { return m_values[Offset(x, y)]; }
+    T &Access(const int32_t x, const int32_t y) { return m_values[Offset(x, y)]; }
+
+    // Copies the wrapped border cells into the halo. Call once after each pass that writes the
+    // interior and before any stencil reads across the edge.
+    void RefreshHalo()
+    {
+        if (m_haloWidth == 0) {
+            return;
+        }
+
+        const int32_t resolution = static_cast<int32_t>(m_resolution);
+        const int32_t halo = static_cast<int32_t>(m_haloWidth);
+
+        // Left and right halo of every interior row
+        for (int32_t y = 0; y < resolution; y++) {
+            T *pRow = AccessRow(y);
+            std::copy(pRow + resolution - halo, pRow + resolution, pRow - halo);
+            std::copy(pRow, pRow + halo, pRow + resolution);
+        }
+
+        // Full padded rows above and below, which also fills the corners
+        for (int32_t y = 0; y < halo; y++) {
+            std::copy(AccessRow(resolution - halo + y) - halo,
+                  AccessRow(resolution - halo + y) + resolution + halo, AccessRow(y - halo) - halo);
+            std::copy(AccessRow(y) - halo, AccessRow(y) + resolution + halo,
+                  AccessRow(resolution + y) - halo);
+        }
+    }
+
+    // Loads the interior from a row major array and refreshes the halo
+    void CopyFrom(const std::vector<T> &values)
+    {
+        assert(values.size() == size_t(m_resolution) * m_resolution);
+        for (uint32_t y = 0; y < m_resolution; y++) {
+            const auto rowStart = values.begin() + size_t(y) * m_resolution;
+            std::copy(rowStart, rowStart + m_resolution, AccessRow(y));
+        }
+        RefreshHalo();
+    }
+
+    void CopyFrom(const TiledGrid<T> &grid)
+    {
+        assert(grid.GetResolution() == m_resolution);
+        const uint32_t tileSize = grid.GetTileSize();
+        for (uint32_t tileY = 0; tileY < grid.GetTilesPerSide(); tileY++) {
+            for (uint32_t tileX = 0; tileX < grid.GetTilesPerSide(); tileX++) {
+                const T *pTile = grid.GetTileData(grid.TileIndex(tileX, tileY));
+                for (uint32_t localY = 0; localY < tileSize; localY++) {
+                    const T *pSource = pTile + size_t(localY) * tileSize;
+                    std::copy(pSource, pSource + tileSize,
+                          AccessRow(tileY * tileSize + localY) + tileX * tileSize);
+                }
+            }
+        }
+        RefreshHalo();
+    }
+
+    // Writes the interior back, leaving tiles whose contents did not change shared
+    void CopyTo(TiledGrid<T> &grid) const
+    {
+        assert(grid.GetResolution() == m_resolution);
+        const uint32_t tileSize = grid.GetTileSize();
+        for (uint32_t tileY = 0; tileY < grid.GetTilesPerSide(); tileY++) {
+            for (uint32_t tileX = 0; tileX < grid.GetTilesPerSide(); tileX++) {
+                const uint32_t tileIdx = grid.TileIndex(tileX, tileY);
+                if (TileMatches(grid.GetTileData(tileIdx), tileX, tileY, tileSize)) {
+                    continue;
+                }
+
+                T *pTile = grid.AccessTileData(tileIdx);
+                for (uint32_t localY = 0; localY < tileSize; localY++) {
+                    const T *pSource = GetRow(tileY * tileSize + localY) + tileX * tileSize;
+                    std::copy(pSource, pSource + tileSize, pTile + size_t(localY) * tileSize);
+                }
+            }
+        }
+    }
+
+    void CopyTo(std::vector<T> &values) const
+    {
+        values.resize(size_t(m_resolution) * m_resolution);
+        for (uint32_t y = 0; y < m_resolution; y++) {
+            const T *pRow = GetRow(y);
+            std::copy(pRow, pRow + m_resolution, values.begin() + size_t(y) * m_resolution);
+        }
+    }
+
+    // Moves rows [y0, y1) to a NUMA node. Rows may reach into the halo. Pages straddling y0 go to
+    // the band before it.
+    bool BindRowsToNumaNode(const int32_t y0, const int32_t y1, const uint32_t node)
+    {
+        const int32_t halo = static_cast<int32_t>(m_haloWidth);
+        assert(y0 >= -halo && y0 <= y1 && y1 <= static_cast<int32_t>(m_resolution) + halo);
+        const size_t first = size_t(y0 + halo) * m_stride;
+        const size_t last = size_t(y1 + halo) * m_stride;
+        return BindToNumaNode(m_values.data() + first, (last - first) * sizeof(T), node,
+              GetLargeBufferPageSize(m_values.size() * sizeof(T)));
+    }
+
+    LargeBufferPlacement GetPlacement() const
+    {
+        return QueryLargeBufferPlacement(m_values.data(), m_values.size() * sizeof(T));
+    }
+
+   private:
+    size_t Offset(const int32_t x, const int32_t y) const
+    {
+        const int32_t halo = static_cast<int32_t>(m_haloWidth);
+        assert(x >= -halo && x < static_cast<int32_t>(m_resolution) + halo);
+        assert(y >= -halo && y < static_cast<int32_t>(m_resolution) + halo);
+        return size_t(y + halo) * m_stride + size_t(x + halo);
+    }
+
+    bool TileMatches(
+          const T *pTile, const uint32_t tileX, const uint32_t tileY, const uint32_t tileSize) const
+    {
+        for (uint32_t localY = 0; localY < tileSize; localY++) {
+            const T *pRow = GetRow(tileY * tileSize + localY) + tileX * tileSize;
+            if (!std::equal(pRow, pRow + tileSize, pTile + size_t(localY) * tileSize)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+   private:
+    uint32_t m_resolution = 0;
+    uint32_t m_haloWidth = 0;
+    uint32_t m_stride = 0;
+    std::vector<T, LargeBufferAllocator<T>> m_values;
+};
+
+}
@@ -0,0 +1,331 @@
+#include "HeightfieldIndex.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace Farlor {
+
+HeightfieldIndex::HeightfieldIndex(uint32_t numThreads)
+    : m_numThreads(numThreads)
+{
+}
+
+uint32_t HeightfieldIndex::Update(const TiledGrid<int32_t> &heights)
+{
+    const bool rebuild = (heights.GetResolution() != m_resolution)
+          || (heights.GetTileSize() != m_tileSize) || (m_resolution == 0);
+    if (rebuild) {
+        m_resolution = heights.GetResolution();
+        m_tileSize = heights.GetTileSize();
+        m_tilesPerSide = heights.GetTilesPerSide();
+
+        const size_t tileCells = size_t(m_tileSize) * m_tileSize;
+        m_tileSums.assign(tileCells * heights.GetTileCount(), 0);
+        m_tilePrefix.assign(size_t(m_tilesPerSide + 1) * (m_tilesPerSide + 1), 0);
+        m_columnStrips.assign(size_t(m_tilesPerSide + 1) * m_resolution, 0);
+        m_rowStrips.assign(size_t(m_tilesPerSide + 1) * m_resolution, 0);
+
+        m_levelSizes.clear();
+        m_minLevels.clear();
+        m_maxLevels.clear();
+        for (uint32_t size = m_resolution; size > 1;) {
+            size = (size + 1) / 2;
+            m_levelSizes.push_back(size);
+            m_minLevels.emplace_back(size_t(size) * size);
+            m_maxLevels.emplace_back(size_t(size) * size);
+        }
+    }
+
+    std::vector<uint32_t> dirtyTiles;
+    for (uint32_t tileIdx = 0; tileIdx < heights.GetTileCount(); tileIdx++) {
+        if (rebuild || !heights.SharesTile(m_heights, tileIdx)) {
+            dirtyTiles.push_back(tileIdx);
+        }
+    }
+    m_heights = heights.Fork();
+    if (dirtyTiles.empty()) {
+        return 0;
+    }
+
+    ParallelFor(uint32_t(dirtyTiles.size()), m_numThreads, [&](const uint32_t idx) {
+        IndexTile(dirtyTiles[idx] % m_tilesPerSide, dirtyTiles[idx] / m_tilesPerSide);
+    });
+
+    // Strips accumulate downwards and rightwards, so only the part past the first dirty tile
+    // of each tile column and row changes
+    std::vector<uint32_t> firstDirtyY(m_tilesPerSide, m_tilesPerSide);
+    std::vector<uint32_t> firstDirtyX(m_tilesPerSide, m_tilesPerSide);
+    for (const uint32_t tileIdx : dirtyTiles) {
+        const uint32_t tileX = tileIdx % m_tilesPerSide;
+        const uint32_t tileY = tileIdx / m_tilesPerSide;
+        firstDirtyY[tileX] = std::min(firstDirtyY[tileX], tileY);
+        firstDirtyX[tileY] = std::min(firstDirtyX[tileY], tileX);
+    }
+    ParallelFor(m_tilesPerSide, m_numThreads, [&](const uint32_t idx) {
+        if (firstDirtyY[idx] < m_tilesPerSide) {
+            RebuildColumnStrip(idx, firstDirtyY[idx]);
+        }
+        if (firstDirtyX[idx] < m_tilesPerSide) {
+            RebuildRowStrip(idx, firstDirtyX[idx]);
+        }
+    });
+    RebuildTilePrefix();
+
+    if (rebuild) {
+        RebuildPyramid(0, 0, m_resolution, m_resolution);
+    }
+    else {
+        for (const uint32_t tileIdx : dirtyTiles) {
+            const uint32_t x0 = (tileIdx % m_tilesPerSide) * m_tileSize;
+            const uint32_t y0 = (tileIdx / m_tilesPerSide) * m_tileSize;
+            RebuildPyramid(x0, y0, x0 + m_tileSize, y0 + m_tileSize);
+        }
+    }
+
+    return uint32_t(dirtyTiles.size());
+}
+
+int64_t HeightfieldIndex::Sum(
+      const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1) const
+{
+    assert(x0 <= x1 && y0 <= y1 && x1 <= m_resolution && y1 <= m_resolution);
+    return PrefixSum(x1, y1) - PrefixSum(x0, y1) - PrefixSum(x1, y0) + PrefixSum(x0, y0);
+}
+
+double HeightfieldIndex::Mean(
+      const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1) const
+{
+    const uint64_t area = uint64_t(x1 - x0) * (y1 - y0);
+    return (area > 0) ? double(Sum(x0, y0, x1, y1)) / double(area) : 0.0;
+}
+
+int32_t HeightfieldIndex::Min(
+      const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1) const
+{
+    return Extreme<false>(x0, y0, x1, y1);
+}
+
+int32_t HeightfieldIndex::Max(
+      const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1) const
+{
+    return Extreme<true>(x0, y0, x1, y1);
+}
+
+int64_t HeightfieldIndex::PrefixSum(const uint32_t x, const uint32_t y) const
+{
+    const uint32_t tileX = x / m_tileSize;
+    const uint32_t tileY = y / m_tileSize;
+    const uint32_t localX = x % m_tileSize;
+    const uint32_t localY = y % m_tileSize;
+
+    // Whole tiles above and left, then the partial column and row strips, then the corner
+    // inside the tile itself
+    int64_t sum = m_tilePrefix[size_t(tileY) * (m_tilesPerSide + 1) + tileX];
+    if (localX > 0) {
+        sum += m_columnStrips[size_t(tileY) * m_resolution + x - 1];
+    }
+    if (localY > 0) {
+        sum += m_rowStrips[size_t(tileX) * m_resolution + y - 1];
+    }
+    if (localX > 0 && localY > 0) {
+        const size_t tileCells = size_t(m_tileSize) * m_tileSize;
+        const size_t tileIdx = size_t(tileY) * m_tilesPerSide + tileX;
+        sum += m_tileSums[tileIdx * tileCells + size_t(localY - 1) * m_tileSize + localX - 1];
+    }
+    return sum;
+}
+
+void HeightfieldIndex::IndexTile(const uint32_t tileX, const uint32_t tileY)
+{
+    const uint32_t tileIdx = m_heights.TileIndex(tileX, tileY);
+    const int32_t *pHeights = m_heights.GetTileData(tileIdx);
+    int64_t *pSums = &m_tileSums[size_t(tileIdx) * m_tileSize * m_tileSize];
+
+    for (uint32_t localY = 0; localY < m_tileSize; localY++) {
+        const int32_t *pRow = pHeights + size_t(localY) * m_tileSize;
+        int64_t *pSumRow = pSums + size_t(localY) * m_tileSize;
+        const int64_t *pAbove = (localY > 0) ? pSumRow - m_tileSize : nullptr;
+
+        int64_t rowSum = 0;
+        for (uint32_t localX = 0; localX < m_tileSize; localX++) {
+            rowSum += pRow[localX];
+            pSumRow[localX] = rowSum + (pAbove ? pAbove[localX] : 0);
+        }
+    }
+}
+
+void HeightfieldIndex::RebuildColumnStrip(const uint32_t tileX, const uint32_t firstTileY)
+{
+    const size_t tileCells = size_t(m_tileSize) * m_tileSize;
+    const uint32_t x0 = tileX * m_tileSize;
+    for (uint32_t tileY = firstTileY; tileY < m_tilesPerSide; tileY++) {
+        // Bottom row of the tile's table holds its column sums
+        const int64_t *pTileColumns = &m_tileSums[m_heights.TileIndex(tileX, tileY) * tileCells
+              + size_t(m_tileSize - 1) * m_tileSize];
+        const int64_t *pAbove = &m_columnStrips[size_t(tileY) * m_resolution + x0];
+        int64_t *pStrip = &m_columnStrips[size_t(tileY + 1) * m_resolution + x0];
+        for (uint32_t localX = 0; localX < m_tileSize; localX++) {
+            pStrip[localX] = pAbove[localX] + pTileColumns[localX];
+        }
+    }
+}
+
+void HeightfieldIndex::RebuildRowStrip(const uint32_t tileY, const uint32_t firstTileX)
+{
+    const size_t tileCells = size_t(m_tileSize) * m_tileSize;
+    const uint32_t y0 = tileY * m_tileSize;
+    for (uint32_t tileX = firstTileX; tileX < m_tilesPerSide; tileX++) {
+        // Right column of the tile's table holds its row sums
+        const int64_t *pTileSums = &m_tileSums[m_heights.TileIndex(tileX, tileY) * tileCells];
+        const int64_t *pLeft = &m_rowStrips[size_t(tileX) * m_resolution + y0];
+        int64_t *pStrip = &m_rowStrips[size_t(tileX + 1) * m_resolution + y0];
+        for (uint32_t localY = 0; localY < m_tileSize; localY++) {
+            pStrip[localY]
+                  = pLeft[localY] + pTileSums[size_t(localY) * m_tileSize + m_tileSize - 1];
+        }
+    }
+}
+
+void HeightfieldIndex::RebuildTilePrefix()
+{
+    const size_t tileCells = size_t(m_tileSize) * m_tileSize;
+    const size_t stride = m_tilesPerSide + 1;
+    for (uint32_t tileY = 0; tileY < m_tilesPerSide; tileY++) {
+        for (uint32_t tileX = 0; tileX < m_tilesPerSide; tileX++) {
+            const int64_t tileTotal
+                  = m_tileSums[(m_heights.TileIndex(tileX, tileY) + 1) * tileCells - 1];
+            const int64_t above = m_tilePrefix[tileY * stride + tileX + 1];
+            const int64_t left = m_tilePrefix[(tileY + 1) * stride + tileX];
+            const int64_t aboveLeft = m_tilePrefix[tileY * stride + tileX];
+            m_tilePrefix[(tileY + 1) * stride + tileX + 1] = tileTotal + above + left - aboveLeft;
+        }
+    }
+}
+
+void HeightfieldIndex::RebuildPyramid(
+      const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1)
+{
+    if (m_levelSizes.empty()) {
+        return;
+    }
+
+    // The first level reads the heights a tile row segment at a time
+    const uint32_t firstSize = m_levelSizes[0];
+    const uint32_t childX0 = x0 & ~1u;
+    const uint32_t childX1 = std::min(((x1 + 1) & ~1u), m_resolution);
+    for (uint32_t blockY = y0 >> 1; blockY <= (y1 - 1) >> 1; blockY++) {
+        int32_t *pMin = &m_minLevels[0][size_t(blockY) * firstSize];
+        int32_t *pMax = &m_maxLevels[0][size_t(blockY) * firstSize];
+        std::fill(pMin + (childX0 >> 1), pMin + ((childX1 + 1) >> 1),
+              std::numeric_limits<int32_t>::max());
+        std::fill(pMax + (childX0 >> 1), pMax + ((childX1 + 1) >> 1),
+              std::numeric_limits<int32_t>::min());
+
+        for (uint32_t y = 2 * blockY; y < std::min(2 * blockY + 2, m_resolution); y++) {
+            const uint32_t tileY = y / m_tileSize;
+            const uint32_t localY = y % m_tileSize;
+            for (uint32_t x = childX0; x < childX1;) {
+                const uint32_t tileX = x / m_tileSize;
+                const uint32_t tileEnd = std::min((tileX + 1) * m_tileSize, childX1);
+                const int32_t *pRow = m_heights.GetTileData(m_heights.TileIndex(tileX, tileY))
+                      + size_t(localY) * m_tileSize - size_t(tileX) * m_tileSize;
+                for (; x < tileEnd; x++) {
+                    pMin[x >> 1] = std::min(pMin[x >> 1], pRow[x]);
+                    pMax[x >> 1] = std::max(pMax[x >> 1], pRow[x]);
+                }
+            }
+        }
+    }
+
+    for (uint32_t level = 1; level < m_levelSizes.size(); level++) {
+        const uint32_t size = m_levelSizes[level];
+        const uint32_t childSize = m_levelSizes[level - 1];
+        const uint32_t shift = level + 1;
+
+        for (uint32_t blockY = y0 >> shift; blockY <= (y1 - 1) >> shift; blockY++) {
+            for (uint32_t blockX = x0 >> shift; blockX <= (x1 - 1) >> shift; blockX++) {
+                int32_t minValue = std::numeric_limits<int32_t>::max();
+                int32_t maxValue = std::numeric_limits<int32_t>::min();
+                for (uint32_t childY = 2 * blockY; childY < std::min(2 * blockY + 2, childSize);
+                      childY++) {
+                    for (uint32_t childX = 2 * blockX;
+                          childX < std::min(2 * blockX + 2, childSize); childX++) {
+                        const size_t childIdx = size_t(childY) * childSize + childX;
+                        minValue = std::min(minValue, m_minLevels[level - 1][childIdx]);
+                        maxValue = std::max(maxValue, m_maxLevels[level - 1][childIdx]);
+                    }
+                }
+                m_minLevels[level][size_t(blockY) * size + blockX] = minValue;
+                m_maxLevels[level][size_t(blockY) * size + blockX] = maxValue;
+            }
+        }
+    }
+}
+
+template<bool IsMax>
+int32_t HeightfieldIndex::Extreme(
+      const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1) const
+{
+    assert(x0 < x1 && y0 < y1 && x1 <= m_resolution && y1 <= m_resolution);
+
+    struct Node {
+        uint32_t m_level;
+        uint32_t m_x;
+        uint32_t m_y;
+    };
+
+    // Depth first from the single top block. Blocks inside the rectangle answer for their
+    // whole subtree, and blocks that cannot beat the best value so far are skipped.
+    int32_t best = IsMax ? std::numeric_limits<int32_t>::min()
+                         : std::numeric_limits<int32_t>::max();
+    std::vector<Node> stack;
+    stack.push_back({ uint32_t(m_levelSizes.size()), 0, 0 });
+    while (!stack.empty()) {
+        const Node node = stack.back();
+        stack.pop_back();
+
+        const uint32_t nodeX0 = node.m_x << node.m_level;
+        const uint32_t nodeY0 = node.m_y << node.m_level;
+        const uint32_t nodeX1 = std::min((node.m_x + 1) << node.m_level, m_resolution);
+        const uint32_t nodeY1 = std::min((node.m_y + 1) << node.m_level, m_resolution);
+        if (nodeX0 >= x1 || nodeY0 >= y1 || nodeX1 <= x0 || nodeY1 <= y0) {
+            continue;
+        }
+
+        int32_t value = 0;
+        if (node.m_level == 0) {
+            value = m_heights.Get(node.m_x, node.m_y);
+        }
+        else {
+            const uint32_t size = m_levelSizes[node.m_level - 1];
+            const size_t idx = size_t(node.m_y) * size + node.m_x;
+            value = IsMax ? m_maxLevels[node.m_level - 1][idx]
+                          : m_minLevels[node.m_level - 1][idx];
+        }
+        if (IsMax ? (value <= best) : (value >= best)) {
+            continue;
+        }
+
+        const bool inside = nodeX0 >= x0 && nodeY0 >= y0 && nodeX1 <= x1 && nodeY1 <= y1;
+        if (inside) {
+            best = value;
+            continue;
+        }
+
+        const uint32_t childSize
+              = (node.m_level > 1) ? m_levelSizes[node.m_level - 2] : m_resolution;
+        for (uint32_t childY = 2 * node.m_y; childY < std::min(2 * node.m_y + 2, childSize);
+              childY++) {
+            for (uint32_t childX = 2 * node.m_x; childX < std::min(2 * node.m_x + 2, childSize);
+                  childX++) {
+                stack.push_back({ node.m_level - 1, childX, childY });
+            }
+        }
+    }
+    return best;
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "TiledGrid.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// Acceleration structure over a block heightfield. A summed area table answers rectangle sums
+// and means in O(1), and a min/max pyramid answers region extremes by descending O(log n)
+// levels. Both are split along the grid's tiles, and Update() only re-indexes the tiles that no
+// longer share storage with the grid indexed last time, so the cost of keeping it current
+// scales with how much of the terrain changed.
+class HeightfieldIndex {
+   public:
+    // numThreads == 0 uses every hardware thread
+    explicit HeightfieldIndex(uint32_t numThreads = 0);
+
+    // Brings the index up to date with heights and returns the number of tiles re-indexed. A
+    // grid of a different size or tiling is indexed from scratch.
+    uint32_t Update(const TiledGrid<int32_t> &heights);
+
+    uint32_t GetResolution() const { return m_resolution; }
+
+    // Rectangles are [x0, x1) x [y0, y1) and must lie inside the grid
+    int64_t Sum(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+    double Mean(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+
+    // Rectangles must be non empty
+    int32_t Min(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+    int32_t Max(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+
+   private:
+    // Sum of [0, x) x [0, y)
+    int64_t PrefixSum(uint32_t x, uint32_t y) const;
+
+    void IndexTile(uint32_t tileX, uint32_t tileY);
+    void RebuildColumnStrip(uint32_t tileX, uint32_t firstTileY);
+    void RebuildRowStrip(uint32_t tileY, uint32_t firstTileX);
+    void RebuildTilePrefix();
+    void RebuildPyramid(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+    template<bool IsMax>
+    int32_t Extreme(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+
+   private:
+    uint32_t m_numThreads = 0;
+
+    uint32_t m_resolution = 0;
+    uint32_t m_tileSize = 0;
+    uint32_t m_tilesPerSide = 0;
+
+    // The grid last indexed, kept to find the tiles that changed since
+    TiledGrid<int32_t> m_heights = TiledGrid<int32_t>(0, 1, 0);
+
+    // Inclusive summed area table local to each tile
+    std::vector<int64_t> m_tileSums;
+
+    // Sum of all tiles above and left of each tile corner, (tilesPerSide + 1)^2 entries
+    std::vector<int64_t> m_tilePrefix;
+
+    // Per tile row ty and column x, the sum of rows [0, ty * tileSize) over the columns from
+    // the start of x's tile up to x. m_rowStrips is the same with rows and columns swapped.
+    std::vector<int64_t> m_columnStrips;
+    std::vector<int64_t> m_rowStrips;
+
+    // Level k + 1 of the pyramid covers 2^(k + 1) square blocks of cells; the cells themselves
+    // are read from m_heights
+    std::vector<uint32_t> m_levelSizes;
+    std::vector<std::vector<int32_t>> m_minLevels;
+    std::vector<std::vector<int32_t>> m_maxLevels;
+};
+
+}
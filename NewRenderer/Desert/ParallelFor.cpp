@@ -0,0 +1,106 @@
+#include "ParallelFor.h"
+
+namespace Farlor {
+
+ParallelForPool::ParallelForPool(uint32_t numThreads, const uint32_t numNodes)
+    : m_numNodes(std::max(1u, numNodes))
+{
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    m_threads.reserve(numThreads - 1);
+    for (uint32_t threadIdx = 1; threadIdx < numThreads; threadIdx++) {
+        m_threads.emplace_back(&ParallelForPool::WorkerLoop, this, threadIdx % m_numNodes);
+    }
+}
+
+ParallelForPool::~ParallelForPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeWorkers.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ParallelForPool::RunJob(
+      const std::vector<uint32_t> &nodeStarts, const JobFunc job, const void *pFunc)
+{
+    assert(nodeStarts.size() >= 2 && nodeStarts.front() == 0);
+    const uint32_t numBands = uint32_t(nodeStarts.size()) - 1;
+    const uint32_t count = nodeStarts.back();
+
+    if (m_threads.empty() || count <= 1) {
+        for (uint32_t idx = 0; idx < count; idx++) {
+            job(pFunc, idx);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pNodeStarts = &nodeStarts;
+        m_job = job;
+        m_pFunc = pFunc;
+        if (m_nextIdx.size() != numBands) {
+            m_nextIdx = std::vector<std::atomic<uint32_t>>(numBands);
+        }
+        for (uint32_t band = 0; band < numBands; band++) {
+            m_nextIdx[band] = nodeStarts[band];
+        }
+        m_numBusyWorkers = uint32_t(m_threads.size());
+        m_jobIdx++;
+    }
+    m_wakeWorkers.notify_all();
+
+    Work((m_numNodes > 1) ? GetCurrentNumaNode() : 0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobDone.wait(lock, [this]() { return m_numBusyWorkers == 0; });
+}
+
+void ParallelForPool::WorkerLoop(const uint32_t node)
+{
+    if (m_numNodes > 1) {
+        PinThreadToNumaNode(node);
+    }
+
+    uint64_t lastJobIdx = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wakeWorkers.wait(lock, [&]() { return m_stop || (m_jobIdx != lastJobIdx); });
+        if (m_stop) {
+            return;
+        }
+        lastJobIdx = m_jobIdx;
+
+        lock.unlock();
+        Work(node);
+        lock.lock();
+
+        if (--m_numBusyWorkers == 0) {
+            m_jobDone.notify_one();
+        }
+    }
+}
+
+void ParallelForPool::Work(const uint32_t homeNode)
+{
+    const std::vector<uint32_t> &nodeStarts = *m_pNodeStarts;
+    const uint32_t numBands = uint32_t(nodeStarts.size()) - 1;
+    const uint32_t homeBand = std::min(homeNode, numBands - 1);
+    for (uint32_t bandOffset = 0; bandOffset < numBands; bandOffset++) {
+        const uint32_t band = (homeBand + bandOffset) % numBands;
+        const uint32_t end = nodeStarts[band + 1];
+        for (uint32_t idx = m_nextIdx[band]++; idx < end; idx = m_nextIdx[band]++) {
+            m_job(m_pFunc, idx);
+        }
+    }
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../../Core/Memory/LargeBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Farlor {
+
+// Runs func(idx) for every idx in [0, count) across numThreads threads, handing out indices
+// dynamically. numThreads == 0 uses every hardware thread, 1 runs inline on the caller.
+template<typename Func>
+void ParallelFor(const uint32_t count, uint32_t numThreads, const Func &func)
+{
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    numThreads = std::min(numThreads, count);
+
+    if (numThreads <= 1) {
+        for (uint32_t idx = 0; idx < count; idx++) {
+            func(idx);
+        }
+        return;
+    }
+
+    std::atomic<uint32_t> nextIdx = 0;
+    auto worker = [&]() {
+        for (uint32_t idx = nextIdx++; idx < count; idx = nextIdx++) {
+            func(idx);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (uint32_t threadIdx = 1; threadIdx < numThreads; threadIdx++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// Persistent worker threads for loops over data split between NUMA nodes, so a kernel that runs
+// many short passes does not create and join threads for every one of them. Run(nodeStarts, func)
+// calls func(idx) for every idx in [0, nodeStarts.back()), where indices [nodeStarts[n],
+// nodeStarts[n + 1]) touch memory on node n. With more than one node the workers are spread over
+// the nodes and pinned there once when they start. Each works through its own node's indices
+// before helping with the others, so most accesses stay on the local node. The calling thread
+// works too, starting on the node it is running on.
+class ParallelForPool {
+   public:
+    // numThreads == 0 uses every hardware thread, counting the thread that calls Run
+    ParallelForPool(uint32_t numThreads, uint32_t numNodes);
+    ~ParallelForPool();
+
+    // Prevent copies
+    ParallelForPool(const ParallelForPool &) = delete;
+    ParallelForPool &operator=(const ParallelForPool &) = delete;
+
+    uint32_t GetNumThreads() const { return uint32_t(m_threads.size()) + 1; }
+    uint32_t GetNumNodes() const { return m_numNodes; }
+
+    // Returns once every index is done. Only one thread may call Run at a time.
+    template<typename Func>
+    void Run(const std::vector<uint32_t> &nodeStarts, const Func &func)
+    {
+        RunJob(nodeStarts, &InvokeJob<Func>, &func);
+    }
+
+   private:
+    using JobFunc = void (*)(const void *pFunc, uint32_t idx);
+
+    template<typename Func>
+    static void InvokeJob(const void *pFunc, const uint32_t idx)
+    {
+        (*static_cast<const Func *>(pFunc))(idx);
+    }
+
+    void RunJob(const std::vector<uint32_t> &nodeStarts, JobFunc job, const void *pFunc);
+    void WorkerLoop(uint32_t node);
+    void Work(uint32_t homeNode);
+
+   private:
+    uint32_t m_numNodes = 1;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeWorkers;
+    std::condition_variable m_jobDone;
+    uint64_t m_jobIdx = 0;
+    uint32_t m_numBusyWorkers = 0;
+    bool m_stop = false;
+
+    // The current job, only changed by RunJob while every worker is idle
+    const std::vector<uint32_t> *m_pNodeStarts = nullptr;
+    JobFunc m_job = nullptr;
+    const void *m_pFunc = nullptr;
+    std::vector<std::atomic<uint32_t>> m_nextIdx;
+};
+
+}
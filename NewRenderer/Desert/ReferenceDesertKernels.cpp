@@ -0,0 +1,166 @@
+#include "ReferenceDesertKernels.h"
+
+#include "HaloGrid.h"
+
+namespace Farlor {
+
+void ReferenceDesertKernels::Load(const DesertState &state)
+{
+    m_resolution = state.GetGridResolution();
+    m_settings = BuildDesertStepSettings(state);
+    m_spObstacles = state.GetSharedObstacles();
+
+    state.GetSandBlocks().CopyTo(m_sand);
+    state.GetBedrockBlocks().CopyTo(m_bedrock);
+    m_shadow.assign(m_sand.size(), 0);
+    m_statistics = DesertStatistics();
+    m_stepStatistics = DesertStatistics();
+}
+
+void ReferenceDesertKernels::Store(DesertState &state) const
+{
+    HaloGrid<int32_t> sand(m_resolution, 0);
+    sand.CopyFrom(m_sand);
+    sand.CopyTo(state.AccessSandBlocks());
+}
+
+void ReferenceDesertKernels::RunStage(const DesertStage stage, const uint64_t stepIdx)
+{
+    switch (stage) {
+        case DesertStage::WindShadow:
+            m_statistics = DesertStatistics();
+            RunWindShadow();
+            break;
+        case DesertStage::Transport:
+            RunTransport(stepIdx);
+            break;
+        case DesertStage::Cascade:
+            for (uint32_t passIdx = 0; passIdx < m_settings.m_cascadePasses; passIdx++) {
+                RunCascadePass();
+            }
+            for (uint32_t cellIdx = 0; cellIdx < m_sand.size(); cellIdx++) {
+                m_statistics.AddCell(m_sand[cellIdx], m_bedrock[cellIdx]);
+            }
+            m_stepStatistics = m_statistics;
+            break;
+        default:
+            break;
+    }
+}
+
+void ReferenceDesertKernels::ReadStageOutput(
+      const DesertStage stage, std::vector<int32_t> &values) const
+{
+    values = (stage == DesertStage::WindShadow) ? m_shadow : m_sand;
+}
+
+uint32_t ReferenceDesertKernels::Wrap(const int32_t coord) const
+{
+    const int32_t resolution = static_cast<int32_t>(m_resolution);
+    return static_cast<uint32_t>(((coord % resolution) + resolution) % resolution);
+}
+
+uint32_t ReferenceDesertKernels::CellIndex(const int32_t x, const int32_t y) const
+{
+    return Wrap(y) * m_resolution + Wrap(x);
+}
+
+int32_t ReferenceDesertKernels::Height(const uint32_t cellIdx) const
+{
+    return m_sand[cellIdx] + m_bedrock[cellIdx];
+}
+
+void ReferenceDesertKernels::RunWindShadow()
+{
+    for (int32_t y = 0; y < int32_t(m_resolution); y++) {
+        for (int32_t x = 0; x < int32_t(m_resolution); x++) {
+            const uint32_t cellIdx = CellIndex(x, y);
+            int32_t inShadow = 0;
+            for (int32_t distance = 1; distance <= int32_t(m_settings.m_shadowThresholds.size());
+                  distance++) {
+                const uint32_t upwindIdx = CellIndex(x - distance * m_settings.m_windStepX,
+                      y - distance * m_settings.m_windStepY);
+                if (Height(upwindIdx) - Height(cellIdx)
+                      >= m_settings.m_shadowThresholds[distance - 1]) {
+                    inShadow = 1;
+                    break;
+                }
+            }
+            m_shadow[cellIdx] = inShadow;
+        }
+    }
+}
+
+void ReferenceDesertKernels::RunTransport(const uint64_t stepIdx)
+{
+    // Hops are decided on the sand before the stage, then applied
+    const std::vector<int32_t> sandBefore = m_sand;
+    for (int32_t y = 0; y < int32_t(m_resolution); y++) {
+        for (int32_t x = 0; x < int32_t(m_resolution); x++) {
+            const uint32_t cellIdx = CellIndex(x, y);
+            if (m_spObstacles->Get(x, y)) {
+                continue;
+            }
+
+            const int32_t hop = static_cast<int32_t>(SampleDesertHop(
+                  m_settings, stepIdx, cellIdx, sandBefore[cellIdx], m_shadow[cellIdx] != 0));
+            if (hop == 0) {
+                continue;
+            }
+
+            const uint32_t destX = Wrap(x + hop * m_settings.m_windStepX);
+            const uint32_t destY = Wrap(y + hop * m_settings.m_windStepY);
+            if (m_spObstacles->Get(destX, destY)) {
+                continue;
+            }
+
+            m_sand[cellIdx]--;
+            m_sand[destY * m_resolution + destX]++;
+            m_statistics.m_transportedBlocks += 1.0;
+        }
+    }
+}
+
+void ReferenceDesertKernels::RunCascadePass()
+{
+    // Every cell moves at most one block, to its steepest neighbour past the angle of repose
+    const std::vector<int32_t> sandBefore = m_sand;
+    const std::vector<int32_t> &sand = sandBefore;
+    for (int32_t y = 0; y < int32_t(m_resolution); y++) {
+        for (int32_t x = 0; x < int32_t(m_resolution); x++) {
+            const uint32_t cellIdx = CellIndex(x, y);
+            if (sand[cellIdx] <= 0) {
+                continue;
+            }
+
+            const int32_t height = sand[cellIdx] + m_bedrock[cellIdx];
+            int32_t bestExcess = 0;
+            uint32_t bestIdx = cellIdx;
+            for (uint32_t neighbour = 0; neighbour < CascadeOffsetsX.size(); neighbour++) {
+                const int32_t neighbourX = x + CascadeOffsetsX[neighbour];
+                const int32_t neighbourY = y + CascadeOffsetsY[neighbour];
+                if (m_spObstacles->Get(Wrap(neighbourX), Wrap(neighbourY))) {
+                    continue;
+                }
+
+                const uint32_t neighbourIdx = CellIndex(neighbourX, neighbourY);
+                const int32_t threshold = (neighbour < 4) ? m_settings.m_reposeThreshold
+                                                          : m_settings.m_reposeThresholdDiagonal;
+                const int32_t excess
+                      = height - (sand[neighbourIdx] + m_bedrock[neighbourIdx]) - threshold;
+                if (excess > bestExcess) {
+                    bestExcess = excess;
+                    bestIdx = neighbourIdx;
+                }
+            }
+
+            if (bestIdx != cellIdx) {
+                m_sand[cellIdx]--;
+                m_sand[bestIdx]++;
+                m_statistics.m_cascadedBlocks++;
+            }
+        }
+    }
+}
+
+}
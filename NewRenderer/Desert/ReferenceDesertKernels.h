@@ -0,0 +1,41 @@
+#pragma once
+
+#include "DesertKernels.h"
+
+#include <memory>
+#include <vector>
+
+namespace Farlor {
+
+// Straightforward single threaded desert step on row major arrays with wrapped indexing. Kept
+// simple on purpose: it defines the expected results the optimized kernels are checked against.
+class ReferenceDesertKernels : public DesertKernels {
+   public:
+    void Load(const DesertState &state) override;
+    void Store(DesertState &state) const override;
+    void RunStage(DesertStage stage, uint64_t stepIdx) override;
+    void ReadStageOutput(DesertStage stage, std::vector<int32_t> &values) const override;
+
+   private:
+    uint32_t Wrap(int32_t coord) const;
+    uint32_t CellIndex(int32_t x, int32_t y) const;
+    int32_t Height(uint32_t cellIdx) const;
+
+    void RunWindShadow();
+    void RunTransport(uint64_t stepIdx);
+    void RunCascadePass();
+
+   private:
+    uint32_t m_resolution = 0;
+    DesertStepSettings m_settings;
+    std::shared_ptr<const BitGrid> m_spObstacles = nullptr;
+
+    std::vector<int32_t> m_sand;
+    std::vector<int32_t> m_bedrock;
+    std::vector<int32_t> m_shadow;
+
+    // Statistics of the step in progress
+    DesertStatistics m_statistics;
+};
+
+}
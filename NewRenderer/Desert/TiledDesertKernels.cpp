@@ -0,0 +1,476 @@
+#include "TiledDesertKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace Farlor {
+
+TiledDesertKernels::TiledDesertKernels(uint32_t numThreads, uint32_t tileSize)
+    : m_numThreads(numThreads)
+    , m_tileSize(tileSize)
+{
+    assert(tileSize > 0);
+}
+
+void TiledDesertKernels::Load(const DesertState &state)
+{
+    m_resolution = state.GetGridResolution();
+    m_settings = BuildDesertStepSettings(state);
+    m_spObstacles = state.GetSharedObstacles();
+
+    // Heights are read up to the shadow distance away, hops up to the longest hop
+    const uint32_t heightHalo
+          = std::max<uint32_t>(1, uint32_t(m_settings.m_shadowThresholds.size()));
+    // Whole tile rows per NUMA node
+    const uint32_t tilesPerSide = (m_resolution + m_tileSize - 1) / m_tileSize;
+    const uint32_t numNodes = std::max(1u, std::min(GetNumaNodeCount(), tilesPerSide));
+    m_nodeTileStarts.resize(numNodes + 1);
+    for (uint32_t node = 0; node <= numNodes; node++) {
+        m_nodeTileStarts[node] = (tilesPerSide * node / numNodes) * tilesPerSide;
+    }
+
+    m_sand = HaloGrid<int32_t>(m_resolution, heightHalo);
+    m_bedrock = HaloGrid<int32_t>(m_resolution, heightHalo);
+    PlaceOnNodes(m_sand);
+    PlaceOnNodes(m_bedrock);
+    m_sand.CopyFrom(state.GetSandBlocks());
+    m_bedrock.CopyFrom(state.GetBedrockBlocks());
+
+    // Obstacles are checked at the cascade neighbours and at every hop destination
+    const uint32_t maxHop = uint32_t(m_settings.m_hopCdf.size());
+    m_obstacleCells = HaloGrid<uint8_t>(m_resolution, maxHop);
+    PlaceOnNodes(m_obstacleCells);
+    for (uint32_t y = 0; y < m_resolution; y++) {
+        for (uint32_t x = 0; x < m_resolution; x++) {
+            m_obstacleCells.Access(x, y) = m_spObstacles->Get(x, y) ? 1 : 0;
+        }
+    }
+    m_obstacleCells.RefreshHalo();
+
+    m_shadow.assign(size_t(m_resolution) * m_resolution, 0);
+    m_hops = HaloGrid<uint8_t>(m_resolution, maxHop);
+    m_cascadeTargets = HaloGrid<uint8_t>(m_resolution, 1);
+    PlaceOnNodes(m_shadow);
+    PlaceOnNodes(m_hops);
+    PlaceOnNodes(m_cascadeTargets);
+
+    // Allocated by the first mean field transport
+    m_meanFlux = HaloGrid<float>(0, 0);
+    m_sandFraction.clear();
+
+    m_statistics.Reset(tilesPerSide * tilesPerSide);
+    m_stepStatistics = DesertStatistics();
+
+    UpdateWorkerPool();
+}
+
+void TiledDesertKernels::Store(DesertState &state) const
+{
+    m_sand.CopyTo(state.AccessSandBlocks());
+}
+
+void TiledDesertKernels::RunStage(const DesertStage stage, const uint64_t stepIdx)
+{
+    switch (stage) {
+        case DesertStage::WindShadow: {
+            const uint32_t tilesPerSide = (m_resolution + m_tileSize - 1) / m_tileSize;
+            m_statistics.Reset(tilesPerSide * tilesPerSide);
+            RunWindShadow();
+            break;
+        }
+        case DesertStage::Transport:
+            if (m_transportMode == DesertTransportMode::MeanField) {
+                RunMeanFieldTransport();
+            } else {
+                RunTransport(stepIdx);
+            }
+            break;
+        case DesertStage::Cascade:
+            for (uint32_t passIdx = 0; passIdx < m_settings.m_cascadePasses; passIdx++) {
+                RunCascadePass(passIdx + 1 == m_settings.m_cascadePasses);
+            }
+            if (m_settings.m_cascadePasses == 0) {
+                AccumulateTerrainStatistics();
+            }
+            m_stepStatistics = m_statistics.Reduce();
+            break;
+        default:
+            break;
+    }
+}
+
+void TiledDesertKernels::ReadStageOutput(
+      const DesertStage stage, std::vector<int32_t> &values) const
+{
+    if (stage == DesertStage::WindShadow) {
+        values.assign(m_shadow.begin(), m_shadow.end());
+    } else {
+        m_sand.CopyTo(values);
+    }
+}
+
+LargeBufferPlacement TiledDesertKernels::GetPlacement() const
+{
+    LargeBufferPlacement placement = m_sand.GetPlacement();
+    placement.Merge(m_bedrock.GetPlacement());
+    placement.Merge(m_obstacleCells.GetPlacement());
+    placement.Merge(m_hops.GetPlacement());
+    placement.Merge(m_cascadeTargets.GetPlacement());
+    placement.Merge(m_meanFlux.GetPlacement());
+    placement.Merge(QueryLargeBufferPlacement(m_shadow.data(), m_shadow.size()));
+    placement.Merge(QueryLargeBufferPlacement(
+          m_sandFraction.data(), m_sandFraction.size() * sizeof(float)));
+    return placement;
+}
+
+uint32_t TiledDesertKernels::GetNodeFirstRow(const uint32_t node) const
+{
+    const uint32_t tilesPerSide = (m_resolution + m_tileSize - 1) / m_tileSize;
+    return std::min(m_nodeTileStarts[node] / tilesPerSide * m_tileSize, m_resolution);
+}
+
+template<typename T>
+void TiledDesertKernels::PlaceOnNodes(HaloGrid<T> &grid)
+{
+    const uint32_t numNodes = uint32_t(m_nodeTileStarts.size()) - 1;
+    if (numNodes <= 1) {
+        return;
+    }
+
+    // The outer bands also take the halo rows next to them
+    const int32_t halo = static_cast<int32_t>(grid.GetHaloWidth());
+    bool placed = true;
+    for (uint32_t node = 0; node < numNodes; node++) {
+        const int32_t y0 = (node == 0) ? -halo : int32_t(GetNodeFirstRow(node));
+        const int32_t y1 = (node + 1 == numNodes) ? int32_t(m_resolution) + halo
+                                                  : int32_t(GetNodeFirstRow(node + 1));
+        placed = grid.BindRowsToNumaNode(y0, y1, node) && placed;
+    }
+    if (!placed) {
+        UseSingleBand();
+    }
+}
+
+template<typename T>
+void TiledDesertKernels::PlaceOnNodes(GridVector<T> &values)
+{
+    const uint32_t numNodes = uint32_t(m_nodeTileStarts.size()) - 1;
+    if (numNodes <= 1 || values.empty()) {
+        return;
+    }
+
+    const size_t pageSize = GetLargeBufferPageSize(values.size() * sizeof(T));
+    bool placed = true;
+    for (uint32_t node = 0; node < numNodes; node++) {
+        const size_t first = size_t(GetNodeFirstRow(node)) * m_resolution;
+        const size_t last = size_t(GetNodeFirstRow(node + 1)) * m_resolution;
+        placed = BindToNumaNode(values.data() + first, (last - first) * sizeof(T), node, pageSize)
+              && placed;
+    }
+    if (!placed) {
+        UseSingleBand();
+    }
+}
+
+// Without the rows on their band's node, workers pinned to a node would read remote memory for
+// every other band, which is worse than not pinning at all. With a single band the worker pool
+// is rebuilt without pinning. Happens on Windows, where binding is not supported.
+void TiledDesertKernels::UseSingleBand()
+{
+    m_nodeTileStarts = { 0, m_nodeTileStarts.back() };
+    if (m_upWorkerPool) {
+        UpdateWorkerPool();
+    }
+}
+
+// Workers are pinned to their node once when they start, so a pool cannot follow a change in the
+// number of bands and is replaced instead
+void TiledDesertKernels::UpdateWorkerPool()
+{
+    const uint32_t numBands = uint32_t(m_nodeTileStarts.size()) - 1;
+    if (!m_upWorkerPool || (m_upWorkerPool->GetNumNodes() != numBands)) {
+        m_upWorkerPool = std::make_unique<ParallelForPool>(m_numThreads, numBands);
+    }
+}
+
+template<typename Func>
+void TiledDesertKernels::ForEachTile(const Func &func) const
+{
+    const uint32_t tilesPerSide = (m_resolution + m_tileSize - 1) / m_tileSize;
+    m_upWorkerPool->Run(m_nodeTileStarts, [&](uint32_t tileIdx) {
+        const uint32_t x0 = (tileIdx % tilesPerSide) * m_tileSize;
+        const uint32_t y0 = (tileIdx / tilesPerSide) * m_tileSize;
+        func(x0, std::min(x0 + m_tileSize, m_resolution), y0,
+              std::min(y0 + m_tileSize, m_resolution));
+    });
+}
+
+DesertStatistics &TiledDesertKernels::AccessTileStatistics(const uint32_t x0, const uint32_t y0)
+{
+    const uint32_t tilesPerSide = (m_resolution + m_tileSize - 1) / m_tileSize;
+    return m_statistics.AccessTile((y0 / m_tileSize) * tilesPerSide + x0 / m_tileSize);
+}
+
+void TiledDesertKernels::RunWindShadow()
+{
+    const ptrdiff_t windOffset
+          = m_settings.m_windStepX + ptrdiff_t(m_settings.m_windStepY) * m_sand.GetStride();
+    const int32_t *pThresholds = m_settings.m_shadowThresholds.data();
+    const uint32_t shadowDistance = uint32_t(m_settings.m_shadowThresholds.size());
+
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        for (uint32_t y = y0; y < y1; y++) {
+            const int32_t *pSand = m_sand.GetRow(y);
+            const int32_t *pBedrock = m_bedrock.GetRow(y);
+            uint8_t *pShadow = &m_shadow[size_t(y) * m_resolution];
+            for (uint32_t x = x0; x < x1; x++) {
+                const int32_t height = pSand[x] + pBedrock[x];
+                uint8_t inShadow = 0;
+                for (uint32_t distance = 1; distance <= shadowDistance; distance++) {
+                    const ptrdiff_t upwind = ptrdiff_t(x) - ptrdiff_t(distance) * windOffset;
+                    inShadow |= (pSand[upwind] + pBedrock[upwind] - height)
+                          >= pThresholds[distance - 1];
+                }
+                pShadow[x] = inShadow;
+            }
+        }
+    });
+}
+
+void TiledDesertKernels::RunTransport(const uint64_t stepIdx)
+{
+    const int32_t resolution = static_cast<int32_t>(m_resolution);
+
+    // Decide every hop from the sand before the stage
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        for (uint32_t y = y0; y < y1; y++) {
+            const int32_t *pSand = m_sand.GetRow(y);
+            const uint8_t *pObstacles = m_obstacleCells.GetRow(y);
+            const uint8_t *pShadow = &m_shadow[size_t(y) * m_resolution];
+            uint8_t *pHops = m_hops.AccessRow(y);
+            for (uint32_t x = x0; x < x1; x++) {
+                uint32_t hop = 0;
+                if (!pObstacles[x]) {
+                    hop = SampleDesertHop(m_settings, stepIdx, y * m_resolution + x, pSand[x],
+                          pShadow[x] != 0);
+                }
+                if (hop != 0) {
+                    int32_t destX = int32_t(x) + int32_t(hop) * m_settings.m_windStepX;
+                    int32_t destY = int32_t(y) + int32_t(hop) * m_settings.m_windStepY;
+                    destX += (destX < 0) ? resolution : ((destX >= resolution) ? -resolution : 0);
+                    destY += (destY < 0) ? resolution : ((destY >= resolution) ? -resolution : 0);
+                    hop = m_spObstacles->Get(destX, destY) ? 0 : hop;
+                }
+                pHops[x] = static_cast<uint8_t>(hop);
+            }
+        }
+    });
+    m_hops.RefreshHalo();
+
+    // Each cell gathers the blocks that land on it
+    const ptrdiff_t hopOffset
+          = m_settings.m_windStepX + ptrdiff_t(m_settings.m_windStepY) * m_hops.GetStride();
+    const uint32_t maxHop = uint32_t(m_settings.m_hopCdf.size());
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        uint32_t lifted = 0;
+        for (uint32_t y = y0; y < y1; y++) {
+            const uint8_t *pHops = m_hops.GetRow(y);
+            int32_t *pSand = m_sand.AccessRow(y);
+            for (uint32_t x = x0; x < x1; x++) {
+                int32_t delta = -int32_t(pHops[x] != 0);
+                for (uint32_t hop = 1; hop <= maxHop; hop++) {
+                    delta += int32_t(pHops[ptrdiff_t(x) - ptrdiff_t(hop) * hopOffset] == hop);
+                }
+                pSand[x] += delta;
+                lifted += uint32_t(pHops[x] != 0);
+            }
+        }
+        AccessTileStatistics(x0, y0).m_transportedBlocks += lifted;
+    });
+    m_sand.RefreshHalo();
+}
+
+// Expected value version of RunTransport. Each cell lifts liftProbability of up to one block,
+// which lands hop cells downwind with the hop length probability; hops onto obstacles stay put.
+// The deposit is a gather of the flux along the wind, a short 1D convolution per row.
+void TiledDesertKernels::RunMeanFieldTransport()
+{
+    if (m_meanFlux.GetResolution() != m_resolution) {
+        m_meanFlux = HaloGrid<float>(m_resolution, uint32_t(m_settings.m_hopProbabilities.size()));
+        m_sandFraction.assign(size_t(m_resolution) * m_resolution, 0.0f);
+        PlaceOnNodes(m_meanFlux);
+        PlaceOnNodes(m_sandFraction);
+    }
+
+    const float liftProbability = m_settings.m_liftProbability;
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        for (uint32_t y = y0; y < y1; y++) {
+            const int32_t *pSand = m_sand.GetRow(y);
+            const float *pFraction = &m_sandFraction[size_t(y) * m_resolution];
+            const uint8_t *pObstacles = m_obstacleCells.GetRow(y);
+            const uint8_t *pShadow = &m_shadow[size_t(y) * m_resolution];
+            float *pFlux = m_meanFlux.AccessRow(y);
+            for (uint32_t x = x0; x < x1; x++) {
+                const float sand = std::clamp(float(pSand[x]) + pFraction[x], 0.0f, 1.0f);
+                const float exposed = float(1 - pShadow[x]) * float(1 - pObstacles[x]);
+                pFlux[x] = liftProbability * sand * exposed;
+            }
+        }
+    });
+    m_meanFlux.RefreshHalo();
+
+    const ptrdiff_t fluxOffset
+          = m_settings.m_windStepX + ptrdiff_t(m_settings.m_windStepY) * m_meanFlux.GetStride();
+    const ptrdiff_t obstacleOffset = m_settings.m_windStepX
+          + ptrdiff_t(m_settings.m_windStepY) * m_obstacleCells.GetStride();
+    const std::vector<float> &hopProbabilities = m_settings.m_hopProbabilities;
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        double moved = 0.0;
+        std::vector<float> arriving(x1 - x0);
+        std::vector<float> leaving(x1 - x0);
+        for (uint32_t y = y0; y < y1; y++) {
+            const float *pFlux = m_meanFlux.GetRow(y) + x0;
+            const uint8_t *pObstacles = m_obstacleCells.GetRow(y) + x0;
+            std::fill(arriving.begin(), arriving.end(), 0.0f);
+            std::fill(leaving.begin(), leaving.end(), 0.0f);
+
+            // Hop outer, cells inner, so every inner loop is a unit stride multiply add
+            for (uint32_t hop = 1; hop <= hopProbabilities.size(); hop++) {
+                const float probability = hopProbabilities[hop - 1];
+                const float *pSource = pFlux - ptrdiff_t(hop) * fluxOffset;
+                const uint8_t *pDestination = pObstacles + ptrdiff_t(hop) * obstacleOffset;
+                for (uint32_t idx = 0; idx < x1 - x0; idx++) {
+                    arriving[idx] += probability * pSource[idx];
+                    leaving[idx] += probability * float(1 - pDestination[idx]);
+                }
+            }
+
+            int32_t *pSand = m_sand.AccessRow(y) + x0;
+            float *pFraction = &m_sandFraction[size_t(y) * m_resolution + x0];
+            float rowMoved = 0.0f;
+            for (uint32_t idx = 0; idx < x1 - x0; idx++) {
+                const float total = std::max(0.0f,
+                      float(pSand[idx]) + pFraction[idx]
+                            + float(1 - pObstacles[idx]) * arriving[idx]
+                            - pFlux[idx] * leaving[idx]);
+                const float blocks = std::floor(total);
+                pSand[idx] = int32_t(blocks);
+                pFraction[idx] = total - blocks;
+                rowMoved += pFlux[idx] * leaving[idx];
+            }
+            moved += rowMoved;
+        }
+        AccessTileStatistics(x0, y0).m_transportedBlocks += moved;
+    });
+    m_sand.RefreshHalo();
+}
+
+void TiledDesertKernels::RunCascadePass(const bool lastPass)
+{
+    std::array<ptrdiff_t, 8> heightOffsets;
+    std::array<ptrdiff_t, 8> obstacleOffsets;
+    std::array<ptrdiff_t, 8> cellOffsets;
+    for (uint32_t neighbour = 0; neighbour < 8; neighbour++) {
+        heightOffsets[neighbour] = CascadeOffsetsX[neighbour]
+              + ptrdiff_t(CascadeOffsetsY[neighbour]) * m_sand.GetStride();
+        obstacleOffsets[neighbour] = CascadeOffsetsX[neighbour]
+              + ptrdiff_t(CascadeOffsetsY[neighbour]) * m_obstacleCells.GetStride();
+        cellOffsets[neighbour] = CascadeOffsetsX[neighbour]
+              + ptrdiff_t(CascadeOffsetsY[neighbour]) * m_cascadeTargets.GetStride();
+    }
+    const int32_t thresholds[2] = { m_settings.m_reposeThreshold,
+        m_settings.m_reposeThresholdDiagonal };
+
+    // Every cell picks the steepest neighbour past the angle of repose
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        for (uint32_t y = y0; y < y1; y++) {
+            const int32_t *pSand = m_sand.GetRow(y);
+            const int32_t *pBedrock = m_bedrock.GetRow(y);
+            const uint8_t *pObstacles = m_obstacleCells.GetRow(y);
+            uint8_t *pTargets = m_cascadeTargets.AccessRow(y);
+            for (uint32_t x = x0; x < x1; x++) {
+                const int32_t height = pSand[x] + pBedrock[x];
+                int32_t bestExcess = 0;
+                uint8_t target = 0;
+                for (uint32_t neighbour = 0; neighbour < 8; neighbour++) {
+                    const ptrdiff_t neighbourIdx = ptrdiff_t(x) + heightOffsets[neighbour];
+                    const int32_t excess = height
+                          - (pSand[neighbourIdx] + pBedrock[neighbourIdx])
+                          - thresholds[neighbour / 4];
+                    const bool better = (excess > bestExcess)
+                          && !pObstacles[ptrdiff_t(x) + obstacleOffsets[neighbour]];
+                    bestExcess = better ? excess : bestExcess;
+                    target = better ? uint8_t(neighbour + 1) : target;
+                }
+                pTargets[x] = (pSand[x] > 0) ? target : 0;
+            }
+        }
+    });
+    m_cascadeTargets.RefreshHalo();
+
+    // Each cell gathers the blocks its neighbours send to it
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        DesertStatistics &statistics = AccessTileStatistics(x0, y0);
+        uint32_t slid = 0;
+        for (uint32_t y = y0; y < y1; y++) {
+            const uint8_t *pTargets = m_cascadeTargets.GetRow(y);
+            int32_t *pSand = m_sand.AccessRow(y);
+            for (uint32_t x = x0; x < x1; x++) {
+                int32_t delta = -int32_t(pTargets[x] != 0);
+                for (uint32_t neighbour = 0; neighbour < 8; neighbour++) {
+                    const uint8_t towardsUs = CascadeOpposite[neighbour] + 1;
+                    delta += int32_t(pTargets[ptrdiff_t(x) + cellOffsets[neighbour]] == towardsUs);
+                }
+                pSand[x] += delta;
+                slid += uint32_t(pTargets[x] != 0);
+            }
+
+            if (lastPass) {
+                const int32_t *pBedrock = m_bedrock.GetRow(y);
+                for (uint32_t x = x0; x < x1; x++) {
+                    statistics.AddCell(pSand[x], pBedrock[x]);
+                }
+            }
+        }
+        statistics.m_cascadedBlocks += slid;
+        if (lastPass && !m_sandFraction.empty()) {
+            statistics.m_sandFraction += SumFractions(x0, x1, y0, y1);
+        }
+    });
+    m_sand.RefreshHalo();
+}
+
+void TiledDesertKernels::AccumulateTerrainStatistics()
+{
+    ForEachTile([&](uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) {
+        DesertStatistics &statistics = AccessTileStatistics(x0, y0);
+        for (uint32_t y = y0; y < y1; y++) {
+            const int32_t *pSand = m_sand.GetRow(y);
+            const int32_t *pBedrock = m_bedrock.GetRow(y);
+            for (uint32_t x = x0; x < x1; x++) {
+                statistics.AddCell(pSand[x], pBedrock[x]);
+            }
+        }
+        if (!m_sandFraction.empty()) {
+            statistics.m_sandFraction += SumFractions(x0, x1, y0, y1);
+        }
+    });
+}
+
+double TiledDesertKernels::SumFractions(
+      const uint32_t x0, const uint32_t x1, const uint32_t y0, const uint32_t y1) const
+{
+    double sum = 0.0;
+    for (uint32_t y = y0; y < y1; y++) {
+        const float *pFraction = &m_sandFraction[size_t(y) * m_resolution];
+        float rowSum = 0.0f;
+        for (uint32_t x = x0; x < x1; x++) {
+            rowSum += pFraction[x];
+        }
+        sum += rowSum;
+    }
+    return sum;
+}
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "DesertKernels.h"
+#include "HaloGrid.h"
+#include "ParallelFor.h"
+
+#include <memory>
+#include <vector>
+
+namespace Farlor {
+
+// Multithreaded desert step. The grid is split into square tiles that are processed in
+// parallel, and every stage is written as a gather over halo padded grids so no two tiles ever
+// write the same cell and the result does not depend on the tiling or thread count.
+//
+// On NUMA machines the tile rows are split into one band per node. The grid rows of a band are
+// moved to its node and its tiles are processed by worker threads pinned there. The workers are
+// created by Load and kept for every stage until the band layout changes.
+class TiledDesertKernels : public DesertKernels {
+   public:
+    static constexpr uint32_t DefaultTileSize = 64;
+
+   public:
+    // numThreads == 0 uses every hardware thread
+    explicit TiledDesertKernels(uint32_t numThreads = 0, uint32_t tileSize = DefaultTileSize);
+
+    void SetTransportMode(const DesertTransportMode mode) { m_transportMode = mode; }
+    DesertTransportMode GetTransportMode() const { return m_transportMode; }
+
+    void Load(const DesertState &state) override;
+    void Store(DesertState &state) const override;
+    void RunStage(DesertStage stage, uint64_t stepIdx) override;
+    void ReadStageOutput(DesertStage stage, std::vector<int32_t> &values) const override;
+
+    // Huge page and NUMA node placement the grids actually got
+    LargeBufferPlacement GetPlacement() const;
+
+   private:
+    template<typename T>
+    using GridVector = std::vector<T, LargeBufferAllocator<T>>;
+
+    // First grid row of the NUMA band of node
+    uint32_t GetNodeFirstRow(uint32_t node) const;
+
+    // Moves every band of rows of a grid to its node, falling back to a single band if that fails
+    template<typename T>
+    void PlaceOnNodes(HaloGrid<T> &grid);
+    template<typename T>
+    void PlaceOnNodes(GridVector<T> &values);
+    void UseSingleBand();
+    // Creates the worker pool, or rebuilds it when the number of bands no longer matches
+    void UpdateWorkerPool();
+
+    // Calls func(x0, x1, y0, y1) for every tile, in parallel
+    template<typename Func>
+    void ForEachTile(const Func &func) const;
+
+    // Statistics slot of the tile starting at (x0, y0)
+    DesertStatistics &AccessTileStatistics(uint32_t x0, uint32_t y0);
+
+    void RunWindShadow();
+    void RunTransport(uint64_t stepIdx);
+    void RunMeanFieldTransport();
+
+    // The last pass also folds the final terrain into the step statistics
+    void RunCascadePass(bool lastPass);
+
+    // Terrain statistics on their own, for steps without cascade passes
+    void AccumulateTerrainStatistics();
+    double SumFractions(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1) const;
+
+   private:
+    uint32_t m_numThreads = 0;
+    uint32_t m_tileSize = DefaultTileSize;
+    DesertTransportMode m_transportMode = DesertTransportMode::Stochastic;
+
+    // Index of the first tile of every NUMA band, plus the tile count at the end
+    std::vector<uint32_t> m_nodeTileStarts;
+    std::unique_ptr<ParallelForPool> m_upWorkerPool = nullptr;
+
+    uint32_t m_resolution = 0;
+    DesertStepSettings m_settings;
+    std::shared_ptr<const BitGrid> m_spObstacles = nullptr;
+
+    HaloGrid<int32_t> m_sand = HaloGrid<int32_t>(0, 0);
+    HaloGrid<int32_t> m_bedrock = HaloGrid<int32_t>(0, 0);
+    HaloGrid<uint8_t> m_obstacleCells = HaloGrid<uint8_t>(0, 0);
+    GridVector<uint8_t> m_shadow;
+
+    // Hop length (transport) or direction + 1 (cascade) each cell sends its block along
+    HaloGrid<uint8_t> m_hops = HaloGrid<uint8_t>(0, 0);
+    HaloGrid<uint8_t> m_cascadeTargets = HaloGrid<uint8_t>(0, 0);
+
+    // Mean field transport: expected blocks leaving each cell, and the sand below one block
+    // that the integer grid cannot hold yet
+    HaloGrid<float> m_meanFlux = HaloGrid<float>(0, 0);
+    GridVector<float> m_sandFraction;
+
+    DesertStatisticsAccumulator m_statistics;
+};
+
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Farlor {
+
+// Square grid stored as fixed size tiles. Tiles are shared copy-on-write, so copying a grid is
+// O(1) and a copy only allocates the tiles it writes to. A grid may only be used from one thread
+// at a time, but copies of it can be modified on other threads concurrently.
+template<typename T>
+class TiledGrid {
+   public:
+    using Tile = std::vector<T>;
+
+    TiledGrid(const uint32_t resolution, const uint32_t tileSize, const T &defaultValue)
+        : m_resolution(resolution)
+        , m_tileSize(tileSize)
+        , m_tilesPerSide(resolution / tileSize)
+    {
+        assert((resolution % tileSize) == 0 && "Grid resolution must be a multiple of tile size");
+
+        // Every tile starts out pointing at the same default tile
+        auto spDefaultTile = std::make_shared<Tile>(size_t(tileSize) * tileSize, defaultValue);
+        m_spTiles = std::make_shared<TileTable>(
+              size_t(m_tilesPerSide) * m_tilesPerSide, spDefaultTile);
+    }
+
+    TiledGrid(const uint32_t resolution, const uint32_t tileSize, const std::vector<T> &values)
+        : TiledGrid(resolution, tileSize, T())
+    {
+        assert(values.size() == size_t(resolution) * resolution);
+        for (uint32_t tileY = 0; tileY < m_tilesPerSide; tileY++) {
+            for (uint32_t tileX = 0; tileX < m_tilesPerSide; tileX++) {
+                auto spTile = std::make_shared<Tile>(size_t(m_tileSize) * m_tileSize);
+                for (uint32_t localY = 0; localY < m_tileSize; localY++) {
+                    const size_t rowStart
+                          = size_t(tileY * m_tileSize + localY) * m_resolution + tileX * m_tileSize;
+                    std::copy(values.begin() + rowStart, values.begin() + rowStart + m_tileSize,
+                          spTile->begin() + size_t(localY) * m_tileSize);
+                }
+                (*m_spTiles)[TileIndex(tileX, tileY)] = std::move(spTile);
+            }
+        }
+    }
+
+    // Copies share every tile with the original until one of them writes
+    TiledGrid Fork() const { return *this; }
+
+    uint32_t GetResolution() const { return m_resolution; }
+    uint32_t GetTileSize() const { return m_tileSize; }
+    uint32_t GetTilesPerSide() const { return m_tilesPerSide; }
+    uint32_t GetTileCount() const { return m_tilesPerSide * m_tilesPerSide; }
+
+    uint32_t TileIndex(const uint32_t tileX, const uint32_t tileY) const
+    {
+        return tileY * m_tilesPerSide + tileX;
+    }
+
+    const T *GetTileData(const uint32_t tileIdx) const { return (*m_spTiles)[tileIdx]->data(); }
+
+    // Gives write access to a tile, taking a private copy first if it is shared
+    T *AccessTileData(const uint32_t tileIdx)
+    {
+        if (m_spTiles.use_count() > 1) {
+            m_spTiles = std::make_shared<TileTable>(*m_spTiles);
+        } else {
+            AcquireSoleOwnership();
+        }
+
+        std::shared_ptr<Tile> &spTile = (*m_spTiles)[tileIdx];
+        if (spTile.use_count() > 1) {
+            spTile = std::make_shared<Tile>(*spTile);
+        } else {
+            AcquireSoleOwnership();
+        }
+        return spTile->data();
+    }
+
+    // True when both grids point at the same storage for this tile
+    bool SharesTile(const TiledGrid &other, const uint32_t tileIdx) const
+    {
+        return (*m_spTiles)[tileIdx] == (*other.m_spTiles)[tileIdx];
+    }
+
+    // Points every tile whose contents match the parent's at the parent's storage, so a grid built
+    // from a fresh readback only keeps the tiles that changed. Returns the number of shared tiles.
+    uint32_t ShareUnchangedTiles(const TiledGrid &parent)
+    {
+        assert(parent.m_resolution == m_resolution && parent.m_tileSize == m_tileSize);
+        if (m_spTiles == parent.m_spTiles) {
+            return GetTileCount();
+        }
+        if (m_spTiles.use_count() > 1) {
+            m_spTiles = std::make_shared<TileTable>(*m_spTiles);
+        } else {
+            AcquireSoleOwnership();
+        }
+
+        uint32_t sharedCount = 0;
+        for (uint32_t tileIdx = 0; tileIdx < GetTileCount(); tileIdx++) {
+            std::shared_ptr<Tile> &spTile = (*m_spTiles)[tileIdx];
+            const std::shared_ptr<Tile> &spParentTile = (*parent.m_spTiles)[tileIdx];
+            if (spTile != spParentTile && *spTile == *spParentTile) {
+                spTile = spParentTile;
+            }
+            sharedCount += (spTile == spParentTile) ? 1 : 0;
+        }
+        return sharedCount;
+    }
+
+    T Get(const uint32_t x, const uint32_t y) const
+    {
+        const uint32_t tileIdx = TileIndex(x / m_tileSize, y / m_tileSize);
+        return GetTileData(tileIdx)[(y % m_tileSize) * m_tileSize + (x % m_tileSize)];
+    }
+
+    void Set(const uint32_t x, const uint32_t y, const T &value)
+    {
+        const uint32_t tileIdx = TileIndex(x / m_tileSize, y / m_tileSize);
+        AccessTileData(tileIdx)[(y % m_tileSize) * m_tileSize + (x % m_tileSize)] = value;
+    }
+
+    // Flattens the grid into a row major array, as the simulation textures expect
+    void CopyTo(std::vector<T> &values) const
+    {
+        values.resize(size_t(m_resolution) * m_resolution);
+        for (uint32_t tileY = 0; tileY < m_tilesPerSide; tileY++) {
+            for (uint32_t tileX = 0; tileX < m_tilesPerSide; tileX++) {
+                const T *pTile = GetTileData(TileIndex(tileX, tileY));
+                for (uint32_t localY = 0; localY < m_tileSize; localY++) {
+                    const size_t rowStart
+                          = size_t(tileY * m_tileSize + localY) * m_resolution + tileX * m_tileSize;
+                    std::copy(pTile + size_t(localY) * m_tileSize,
+                          pTile + size_t(localY + 1) * m_tileSize, values.begin() + rowStart);
+                }
+            }
+        }
+    }
+
+    // Bytes of tile storage this grid references, splitting shared tiles evenly between owners
+    size_t GetSharedBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto &spTile : *m_spTiles) {
+            bytes += (spTile->size() * sizeof(T)) / spTile.use_count();
+        }
+        return bytes / m_spTiles.use_count();
+    }
+
+    // Number of tiles this grid does not share with any other grid
+    uint32_t GetUniqueTileCount() const
+    {
+        if (m_spTiles.use_count() > 1) {
+            return 0;
+        }
+
+        uint32_t count = 0;
+        for (const auto &spTile : *m_spTiles) {
+            count += (spTile.use_count() == 1) ? 1 : 0;
+        }
+        return count;
+    }
+
+   private:
+    using TileTable = std::vector<std::shared_ptr<Tile>>;
+
+    // use_count() is a relaxed load. Seeing a count of one does not order this thread after
+    // another grid that read the storage and then dropped its reference on another thread, so
+    // writing in place needs this fence first.
+    static void AcquireSoleOwnership() { std::atomic_thread_fence(std::memory_order_acquire); }
+
+    uint32_t m_resolution = 0;
+    uint32_t m_tileSize = 0;
+    uint32_t m_tilesPerSide = 0;
+
+    // The table itself is shared as well so forking never touches every tile pointer
+    std::shared_ptr<TileTable> m_spTiles = nullptr;
+};
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Farlor {
+
+// Zigzag maps small signed values to small unsigned ones: 0, -1, 1, -2 -> 0, 1, 2, 3
+inline uint32_t ZigZagEncode(const int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t ZigZagDecode(const uint32_t value)
+{
+    return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+inline uint64_t ZigZagEncode64(const int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t ZigZagDecode64(const uint64_t value)
+{
+    return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+// LEB128 style varints, 7 bits per byte with the high bit marking continuation
+constexpr uint32_t MaxVarintBytes = 10;
+
+inline void WriteVarint(uint64_t value, std::vector<uint8_t> &encoded)
+{
+    while (value >= 0x80) {
+        encoded.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    encoded.push_back(static_cast<uint8_t>(value));
+}
+
+// Reads a varint that must end before pDataEnd. Returns false on a truncated or overlong one,
+// which only corrupt data produces.
+inline bool ReadVarint(const uint8_t *&pData, const uint8_t *pDataEnd, uint64_t &value)
+{
+    value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (pData >= pDataEnd) {
+            return false;
+        }
+        const uint8_t byte = *pData++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -2,9 +2,203 @@
 #include "vec.h"
 #include <time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
-// Random (Dirty, C-style)
+// Seedable xoshiro256** generator. Copies are independent streams; use Jump() or
+// Substream() to hand non overlapping streams to tiles or threads.
+class RandomStream {
+   public:
+    /*!
+	\brief Constructor.
+	\param seed any value, expanded to the full state with splitmix64
+	*/
+    explicit RandomStream(uint64_t seed = 0x853C49E6748FEA9Bull) { Seed(seed); }
+
+    /*!
+	\brief Reset the stream from a seed.
+	*/
+    inline void Seed(uint64_t seed)
+    {
+        for (int i = 0; i < 4; i++) {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            state[i] = z ^ (z >> 31);
+        }
+        hasSpareNormal = false;
+    }
+
+    /*!
+	\brief Next raw 64 bit value.
+	*/
+    inline uint64_t Next()
+    {
+        const uint64_t result = Rotl(state[1] * 5, 7) * 9;
+        const uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = Rotl(state[3], 45);
+        return result;
+    }
+
+    /*!
+	\brief Advance the stream by 2^128 values, as if Next() had been called that many times.
+	*/
+    inline void Jump()
+    {
+        static const uint64_t table[4]
+              = { 0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull,
+                    0x39ABDC4529B1661Cull };
+        JumpBy(table);
+    }
+
+    /*!
+	\brief Advance the stream by 2^192 values, for streams that will themselves be split
+	with Jump().
+	*/
+    inline void LongJump()
+    {
+        static const uint64_t table[4]
+              = { 0x76E15D3EFEFDCBBFull, 0xC5004E441C522FB3ull, 0x77710069854EE241ull,
+                    0x39109BB02ACBE635ull };
+        JumpBy(table);
+    }
+
+    /*!
+	\brief Copy of this stream jumped index + 1 times, so substreams 0, 1, ... never overlap
+	each other or this stream's next 2^128 values.
+	*/
+    inline RandomStream Substream(uint32_t index) const
+    {
+        RandomStream stream = *this;
+        stream.hasSpareNormal = false;
+        for (uint32_t i = 0; i <= index; i++) {
+            stream.Jump();
+        }
+        return stream;
+    }
+
+    /*!
+	\brief Uniform random number in [0, 1).
+	*/
+    inline float Uniform() { return float(Next() >> 40) * (1.0f / 16777216.0f); }
+
+    /*!
+	\brief Uniform random number in [a, b).
+	*/
+    inline float Uniform(float a, float b) { return a + (b - a) * Uniform(); }
+
+    /*!
+	\brief Random positive integer in [0, 2^31).
+	*/
+    inline int Integer() { return int(Next() >> 33); }
+
+    /*!
+	\brief Normally distributed random number (Box-Muller, the second value is kept for the
+	next call).
+	*/
+    inline float Normal(float mean = 0.0f, float sigma = 1.0f)
+    {
+        if (hasSpareNormal) {
+            hasSpareNormal = false;
+            return mean + sigma * spareNormal;
+        }
+        float n0, n1;
+        NormalPair(n0, n1);
+        spareNormal = n1;
+        hasSpareNormal = true;
+        return mean + sigma * n0;
+    }
+
+    /*!
+	\brief Fill out with count uniform random numbers in [a, b).
+	*/
+    inline void Uniform(float *out, int count, float a = 0.0f, float b = 1.0f)
+    {
+        const float scale = (b - a) * (1.0f / 16777216.0f);
+        for (int i = 0; i < count; i++) {
+            out[i] = a + float(Next() >> 40) * scale;
+        }
+    }
+
+    /*!
+	\brief Fill out with count normally distributed random numbers.
+	*/
+    inline void Normal(float *out, int count, float mean = 0.0f, float sigma = 1.0f)
+    {
+        int i = 0;
+        for (; i + 1 < count; i += 2) {
+            float n0, n1;
+            NormalPair(n0, n1);
+            out[i] = mean + sigma * n0;
+            out[i + 1] = mean + sigma * n1;
+        }
+        if (i < count) {
+            out[i] = Normal(mean, sigma);
+        }
+    }
+
+    /*!
+	\brief Stream owned by the calling thread. Threads get consecutive substreams of a fixed
+	seed in the order they first call this, so use Substream() on an explicit stream when
+	results must not depend on thread scheduling.
+	*/
+    static inline RandomStream &ThreadLocal()
+    {
+        static std::atomic<uint32_t> nextThread = 0;
+        thread_local RandomStream stream = RandomStream().Substream(nextThread++);
+        return stream;
+    }
+
+   private:
+    static inline uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    inline void JumpBy(const uint64_t table[4])
+    {
+        uint64_t jumped[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4; i++) {
+            for (int b = 0; b < 64; b++) {
+                if (table[i] & (uint64_t(1) << b)) {
+                    for (int j = 0; j < 4; j++) {
+                        jumped[j] ^= state[j];
+                    }
+                }
+                Next();
+            }
+        }
+        for (int j = 0; j < 4; j++) {
+            state[j] = jumped[j];
+        }
+    }
+
+    // Two independent standard normals from two uniforms in (0, 1]
+    inline void NormalPair(float &n0, float &n1)
+    {
+        const float u0 = float((Next() >> 40) + 1) * (1.0f / 16777216.0f);
+        const float u1 = float(Next() >> 40) * (1.0f / 16777216.0f);
+        const float r = sqrt(-2.0f * log(u0));
+        const float theta = 6.28318530718f * u1;
+        n0 = r * cos(theta);
+        n1 = r * sin(theta);
+    }
+
+   private:
+    uint64_t state[4];
+    float spareNormal = 0.0f;
+    bool hasSpareNormal = false;
+};
+
+// Random numbers from the calling thread's RandomStream
 class Random {
    public:
     /*!
@@ -15,6 +209,11 @@ class Random {
         // Empty
     }
 
+    /*!
+	\brief Reseed the calling thread's stream.
+	*/
+    static inline void Seed(uint64_t seed) { RandomStream::ThreadLocal().Seed(seed); }
+
     /*!
 	\brief Compute a random number in a given range.
 	\param a min
@@ -23,14 +222,22 @@ class Random {
     static inline float Uniform(float a, float b) { return a + (b - a) * Uniform(); }
 
     /*!
-	\brief Compute a uniform random number in [0, 1]
+	\brief Compute a uniform random number in [0, 1)
 	*/
-    static inline float Uniform() { return float(rand()) / RAND_MAX; }
+    static inline float Uniform() { return RandomStream::ThreadLocal().Uniform(); }
 
     /*!
 	\brief Compute a random positive integer.
 	*/
-    static inline int Integer() { return rand(); }
+    static inline int Integer() { return RandomStream::ThreadLocal().Integer(); }
+
+    /*!
+	\brief Compute a normally distributed random number.
+	*/
+    static inline float Normal(float mean = 0.0f, float sigma = 1.0f)
+    {
+        return RandomStream::ThreadLocal().Normal(mean, sigma);
+    }
 };
 
 // AABB 2D class.
@@ -476,6 +683,83 @@ class ScalarField2D {
               + localU * (1 - localV) * v4 + localU * localV * v3;
     }
 
+    /*!
+	\brief Bilinear interpolation at count world points given as separate x and y arrays.
+	Points outside the field get -1, like GetValueBilinear.
+	*/
+    inline void GetValuesBilinear(const float *px, const float *py, float *out, int count) const
+    {
+        SampleBilinear(px, py, out, nullptr, nullptr, count);
+    }
+
+    /*!
+	\brief World space gradient of the bilinear interpolation at count world points.
+	Points outside the field get a zero gradient and, if values is given, a value of -1.
+	*/
+    inline void GetGradientsBilinear(const float *px, const float *py, float *gx, float *gy,
+          int count, float *values = nullptr) const
+    {
+        SampleBilinear(px, py, values, gx, gy, count);
+    }
+
+    /*!
+	\brief Resample the whole field to a new resolution over the same box. Every source row
+	is interpolated horizontally once and each output row blends two of them, so this
+	streams through memory instead of doing a full bilinear lookup per vertex.
+	*/
+    inline ScalarField2D ResampleBilinear(int newNx, int newNy) const
+    {
+        ScalarField2D field(newNx, newNy, box);
+        if (nx < 2 || ny < 2 || newNx < 1 || newNy < 1)
+            return field;
+
+        // Source column and weight for every output column
+        std::vector<int> columns(newNx);
+        std::vector<float> weights(newNx);
+        const float scaleX = newNx > 1 ? float(nx - 1) / float(newNx - 1) : 0.0f;
+        for (int c = 0; c < newNx; c++) {
+            const float x = c * scaleX;
+            columns[c] = Math::Min(int(x), nx - 2);
+            weights[c] = x - columns[c];
+        }
+
+        auto resampleRow = [&](int row, float *out) {
+            const float *src = values.data() + size_t(row) * nx;
+            for (int c = 0; c < newNx; c++) {
+                const float a = src[columns[c]];
+                const float b = src[columns[c] + 1];
+                out[c] = a + (b - a) * weights[c];
+            }
+        };
+
+        // Horizontally resampled copies of the two source rows around the current output row
+        std::vector<float> lower(newNx);
+        std::vector<float> upper(newNx);
+        int lowerRow = -1;
+        const float scaleY = newNy > 1 ? float(ny - 1) / float(newNy - 1) : 0.0f;
+        for (int r = 0; r < newNy; r++) {
+            const float y = r * scaleY;
+            const int row = Math::Min(int(y), ny - 2);
+            const float w = y - row;
+            if (row != lowerRow) {
+                if (lowerRow >= 0 && row == lowerRow + 1) {
+                    std::swap(lower, upper);
+                }
+                else {
+                    resampleRow(row, lower.data());
+                }
+                resampleRow(row + 1, upper.data());
+                lowerRow = row;
+            }
+
+            float *out = field.values.data() + size_t(r) * newNx;
+            for (int c = 0; c < newNx; c++) {
+                out[c] = lower[c] + (upper[c] - lower[c]) * w;
+            }
+        }
+        return field;
+    }
+
     /*!
 	\brief Fill all the field with a given value.
 	*/
@@ -578,4 +862,114 @@ class ScalarField2D {
 	\brief Compute the memory used by the field.
 	*/
     inline int Memory() const { return sizeof(ScalarField2D) + sizeof(float) * int(values.size()); }
+
+   private:
+    // Shared by the batch bilinear queries; any of value, gx and gy may be null. The 8 wide gather
+    // path needs AVX2, which FARLOR_ENABLE_AVX2 turns on for the engine; otherwise every point
+    // takes the scalar loop.
+    inline void SampleBilinear(
+          const float *px, const float *py, float *value, float *gx, float *gy, int count) const
+    {
+        const Math::Vector2 o = box.Vertex(0);
+        const Math::Vector2 d = box.Vertex(1) - box.Vertex(0);
+        const float scaleU = float(nx - 1) / d[0];
+        const float scaleV = float(ny - 1) / d[1];
+
+        int k = 0;
+#if defined(__AVX2__)
+        const __m256 originX = _mm256_set1_ps(o[0]);
+        const __m256 originY = _mm256_set1_ps(o[1]);
+        const __m256 lanesScaleU = _mm256_set1_ps(scaleU);
+        const __m256 lanesScaleV = _mm256_set1_ps(scaleV);
+        const __m256i lastRow = _mm256_set1_epi32(ny - 1);
+        const __m256i lastColumn = _mm256_set1_epi32(nx - 1);
+        const __m256i rowStride = _mm256_set1_epi32(nx);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i minusOne = _mm256_set1_epi32(-1);
+        const __m256 onef = _mm256_set1_ps(1.0f);
+        for (; k + 8 <= count; k += 8) {
+            // Texel coordinates, truncated toward zero like GetValueBilinear
+            const __m256 fu
+                  = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(px + k), originX), lanesScaleU);
+            const __m256 fv
+                  = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(py + k), originY), lanesScaleV);
+            const __m256i j = _mm256_cvttps_epi32(fu);
+            const __m256i i = _mm256_cvttps_epi32(fv);
+            const __m256i insideRow = _mm256_and_si256(
+                  _mm256_cmpgt_epi32(i, minusOne), _mm256_cmpgt_epi32(lastRow, i));
+            const __m256i insideColumn = _mm256_and_si256(
+                  _mm256_cmpgt_epi32(j, minusOne), _mm256_cmpgt_epi32(lastColumn, j));
+            const __m256i inside = _mm256_and_si256(insideRow, insideColumn);
+            const __m256 mask = _mm256_castsi256_ps(inside);
+
+            // Outside lanes gather nothing
+            const __m256i index = _mm256_and_si256(
+                  _mm256_add_epi32(_mm256_mullo_epi32(i, rowStride), j), inside);
+            const __m256 zero = _mm256_setzero_ps();
+            const float *data = values.data();
+            const __m256i next = _mm256_add_epi32(index, rowStride);
+            const __m256 v1 = _mm256_mask_i32gather_ps(zero, data, index, mask, 4);
+            const __m256 v2 = _mm256_mask_i32gather_ps(zero, data, next, mask, 4);
+            const __m256 v3
+                  = _mm256_mask_i32gather_ps(zero, data, _mm256_add_epi32(next, one), mask, 4);
+            const __m256 v4
+                  = _mm256_mask_i32gather_ps(zero, data, _mm256_add_epi32(index, one), mask, 4);
+
+            const __m256 localU = _mm256_sub_ps(fu, _mm256_cvtepi32_ps(j));
+            const __m256 localV = _mm256_sub_ps(fv, _mm256_cvtepi32_ps(i));
+            const __m256 invU = _mm256_sub_ps(onef, localU);
+            const __m256 invV = _mm256_sub_ps(onef, localV);
+            if (value) {
+                const __m256 bottom
+                      = _mm256_add_ps(_mm256_mul_ps(invU, v1), _mm256_mul_ps(localU, v4));
+                const __m256 top
+                      = _mm256_add_ps(_mm256_mul_ps(invU, v2), _mm256_mul_ps(localU, v3));
+                const __m256 result
+                      = _mm256_add_ps(_mm256_mul_ps(invV, bottom), _mm256_mul_ps(localV, top));
+                _mm256_storeu_ps(value + k, _mm256_blendv_ps(_mm256_set1_ps(-1.0f), result, mask));
+            }
+            if (gx) {
+                const __m256 du = _mm256_add_ps(_mm256_mul_ps(invV, _mm256_sub_ps(v4, v1)),
+                      _mm256_mul_ps(localV, _mm256_sub_ps(v3, v2)));
+                _mm256_storeu_ps(gx + k, _mm256_and_ps(_mm256_mul_ps(du, lanesScaleU), mask));
+            }
+            if (gy) {
+                const __m256 dv = _mm256_add_ps(_mm256_mul_ps(invU, _mm256_sub_ps(v2, v1)),
+                      _mm256_mul_ps(localU, _mm256_sub_ps(v3, v4)));
+                _mm256_storeu_ps(gy + k, _mm256_and_ps(_mm256_mul_ps(dv, lanesScaleV), mask));
+            }
+        }
+#endif
+        for (; k < count; k++) {
+            const float fu = (px[k] - o[0]) * scaleU;
+            const float fv = (py[k] - o[1]) * scaleV;
+            const int j = int(fu);
+            const int i = int(fv);
+            if (i < 0 || i >= ny - 1 || j < 0 || j >= nx - 1) {
+                if (value)
+                    value[k] = -1.0f;
+                if (gx)
+                    gx[k] = 0.0f;
+                if (gy)
+                    gy[k] = 0.0f;
+                continue;
+            }
+
+            const float *row = values.data() + size_t(i) * nx + j;
+            const float v1 = row[0];
+            const float v4 = row[1];
+            const float v2 = row[nx];
+            const float v3 = row[nx + 1];
+            const float localU = fu - j;
+            const float localV = fv - i;
+            if (value) {
+                value[k] = (1 - localV) * ((1 - localU) * v1 + localU * v4)
+                      + localV * ((1 - localU) * v2 + localU * v3);
+            }
+            if (gx)
+                gx[k] = ((1 - localV) * (v4 - v1) + localV * (v3 - v2)) * scaleU;
+            if (gy)
+                gy[k] = ((1 - localU) * (v2 - v1) + localU * (v3 - v4)) * scaleV;
+        }
+    }
 };
@@ -1,6 +1,11 @@
 #pragma once
 #include <cmath>
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #include "vec.h"
+#include "../Desert/ParallelFor.h"
 
 static int Perm[512] = { 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140,
     36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0, 26, 197,
@@ -28,6 +33,113 @@ static int Perm[512] = { 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 19
     199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222,
     114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180 };
 
+/*!
+	\brief 4 wide SSE2 lanes for the batch noise functions.
+	*/
+struct NoiseLanes4 {
+    using Float = __m128;
+    using Int = __m128i;
+    static constexpr int Width = 4;
+
+    static inline Float Load(const float *p) { return _mm_loadu_ps(p); }
+    static inline void Store(float *p, Float v) { _mm_storeu_ps(p, v); }
+    static inline Float Set(float v) { return _mm_set1_ps(v); }
+    static inline Float Iota() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+    static inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+
+    // Truncate, then step down where that rounded up (negative values)
+    static inline Float Floor(Float x)
+    {
+        const Float t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+    }
+
+    static inline Int ToInt(Float x) { return _mm_cvttps_epi32(x); }
+    static inline Int AddInt(Int a, int b) { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+    static inline Int AddInt(Int a, Int b) { return _mm_add_epi32(a, b); }
+    static inline Int AndInt(Int a, int b) { return _mm_and_si128(a, _mm_set1_epi32(b)); }
+    static inline Int Less(Int a, int b) { return _mm_cmplt_epi32(a, _mm_set1_epi32(b)); }
+    static inline Int Equal(Int a, int b) { return _mm_cmpeq_epi32(a, _mm_set1_epi32(b)); }
+    static inline Int Or(Int a, Int b) { return _mm_or_si128(a, b); }
+
+    // No gather before AVX2, so look the permutation table up one lane at a time
+    static inline Int Lookup(const int *table, Int idx)
+    {
+        alignas(16) int i[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(i), idx);
+        return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+    }
+
+    static inline Float Select(Int mask, Float a, Float b)
+    {
+        const Float m = _mm_castsi128_ps(mask);
+        return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+    }
+
+    // Negates v in the lanes where h has the given bit set
+    static inline Float FlipSign(Float v, Int h, int bit)
+    {
+        const Int set = _mm_cmpeq_epi32(AndInt(h, bit), _mm_set1_epi32(bit));
+        return _mm_xor_ps(v, _mm_and_ps(_mm_castsi128_ps(set), _mm_set1_ps(-0.0f)));
+    }
+};
+
+#if defined(__AVX2__)
+/*!
+	\brief 8 wide AVX2 lanes for the batch noise functions.
+
+	Only compiled with /arch:AVX2, which FARLOR_ENABLE_AVX2 adds to the engine target. Without it
+	the batch functions fall back to NoiseLanes4.
+	*/
+struct NoiseLanes8 {
+    using Float = __m256;
+    using Int = __m256i;
+    static constexpr int Width = 8;
+
+    static inline Float Load(const float *p) { return _mm256_loadu_ps(p); }
+    static inline void Store(float *p, Float v) { _mm256_storeu_ps(p, v); }
+    static inline Float Set(float v) { return _mm256_set1_ps(v); }
+    static inline Float Iota()
+    {
+        return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    }
+    static inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static inline Float Floor(Float x) { return _mm256_floor_ps(x); }
+
+    static inline Int ToInt(Float x) { return _mm256_cvttps_epi32(x); }
+    static inline Int AddInt(Int a, int b) { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+    static inline Int AddInt(Int a, Int b) { return _mm256_add_epi32(a, b); }
+    static inline Int AndInt(Int a, int b) { return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+    static inline Int Less(Int a, int b) { return _mm256_cmpgt_epi32(_mm256_set1_epi32(b), a); }
+    static inline Int Equal(Int a, int b) { return _mm256_cmpeq_epi32(a, _mm256_set1_epi32(b)); }
+    static inline Int Or(Int a, Int b) { return _mm256_or_si256(a, b); }
+    static inline Int Lookup(const int *table, Int idx)
+    {
+        return _mm256_i32gather_epi32(table, idx, 4);
+    }
+
+    static inline Float Select(Int mask, Float a, Float b)
+    {
+        return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask));
+    }
+
+    static inline Float FlipSign(Float v, Int h, int bit)
+    {
+        const Int set = _mm256_cmpeq_epi32(AndInt(h, bit), _mm256_set1_epi32(bit));
+        return _mm256_xor_ps(v, _mm256_and_ps(_mm256_castsi256_ps(set), _mm256_set1_ps(-0.0f)));
+    }
+};
+
+// Widest lanes the build targets
+using NoiseLanes = NoiseLanes8;
+#else
+using NoiseLanes = NoiseLanes4;
+#endif
+
 class PerlinNoise {
    public:
     static inline float Gradient(int hash, float x, float y, float z)
@@ -95,4 +207,194 @@ class PerlinNoise {
         }
         return ret;
     }
+
+    /*
+	\brief Evaluates GetValue for count points stored as separate x, y and z arrays.
+	Matches the scalar path to within float rounding.
+	*/
+    template<typename L = NoiseLanes>
+    static inline void GetValues(
+          const float *x, const float *y, const float *z, float *out, int count)
+    {
+        int i = 0;
+        for (; i + L::Width <= count; i += L::Width) {
+            L::Store(out + i, GetValueLanes<L>(L::Load(x + i), L::Load(y + i), L::Load(z + i)));
+        }
+        for (; i < count; i++) {
+            out[i] = GetValue(Math::Vector3(x[i], y[i], z[i]));
+        }
+    }
+
+    /*
+	\brief Evaluates fBm for count points stored as separate x, y and z arrays.
+	*/
+    template<typename L = NoiseLanes>
+    static inline void fBmValues(const float *x, const float *y, const float *z, float *out,
+          int count, float a, float f, int o)
+    {
+        int i = 0;
+        for (; i + L::Width <= count; i += L::Width) {
+            L::Store(out + i,
+                  fBmLanes<L>(L::Load(x + i), L::Load(y + i), L::Load(z + i), a, f, o));
+        }
+        for (; i < count; i++) {
+            out[i] = fBm(Math::Vector3(x[i], y[i], z[i]), a, f, o);
+        }
+    }
+
+    /*
+	\brief Evaluates fBm at the count points start + step * i, writing one row of samples.
+	*/
+    template<typename L = NoiseLanes>
+    static inline void fBmRow(const Math::Vector3 &start, const Math::Vector3 &step, int count,
+          float a, float f, int o, float *out)
+    {
+        const typename L::Float iota = L::Iota();
+        int i = 0;
+        for (; i + L::Width <= count; i += L::Width) {
+            const typename L::Float idx = L::Add(L::Set(float(i)), iota);
+            const typename L::Float x = L::Add(L::Set(start.x), L::Mul(L::Set(step.x), idx));
+            const typename L::Float y = L::Add(L::Set(start.y), L::Mul(L::Set(step.y), idx));
+            const typename L::Float z = L::Add(L::Set(start.z), L::Mul(L::Set(step.z), idx));
+            L::Store(out + i, fBmLanes<L>(x, y, z, a, f, o));
+        }
+        for (; i < count; i++) {
+            const float idx = float(i);
+            const Math::Vector3 p(
+                  start.x + step.x * idx, start.y + step.y * idx, start.z + step.z * idx);
+            out[i] = fBm(p, a, f, o);
+        }
+    }
+
+    /*
+	\brief Fills a row major width x height grid with fBm sampled at
+	origin + stepX * x + stepY * y. Square tiles are spread over numThreads threads
+	(0 uses every hardware thread).
+	*/
+    template<typename L = NoiseLanes>
+    static inline void fBmGrid(const Math::Vector3 &origin, const Math::Vector3 &stepX,
+          const Math::Vector3 &stepY, int width, int height, float a, float f, int o, float *out,
+          int numThreads = 0, int tileSize = 64)
+    {
+        if (width <= 0 || height <= 0) {
+            return;
+        }
+        const int tilesX = (width + tileSize - 1) / tileSize;
+        const int tilesY = (height + tileSize - 1) / tileSize;
+        Farlor::ParallelFor(uint32_t(tilesX * tilesY), uint32_t(numThreads), [&](uint32_t tile) {
+            const int x0 = (int(tile) % tilesX) * tileSize;
+            const int y0 = (int(tile) / tilesX) * tileSize;
+            const int x1 = Math::Min(x0 + tileSize, width);
+            const int y1 = Math::Min(y0 + tileSize, height);
+            for (int y = y0; y < y1; y++) {
+                const float fx = float(x0);
+                const float fy = float(y);
+                const Math::Vector3 start(origin.x + stepX.x * fx + stepY.x * fy,
+                      origin.y + stepX.y * fx + stepY.y * fy,
+                      origin.z + stepX.z * fx + stepY.z * fy);
+                fBmRow<L>(start, stepX, x1 - x0, a, f, o, out + size_t(y) * width + x0);
+            }
+        });
+    }
+
+   private:
+    template<typename L>
+    static inline typename L::Float GradientLanes(typename L::Int hash, typename L::Float x,
+          typename L::Float y, typename L::Float z)
+    {
+        const typename L::Int h = L::AndInt(hash, 15);
+        const typename L::Float u = L::Select(L::Less(h, 8), x, y);
+        const typename L::Float v = L::Select(
+              L::Less(h, 4), y, L::Select(L::Or(L::Equal(h, 12), L::Equal(h, 14)), x, z));
+        return L::Add(L::FlipSign(u, h, 1), L::FlipSign(v, h, 2));
+    }
+
+    // Same operation order as Math::Lerp and Math::QuinticSmooth
+    template<typename L>
+    static inline typename L::Float LerpLanes(
+          typename L::Float a, typename L::Float b, typename L::Float t)
+    {
+        return L::Add(L::Mul(L::Sub(L::Set(1.0f), t), a), L::Mul(t, b));
+    }
+
+    template<typename L>
+    static inline typename L::Float QuinticSmoothLanes(typename L::Float t)
+    {
+        const typename L::Float t3 = L::Mul(L::Mul(t, t), t);
+        const typename L::Float inner = L::Sub(L::Mul(t, L::Set(6.0f)), L::Set(15.0f));
+        return L::Mul(t3, L::Add(L::Mul(t, inner), L::Set(10.0f)));
+    }
+
+    template<typename L>
+    static inline typename L::Float GetValueLanes(
+          typename L::Float x, typename L::Float y, typename L::Float z)
+    {
+        using Float = typename L::Float;
+        using Int = typename L::Int;
+
+        // Unit coordinates in cube
+        const Float floorX = L::Floor(x);
+        const Float floorY = L::Floor(y);
+        const Float floorZ = L::Floor(z);
+        const Int unitX = L::AndInt(L::ToInt(floorX), 255);
+        const Int unitY = L::AndInt(L::ToInt(floorY), 255);
+        const Int unitZ = L::AndInt(L::ToInt(floorZ), 255);
+
+        // Relative coordinates in cube
+        x = L::Sub(x, floorX);
+        y = L::Sub(y, floorY);
+        z = L::Sub(z, floorZ);
+        const Float one = L::Set(1.0f);
+        const Float x1 = L::Sub(x, one);
+        const Float y1 = L::Sub(y, one);
+        const Float z1 = L::Sub(z, one);
+
+        // Compute fading coefficients
+        const Float u = QuinticSmoothLanes<L>(x);
+        const Float v = QuinticSmoothLanes<L>(y);
+        const Float w = QuinticSmoothLanes<L>(z);
+
+        // Hash cube coordinates
+        const Int a = L::AddInt(L::Lookup(Perm, unitX), unitY);
+        const Int aa = L::AddInt(L::Lookup(Perm, a), unitZ);
+        const Int ab = L::AddInt(L::Lookup(Perm, L::AddInt(a, 1)), unitZ);
+        const Int b = L::AddInt(L::Lookup(Perm, L::AddInt(unitX, 1)), unitY);
+        const Int ba = L::AddInt(L::Lookup(Perm, b), unitZ);
+        const Int bb = L::AddInt(L::Lookup(Perm, L::AddInt(b, 1)), unitZ);
+
+        // Interpolate results
+        const Float l1 = LerpLanes<L>(GradientLanes<L>(L::Lookup(Perm, aa), x, y, z),
+              GradientLanes<L>(L::Lookup(Perm, ba), x1, y, z), u);
+        const Float l2 = LerpLanes<L>(GradientLanes<L>(L::Lookup(Perm, ab), x, y1, z),
+              GradientLanes<L>(L::Lookup(Perm, bb), x1, y1, z), u);
+        const Float l3
+              = LerpLanes<L>(GradientLanes<L>(L::Lookup(Perm, L::AddInt(aa, 1)), x, y, z1),
+                    GradientLanes<L>(L::Lookup(Perm, L::AddInt(ba, 1)), x1, y, z1), u);
+        const Float l4
+              = LerpLanes<L>(GradientLanes<L>(L::Lookup(Perm, L::AddInt(ab, 1)), x, y1, z1),
+                    GradientLanes<L>(L::Lookup(Perm, L::AddInt(bb, 1)), x1, y1, z1), u);
+        const Float l5 = LerpLanes<L>(l1, l2, v);
+        const Float l6 = LerpLanes<L>(l3, l4, v);
+
+        return LerpLanes<L>(l5, l6, w);
+    }
+
+    template<typename L>
+    static inline typename L::Float fBmLanes(
+          typename L::Float x, typename L::Float y, typename L::Float z, float a, float f, int o)
+    {
+        typename L::Float ret = L::Set(0.0f);
+        const typename L::Float half = L::Set(0.5f);
+        float freq = f;
+        float amp = a;
+        for (int i = 0; i < o; i++) {
+            const typename L::Float scale = L::Set(freq);
+            const typename L::Float n
+                  = GetValueLanes<L>(L::Mul(x, scale), L::Mul(y, scale), L::Mul(z, scale));
+            ret = L::Add(ret, L::Mul(L::Add(L::Mul(n, half), half), L::Set(amp)));
+            amp *= 0.5f;
+            freq *= 2.0f;
+        }
+        return ret;
+    }
 };
@@ -259,7 +259,7 @@ void LargeScaleDesertModel::FirstFrameSetup(
 }
 
 
-bool LargeScaleDesertModel::StepDesertSimulation(
+void LargeScaleDesertModel::ProcessPendingRequests(
       ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf)
 {
     if (m_resetRequested) {
@@ -271,7 +271,11 @@ bool LargeScaleDesertModel::StepDesertSimulation(
     if (m_updateCachedTerrainRequested) {
         UpdateCachedTerrainValues(pDeviceContext);
     }
+}
 
+bool LargeScaleDesertModel::StepDesertSimulation(
+      ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf)
+{
     // Early out of actually performing the heavyweight updates. We only want to allow for the basic updates.
     if (!m_stepSimulation) {
         return true;
@@ -20,6 +20,8 @@
 #include <imgui.h>
 
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <winnls.h>
 
 namespace Farlor {
@@ -84,9 +86,12 @@ LargeScaleDesertModel_Rasterization::LargeScaleDesertModel_Rasterization(
             DXGI_FORMAT_R32_FLOAT)
     , m_heightmapReadBack("LargeScale_Rasterized_HeightmapReadBack", gridResolution, gridResolution,
             DXGI_FORMAT_R32_FLOAT)
+    , m_blocksReadBack("LargeScale_Rasterized_BlocksReadBack", gridResolution, gridResolution,
+            DXGI_FORMAT_R32_SINT)
     , m_transportedSandTexture("LargeScale_Rasterized_TransportedSandTexture", gridResolution,
             gridResolution, DXGI_FORMAT_R32_FLOAT)
     , m_pSandTransportRS(nullptr)
+    , m_upHistory(std::make_unique<DesertHistory>(16, size_t(512) * 1024 * 1024))
 {
 }
 
@@ -100,17 +105,22 @@ void LargeScaleDesertModel_Rasterization::SetupDesertSimulation(ID3D11Device *co
         bedrockHeights[i] = initialBedrockHeights[i] / m_desertSimulationBlockHeight;
     }
 
-    std::vector<uint32_t> initialObjectMask(m_gridResolution * m_gridResolution, 0);
+    auto spObstacleCells = std::make_shared<BitGrid>(m_gridResolution);
     // {
     //     int wallColumn = floor(m_gridResolution / 2.0f);
     //     for (int rowIdx = 0; rowIdx < m_gridResolution; rowIdx++) {
-    //         initialObjectMask[rowIdx * m_gridResolution + wallColumn] = 1;
+    //         spObstacleCells->Set(wallColumn, rowIdx, true);
     //     }
     //     wallColumn = ceil(m_gridResolution / 2.0f);
     //     for (int rowIdx = 0; rowIdx < m_gridResolution; rowIdx++) {
-    //         initialObjectMask[rowIdx * m_gridResolution + wallColumn] = 1;
+    //         spObstacleCells->Set(wallColumn, rowIdx, true);
     //     }
     // }
+    m_spObstacleCells = spObstacleCells;
+
+    // The shaders still read one uint per cell, so only the upload is unpacked
+    std::vector<uint32_t> initialObjectMask;
+    m_spObstacleCells->CopyTo(initialObjectMask);
 
     std::vector<int32_t> sandHeights(initialSandHeights.size());
     for (int i = 0; i < initialSandHeights.size(); i++) {
@@ -168,6 +178,24 @@ void LargeScaleDesertModel_Rasterization::SetupDesertSimulation(ID3D11Device *co
     m_windShadow.Initialize(pDevice);
     m_vegitationMask.Initialize(pDevice, initialVegetation.data());
     m_heightmapReadBack.Initialize(pDevice);
+    m_blocksReadBack.Initialize(pDevice);
+    {
+        D3D11_TEXTURE2D_DESC readbackDesc;
+        m_blocksReadBack.GetTexture()->GetDesc(&readbackDesc);
+        for (uint32_t slotIdx = 0; slotIdx < NumHistoryReadbacks; slotIdx++) {
+            HistoryReadback &readback = m_historyReadbacks[slotIdx];
+            pDevice->CreateTexture2D(
+                  &readbackDesc, nullptr, readback.m_pSandBlocks.ReleaseAndGetAddressOf());
+            pDevice->CreateTexture2D(
+                  &readbackDesc, nullptr, readback.m_pBedrockBlocks.ReleaseAndGetAddressOf());
+            assert(readback.m_pSandBlocks && readback.m_pBedrockBlocks
+                  && "Failed to create history readback textures");
+            SetDebugObjectName(readback.m_pSandBlocks.Get(),
+                  "LargeScale_Rasterized_HistorySandReadBack_" + std::to_string(slotIdx));
+            SetDebugObjectName(readback.m_pBedrockBlocks.Get(),
+                  "LargeScale_Rasterized_HistoryBedrockReadBack_" + std::to_string(slotIdx));
+        }
+    }
 
     m_transportedSandTexture.Initialize(pDevice);
 
@@ -373,7 +401,7 @@ void LargeScaleDesertModel_Rasterization::FirstFrameSetup(
 }
 
 
-bool LargeScaleDesertModel_Rasterization::StepDesertSimulation(
+void LargeScaleDesertModel_Rasterization::ProcessPendingRequests(
       ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf)
 {
     if (m_resetRequested) {
@@ -386,6 +414,128 @@ bool LargeScaleDesertModel_Rasterization::StepDesertSimulation(
         UpdateCachedTerrainValues(pDeviceContext);
     }
 
+    if (m_forkRequested) {
+        pPerf->BeginEvent(L"Fork Event");
+        DesertState state = CaptureState(pDeviceContext);
+        m_branches.push_back(state.Fork("Branch " + std::to_string(m_branches.size())));
+        m_forkRequested = false;
+        pPerf->EndEvent();
+    }
+
+    if (m_restoreBranchIdx >= 0) {
+        pPerf->BeginEvent(L"Restore Branch Event");
+        RestoreState(pDeviceContext, m_branches[m_restoreBranchIdx]);
+        m_restoreBranchIdx = -1;
+        pPerf->EndEvent();
+    }
+
+    if (m_restoreScrubStepRequested) {
+        pPerf->BeginEvent(L"Restore History Event");
+        DesertState state(m_gridResolution, m_cellSizeMeters, m_desertSimulationBlockHeight);
+        if (m_upHistory->Seek(m_scrubStepIdx, state)) {
+            RestoreState(pDeviceContext, state);
+            m_stepIdx = state.GetStepIdx();
+            m_lastRecordedStepIdx = m_stepIdx;
+        }
+        m_restoreScrubStepRequested = false;
+        pPerf->EndEvent();
+    }
+
+    ResolveHistoryReadbacks(pDeviceContext);
+
+    const bool recordDue = (m_stepIdx != m_lastRecordedStepIdx)
+          && ((m_stepIdx % std::max(m_historyRecordInterval, 1u)) == 0);
+    if (m_recordHistory && recordDue) {
+        pPerf->BeginEvent(L"Record History Event");
+        RequestHistoryReadback(pDeviceContext);
+        m_lastRecordedStepIdx = m_stepIdx;
+        pPerf->EndEvent();
+    }
+
+    if (m_validateKernelsRequested) {
+        pPerf->BeginEvent(L"Validate Kernels Event");
+        DesertState state = CaptureState(pDeviceContext);
+        state.SetStepIdx(m_stepIdx);
+
+        m_validationReport.clear();
+        const DesertValidationConfig config;
+        for (const DesertValidationResult &result : DesertValidator::Validate(state, config)) {
+            m_validationReport.push_back(result.ToString());
+            if (!result.m_passed) {
+                FARLOR_LOG_ERROR("Desert kernel validation failed, {}", m_validationReport.back());
+            }
+        }
+        m_validateKernelsRequested = false;
+        pPerf->EndEvent();
+    }
+
+    if (m_cpuRunRequested) {
+        pPerf->BeginEvent(L"CPU Fast Forward Event");
+        DesertState state = CaptureState(pDeviceContext);
+
+        TiledDesertKernels kernels;
+        kernels.SetTransportMode(m_cpuMeanFieldTransport ? DesertTransportMode::MeanField
+                                                         : DesertTransportMode::Stochastic);
+        kernels.Load(state);
+
+        // Sand is only ever moved, so the total must hold up to the float error of the mean
+        // field fractions
+        const TiledGrid<int32_t> &sandBlocks = state.GetSandBlocks();
+        const uint32_t tileCells = sandBlocks.GetTileSize() * sandBlocks.GetTileSize();
+        int64_t initialSand = 0;
+        for (uint32_t tileIdx = 0; tileIdx < sandBlocks.GetTileCount(); tileIdx++) {
+            const int32_t *pTile = sandBlocks.GetTileData(tileIdx);
+            for (uint32_t cellIdx = 0; cellIdx < tileCells; cellIdx++) {
+                initialSand += pTile[cellIdx];
+            }
+        }
+        const double sandTolerance = m_cpuMeanFieldTransport ? 1e-3 * double(initialSand) : 0.0;
+        bool conservationWarned = false;
+
+        for (uint32_t stepOffset = 0; stepOffset < m_cpuRunSteps; stepOffset++) {
+            kernels.Step(m_stepIdx + stepOffset);
+
+            const uint64_t stepIdx = m_stepIdx + stepOffset + 1;
+            const DesertStatistics &statistics = kernels.GetStepStatistics();
+            const double sandError = std::abs(statistics.GetTotalSand() - double(initialSand));
+            if (!conservationWarned && (sandError > sandTolerance)) {
+                FARLOR_LOG_WARNING("Sand not conserved at step {}: {:.3f} blocks, started with {}",
+                      stepIdx, statistics.GetTotalSand(), initialSand);
+                conservationWarned = true;
+            }
+
+            if ((m_spectrumLogInterval > 0) && ((stepIdx % m_spectrumLogInterval) == 0)) {
+                kernels.Store(state);
+                state.SetStepIdx(stepIdx);
+                m_lastSpectrumReport = m_spectrumAnalyzer.Analyze(state).ToString();
+                FARLOR_LOG_INFO("Dune spectrum, {}", m_lastSpectrumReport);
+            }
+        }
+        kernels.Store(state);
+        m_cpuLastStatistics = kernels.GetStepStatistics().ToString();
+        FARLOR_LOG_INFO("CPU fast forward, {}", m_cpuLastStatistics);
+        FARLOR_LOG_INFO("CPU fast forward grids, {}", kernels.GetPlacement().ToString());
+
+        RestoreState(pDeviceContext, state);
+        m_stepIdx += m_cpuRunSteps;
+        m_cpuRunRequested = false;
+        pPerf->EndEvent();
+    }
+
+    if (m_spectrumRequested) {
+        pPerf->BeginEvent(L"Dune Spectrum Event");
+        DesertState state = CaptureState(pDeviceContext);
+        state.SetStepIdx(m_stepIdx);
+        m_lastSpectrumReport = m_spectrumAnalyzer.Analyze(state).ToString();
+        FARLOR_LOG_INFO("Dune spectrum, {}", m_lastSpectrumReport);
+        m_spectrumRequested = false;
+        pPerf->EndEvent();
+    }
+}
+
+bool LargeScaleDesertModel_Rasterization::StepDesertSimulation(
+      ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf)
+{
     // Early out of actually performing the heavyweight updates. We only want to allow for the basic updates.
     if (!m_stepSimulation) {
         return true;
@@ -398,7 +548,7 @@ bool LargeScaleDesertModel_Rasterization::StepDesertSimulation(
     m_desertSimParams.AccessData().m_desertBlockHeight = m_desertSimulationBlockHeight;
     m_desertSimParams.Update(pDeviceContext);
 
-    Farlor::Vector2 windDir = Farlor::Vector2(1.0, 0.0).Normalized() * m_baseWindSpeed;
+    Farlor::Vector2 windDir = m_baseWindDirection.Normalized() * m_baseWindSpeed;
     m_windGenerationParams.AccessData().m_windX = windDir.x;
     m_windGenerationParams.AccessData().m_windZ = windDir.y;
     m_windGenerationParams.Update(pDeviceContext);
@@ -1290,6 +1440,7 @@ bool LargeScaleDesertModel_Rasterization::StepDesertSimulation(
               m_previousCombinedHeightmap.GetTexture(), m_combinedHeightmap.GetTexture());
     }
 
+    m_stepIdx++;
     return true;
 }
 
@@ -1334,9 +1485,237 @@ void LargeScaleDesertModel_Rasterization::Gui()
               &m_numSandCascadePasses, &minVal, &maxVal);
     }
     ImGui::InputFloat("Wind Base Speed", &m_baseWindSpeed, 0.1f, 1.0f, "%.6f");
+    ImGui::SliderFloat2(
+          "Wind Base Direction", &m_baseWindDirection.m_data[0], -1.0f, 1.0f, "%.3f");
+
+    if (ImGui::TreeNode("Branches")) {
+        if (ImGui::Button("Fork Current State")) {
+            m_forkRequested = true;
+        }
+
+        size_t branchBytes = 0;
+        for (uint32_t branchIdx = 0; branchIdx < m_branches.size(); branchIdx++) {
+            const DesertState &branch = m_branches[branchIdx];
+            branchBytes += branch.GetSharedBytes();
+
+            ImGui::PushID(static_cast<int>(branchIdx));
+            ImGui::Text("%s: %u unique tiles", branch.GetBranchName().c_str(),
+                  branch.GetUniqueTileCount());
+            ImGui::SameLine();
+            if (ImGui::Button("Restore")) {
+                m_restoreBranchIdx = static_cast<int32_t>(branchIdx);
+            }
+            ImGui::PopID();
+        }
+        ImGui::Text("Branch memory: %.2f MB", branchBytes / (1024.0f * 1024.0f));
+        ImGui::TreePop();
+    }
+
+    if (ImGui::TreeNode("History")) {
+        ImGui::Checkbox("Record History", &m_recordHistory);
+        {
+            const uint32_t minVal = 1;
+            const uint32_t maxVal = 100;
+            ImGui::SliderScalar("Record Interval", ImGuiDataType_U32, &m_historyRecordInterval,
+                  &minVal, &maxVal);
+        }
+
+        if (!m_upHistory->IsEmpty()) {
+            const uint64_t firstStep = m_upHistory->GetFirstStep();
+            const uint64_t lastStep = m_upHistory->GetLastStep();
+            m_scrubStepIdx = std::clamp(m_scrubStepIdx, firstStep, lastStep);
+            ImGui::SliderScalar(
+                  "Scrub Step", ImGuiDataType_U64, &m_scrubStepIdx, &firstStep, &lastStep);
+            if (ImGui::Button("Restore Step")) {
+                m_restoreScrubStepRequested = true;
+            }
+        }
+        ImGui::Text("Step %llu, history memory: %.2f MB, dropped records: %llu", m_stepIdx,
+              m_upHistory->GetUsedBytes() / (1024.0f * 1024.0f),
+              m_upHistory->GetDroppedRecordCount() + m_droppedHistoryReadbacks);
+        ImGui::TreePop();
+    }
+
+    if (ImGui::TreeNode("Validation")) {
+        if (ImGui::Button("Validate CPU Kernels")) {
+            m_validateKernelsRequested = true;
+        }
+        for (const std::string &line : m_validationReport) {
+            ImGui::TextUnformatted(line.c_str());
+        }
+        ImGui::TreePop();
+    }
+
+    if (ImGui::TreeNode("CPU Simulation")) {
+        ImGui::Checkbox("Mean Field Transport", &m_cpuMeanFieldTransport);
+        {
+            const uint32_t minVal = 1;
+            const uint32_t maxVal = 10000;
+            ImGui::SliderScalar("Steps", ImGuiDataType_U32, &m_cpuRunSteps, &minVal, &maxVal);
+        }
+        if (ImGui::Button("Fast Forward On CPU")) {
+            m_cpuRunRequested = true;
+        }
+        if (!m_cpuLastStatistics.empty()) {
+            ImGui::TextWrapped("%s", m_cpuLastStatistics.c_str());
+        }
+        ImGui::TreePop();
+    }
+
+    if (ImGui::TreeNode("Dune Spectrum")) {
+        {
+            const uint32_t minVal = 0;
+            const uint32_t maxVal = 1000;
+            ImGui::SliderScalar("CPU Log Interval", ImGuiDataType_U32, &m_spectrumLogInterval,
+                  &minVal, &maxVal);
+        }
+        if (ImGui::Button("Analyze Current State")) {
+            m_spectrumRequested = true;
+        }
+        if (!m_lastSpectrumReport.empty()) {
+            ImGui::TextWrapped("%s", m_lastSpectrumReport.c_str());
+        }
+        ImGui::TreePop();
+    }
     ImGui::PopID();
 }
 
+DesertState LargeScaleDesertModel_Rasterization::CaptureState(
+      ID3D11DeviceContext *const pDeviceContext)
+{
+    pDeviceContext->CopyResource(m_blocksReadBack.GetTexture(), m_sandBlocksRead.GetTexture());
+    m_blocksReadBack.UpdateCachedValues(pDeviceContext);
+    const std::vector<int32_t> sandBlocks = m_blocksReadBack.CachedValues();
+
+    pDeviceContext->CopyResource(m_blocksReadBack.GetTexture(), m_bedrockBlocksRead.GetTexture());
+    m_blocksReadBack.UpdateCachedValues(pDeviceContext);
+    const std::vector<int32_t> &bedrockBlocks = m_blocksReadBack.CachedValues();
+
+    DesertState state(m_gridResolution, m_cellSizeMeters, m_desertSimulationBlockHeight,
+          sandBlocks, bedrockBlocks);
+    CaptureParameters(state);
+
+    // Captures taken a few steps apart differ in few tiles, so branches share the rest through the
+    // previous capture
+    if (m_upLastCapturedState) {
+        state.ShareUnchangedTiles(*m_upLastCapturedState);
+    }
+    m_upLastCapturedState = std::make_unique<DesertState>(state);
+    return state;
+}
+
+void LargeScaleDesertModel_Rasterization::CaptureParameters(DesertState &state)
+{
+    state.SetObstacles(m_spObstacleCells);
+
+    DesertParameters &parameters = state.AccessParameters();
+    parameters.m_windDirectionX = m_baseWindDirection.x;
+    parameters.m_windDirectionZ = m_baseWindDirection.y;
+    parameters.m_windSpeed = m_baseWindSpeed;
+    parameters.m_maxTransportSteps = m_sandTransportParams.AccessData().maxTransportSteps;
+    parameters.m_targetBlocksToMove = m_sandTransportParams.AccessData().targetBlocksToMove;
+    parameters.m_numSandCascadePasses = m_numSandCascadePasses;
+}
+
+void LargeScaleDesertModel_Rasterization::RequestHistoryReadback(
+      ID3D11DeviceContext *const pDeviceContext)
+{
+    // Every slot still waiting on the GPU means it is frames behind, skip rather than stall
+    if (m_numPendingHistoryReadbacks == NumHistoryReadbacks) {
+        m_droppedHistoryReadbacks++;
+        return;
+    }
+
+    HistoryReadback &readback = m_historyReadbacks[m_nextHistoryReadback];
+    pDeviceContext->CopyResource(readback.m_pSandBlocks.Get(), m_sandBlocksRead.GetTexture());
+    pDeviceContext->CopyResource(readback.m_pBedrockBlocks.Get(), m_bedrockBlocksRead.GetTexture());
+
+    readback.m_upState = std::make_unique<DesertState>(
+          m_gridResolution, m_cellSizeMeters, m_desertSimulationBlockHeight);
+    readback.m_upState->SetStepIdx(m_stepIdx);
+    CaptureParameters(*readback.m_upState);
+
+    m_nextHistoryReadback = (m_nextHistoryReadback + 1) % NumHistoryReadbacks;
+    m_numPendingHistoryReadbacks++;
+}
+
+void LargeScaleDesertModel_Rasterization::ResolveHistoryReadbacks(
+      ID3D11DeviceContext *const pDeviceContext)
+{
+    const auto readBlocks = [this, pDeviceContext](
+                                  ID3D11Texture2D *const pTexture, std::vector<int32_t> &blocks) {
+        D3D11_MAPPED_SUBRESOURCE mappedResource;
+        if (FAILED(pDeviceContext->Map(
+                  pTexture, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource))) {
+            return false;
+        }
+
+        blocks.resize(size_t(m_gridResolution) * m_gridResolution);
+        for (uint32_t y = 0; y < m_gridResolution; y++) {
+            const uint8_t *const pRow = static_cast<const uint8_t *>(mappedResource.pData)
+                  + size_t(y) * mappedResource.RowPitch;
+            std::memcpy(blocks.data() + size_t(y) * m_gridResolution, pRow,
+                  m_gridResolution * sizeof(int32_t));
+        }
+        pDeviceContext->Unmap(pTexture, 0);
+        return true;
+    };
+
+    while (m_numPendingHistoryReadbacks > 0) {
+        const uint32_t slotIdx
+              = (m_nextHistoryReadback + NumHistoryReadbacks - m_numPendingHistoryReadbacks)
+              % NumHistoryReadbacks;
+        HistoryReadback &readback = m_historyReadbacks[slotIdx];
+
+        // The bedrock copy was queued last, so it is checked first
+        std::vector<int32_t> sandBlocks;
+        std::vector<int32_t> bedrockBlocks;
+        if (!readBlocks(readback.m_pBedrockBlocks.Get(), bedrockBlocks)
+              || !readBlocks(readback.m_pSandBlocks.Get(), sandBlocks)) {
+            break;
+        }
+
+        // The recorder thread tiles the grids, this thread only copies the rows out
+        m_upHistory->Record(*readback.m_upState, std::move(sandBlocks), std::move(bedrockBlocks));
+        readback.m_upState = nullptr;
+        m_numPendingHistoryReadbacks--;
+    }
+}
+
+void LargeScaleDesertModel_Rasterization::RestoreState(
+      ID3D11DeviceContext *const pDeviceContext, const DesertState &state)
+{
+    assert(state.GetGridResolution() == m_gridResolution && "Branch resolution mismatch");
+
+    // Records still in flight belong to the timeline being replaced
+    for (HistoryReadback &readback : m_historyReadbacks) {
+        readback.m_upState = nullptr;
+    }
+    m_numPendingHistoryReadbacks = 0;
+
+    std::vector<int32_t> blocks;
+    const uint32_t rowPitch = m_gridResolution * sizeof(int32_t);
+
+    state.GetSandBlocks().CopyTo(blocks);
+    pDeviceContext->UpdateSubresource(
+          m_sandBlocksRead.GetTexture(), 0, nullptr, blocks.data(), rowPitch, 0);
+    pDeviceContext->UpdateSubresource(
+          m_sandBlocksWrite.GetTexture(), 0, nullptr, blocks.data(), rowPitch, 0);
+
+    state.GetBedrockBlocks().CopyTo(blocks);
+    pDeviceContext->UpdateSubresource(
+          m_bedrockBlocksRead.GetTexture(), 0, nullptr, blocks.data(), rowPitch, 0);
+    pDeviceContext->UpdateSubresource(
+          m_bedrockBlocksWrite.GetTexture(), 0, nullptr, blocks.data(), rowPitch, 0);
+
+    const DesertParameters &parameters = state.GetParameters();
+    m_baseWindDirection = Farlor::Vector2(parameters.m_windDirectionX, parameters.m_windDirectionZ);
+    m_baseWindSpeed = parameters.m_windSpeed;
+    m_sandTransportParams.AccessData().maxTransportSteps = parameters.m_maxTransportSteps;
+    m_sandTransportParams.AccessData().targetBlocksToMove = parameters.m_targetBlocksToMove;
+    m_numSandCascadePasses = parameters.m_numSandCascadePasses;
+}
+
 void LargeScaleDesertModel_Rasterization::UpdateCachedTerrainValues(
       ID3D11DeviceContext *const pDeviceContext)
 {
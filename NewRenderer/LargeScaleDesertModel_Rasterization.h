@@ -3,6 +3,12 @@
 #include "ManagedConstantBuffer.h"
 #include "ManagedTexture2D.h"
 
+#include "Desert/DesertHistory.h"
+#include "Desert/DesertState.h"
+#include "Desert/DesertValidation.h"
+#include "Desert/DuneSpectrum.h"
+#include "Desert/TiledDesertKernels.h"
+
 #include <DirectXMath.h>
 #include <d3d11.h>
 #include <d3d11_1.h>
@@ -16,7 +22,9 @@
 
 #include <FMath/FMath.h>
 
+#include <array>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace Farlor {
@@ -67,6 +75,9 @@ class LargeScaleDesertModel_Rasterization {
           ID3D11DeviceContext *const pDeviceContext, const std::vector<float> &initialSandHeights,
           const std::vector<float> &initialBedrockHeights,
           const std::vector<float> &initialVegitation);
+    // Handles reset and readback requests. Must run on the immediate context.
+    void ProcessPendingRequests(
+          ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf);
     bool StepDesertSimulation(
           ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf);
 
@@ -75,6 +86,7 @@ class LargeScaleDesertModel_Rasterization {
 
     void Gui();
 
+    const std::string &GetSimulationId() const { return m_simulationId; }
     uint32_t GetGridResolution() const { return m_gridResolution; }
     float GetCellSizeMeters() const { return m_cellSizeMeters; }
 
@@ -84,6 +96,7 @@ class LargeScaleDesertModel_Rasterization {
     ID3D11ShaderResourceView *GetBedrockHeightmap() { return m_bedrockHeightmap.GetSRV(); }
     ID3D11ShaderResourceView *GetHeightmapNormals() { return m_heightmapNormals.GetSRV(); }
     ID3D11ShaderResourceView *GetObstacleMask() { return m_obstacleMask.GetSRV(); }
+    const BitGrid &GetObstacleCells() const { return *m_spObstacleCells; }
 
     void Reset(ID3D11DeviceContext *const pDeviceContext)
     {
@@ -120,11 +133,32 @@ class LargeScaleDesertModel_Rasterization {
     bool WasTerrainUpdated() { return m_cachedTerrainUpdated; }
     void HandleTerrainUpdated() { m_cachedTerrainUpdated = false; }
 
+    // Reads the block grids back from the GPU. Must run on the immediate context.
+    DesertState CaptureState(ID3D11DeviceContext *const pDeviceContext);
+    void RestoreState(ID3D11DeviceContext *const pDeviceContext, const DesertState &state);
+
+    const std::vector<DesertState> &GetBranches() const { return m_branches; }
+
+   private:
+    // A block grid copy in flight to the CPU, along with the step and parameters it was taken at
+    struct HistoryReadback {
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> m_pSandBlocks = nullptr;
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> m_pBedrockBlocks = nullptr;
+        std::unique_ptr<DesertState> m_upState = nullptr;
+    };
+    static constexpr uint32_t NumHistoryReadbacks = 3;
+
    private:
     void DoBedrockCascadePass(
           ID3D11DeviceContext *pDeviceContext, ID3DUserDefinedAnnotation *pPerf);
     void DoSandCascadePass(ID3D11DeviceContext *pDeviceContext, ID3DUserDefinedAnnotation *pPerf);
 
+    void CaptureParameters(DesertState &state);
+    // Copies the block grids into a free readback slot without waiting on the GPU
+    void RequestHistoryReadback(ID3D11DeviceContext *const pDeviceContext);
+    // Hands every readback the GPU has finished to the history, oldest first
+    void ResolveHistoryReadbacks(ID3D11DeviceContext *const pDeviceContext);
+
    private:
     Renderer &m_renderer;
     std::string m_simulationId = "";
@@ -148,6 +182,44 @@ class LargeScaleDesertModel_Rasterization {
 
     std::vector<float> m_latestCachedHeightmapValues;
 
+    // What-if branches forked from the running simulation
+    std::vector<DesertState> m_branches;
+    bool m_forkRequested = false;
+    // Last captured state. New captures share its tiles wherever the contents did not change.
+    std::unique_ptr<DesertState> m_upLastCapturedState = nullptr;
+    int32_t m_restoreBranchIdx = -1;
+
+    // Scrubbable history, recorded from GPU readbacks every m_historyRecordInterval steps
+    std::unique_ptr<DesertHistory> m_upHistory = nullptr;
+    bool m_recordHistory = false;
+    uint32_t m_historyRecordInterval = 10;
+    uint64_t m_stepIdx = 0;
+    uint64_t m_lastRecordedStepIdx = UINT64_MAX;
+    uint64_t m_scrubStepIdx = 0;
+    bool m_restoreScrubStepRequested = false;
+    // Records are mapped a frame or more after their copy, so recording never stalls on the GPU
+    std::array<HistoryReadback, NumHistoryReadbacks> m_historyReadbacks;
+    uint32_t m_nextHistoryReadback = 0;
+    uint32_t m_numPendingHistoryReadbacks = 0;
+    uint64_t m_droppedHistoryReadbacks = 0;
+
+    // Golden hash check of the CPU desert kernels against the reference, run on a captured state
+    bool m_validateKernelsRequested = false;
+    std::vector<std::string> m_validationReport;
+
+    // Fast forward on the CPU kernels, optionally with the mean field transport
+    bool m_cpuRunRequested = false;
+    bool m_cpuMeanFieldTransport = false;
+    uint32_t m_cpuRunSteps = 100;
+    // Statistics of the last fast forwarded step
+    std::string m_cpuLastStatistics;
+
+    // Dune spectrum of a captured state, and every m_spectrumLogInterval CPU steps (0 is off)
+    bool m_spectrumRequested = false;
+    uint32_t m_spectrumLogInterval = 0;
+    DuneSpectrumAnalyzer m_spectrumAnalyzer;
+    std::string m_lastSpectrumReport;
+
     // Resources for Sand Sim
     ManagedTexture2D<uint32_t> m_desertRandomStatesTexture;
 
@@ -180,11 +252,13 @@ class LargeScaleDesertModel_Rasterization {
     ManagedTexture2D<Farlor::Vector2> m_gradientMapRadius50;
 
     ManagedTexture2D<uint32_t> m_obstacleMask;
+    std::shared_ptr<const BitGrid> m_spObstacleCells = nullptr;
 
     ManagedTexture2D<Farlor::Vector2> m_windTexture;
     ManagedTexture2D<float> m_windShadow;
     ManagedTexture2D<float> m_vegitationMask;
     ManagedTexture2DStaging<float> m_heightmapReadBack;
+    ManagedTexture2DStaging<int32_t> m_blocksReadBack;
 
     ManagedConstantBuffer<cbDesertSimParams> m_desertSimParams;
     ManagedConstantBuffer<cbWindGenerationParams> m_windGenerationParams;
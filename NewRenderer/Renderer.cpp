@@ -794,12 +794,54 @@ void Renderer::Initialize(const GameWindow &gameWindow)
           m_height, agz::smaa::EdgeDetectionMode::Lum);
 }
 
-bool Renderer::StepDesertSimulation()
+void Renderer::SetupSimulationScheduling()
+{
+    auto registerSimulation = [this](const std::string &simulationId, float targetRateHz,
+                                    float frameBudgetMs, auto &model) {
+        SimulationContext &context = m_simulationContexts[simulationId];
+
+        HRESULT result
+              = m_pDevice->CreateDeferredContext(0, context.m_pDeferredContext.GetAddressOf());
+        assert(SUCCEEDED(result) && "Failed to create simulation deferred context");
+        result = context.m_pDeferredContext.As(&context.m_pPerf);
+        assert(SUCCEEDED(result) && "Failed to query simulation deferred context annotation");
+        SetDebugObjectName(context.m_pDeferredContext.Get(), simulationId + " Deferred Context");
+
+        m_simulationScheduler.RegisterSimulation(
+              simulationId, targetRateHz, frameBudgetMs, [&model, &context]() {
+                  return model.StepDesertSimulation(
+                        context.m_pDeferredContext.Get(), context.m_pPerf.Get());
+              });
+    };
+
+    registerSimulation(m_largeScaleDuneModel.GetSimulationId(), 5.0f, 8.0f, m_largeScaleDuneModel);
+    registerSimulation(
+          m_smallScaleRippleModel.GetSimulationId(), 30.0f, 4.0f, m_smallScaleRippleModel);
+}
+
+bool Renderer::StepDesertSimulation(const float dt)
 {
     m_simulationStepCount++;
 
-    m_largeScaleDuneModel.StepDesertSimulation(m_pDeviceContext.Get(), m_pPerf.Get());
-    m_smallScaleRippleModel.StepDesertSimulation(m_pDeviceContext.Get(), m_pPerf.Get());
+    // Resets and readbacks touch staging resources, so they stay on the immediate context
+    m_largeScaleDuneModel.ProcessPendingRequests(m_pDeviceContext.Get(), m_pPerf.Get());
+    m_smallScaleRippleModel.ProcessPendingRequests(m_pDeviceContext.Get(), m_pPerf.Get());
+
+    const std::vector<std::string> &steppedSimulations = m_simulationScheduler.Tick(dt);
+
+    // Submit in scheduler priority order so the simulation furthest behind reaches the GPU first
+    for (const std::string &simulationId : steppedSimulations) {
+        SimulationContext &context = m_simulationContexts.at(simulationId);
+
+        Microsoft::WRL::ComPtr<ID3D11CommandList> pCommandList = nullptr;
+        HRESULT result
+              = context.m_pDeferredContext->FinishCommandList(FALSE, pCommandList.GetAddressOf());
+        if (FAILED(result)) {
+            FARLOR_LOG_ERROR("Failed to finish command list for simulation {}", simulationId);
+            continue;
+        }
+        m_pDeviceContext->ExecuteCommandList(pCommandList.Get(), TRUE);
+    }
 
     return true;
 }
@@ -1075,6 +1117,8 @@ void Renderer::SetupDesertSimulation(
 
     m_largeScaleDuneModel.SetupDesertSimulation(m_pDevice.Get(), m_pDeviceContext.Get(),
           largeScaleSand, largeScaleBedrock, largeScaleVegetation);
+
+    SetupSimulationScheduling();
 }
 
 void Renderer::FirstFrameSetupWithShaders()
@@ -1123,7 +1167,7 @@ void Renderer::Render(const Camera &currentCamera, const float dt)
     }
 
     m_pPerf->BeginEvent(L"Desert Simulation Step");
-    StepDesertSimulation();
+    StepDesertSimulation(dt);
     m_pPerf->EndEvent();
     // Position clear color
     {
@@ -1535,6 +1579,10 @@ void Renderer::Render(const Camera &currentCamera, const float dt)
                   "Desert Grid Scale", &m_desertScale.m_data[0], 0.0f, 1024.0f, "%.3f");
         }
 
+        if (ImGui::CollapsingHeader("Simulation Scheduling")) {
+            m_simulationScheduler.Gui();
+        }
+
         if (ImGui::CollapsingHeader("Large Scale Desert Params", ImGuiTreeNodeFlags_DefaultOpen)) {
             m_largeScaleDuneModel.Gui();
         }
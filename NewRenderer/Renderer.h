@@ -20,6 +20,7 @@
 #include "RenderTarget.h"
 
 #include "DesertModels.h"
+#include "SimulationScheduler.h"
 
 #include "D3D11/D3D11_Utils.h"
 
@@ -136,7 +137,8 @@ class Renderer {
     void SetupSMAAResources();
     void SetupDesertSimulation(
           const float rMin, const float rMax, const Imf::Array2D<Imf::Rgba> &defaultValues);
-    bool StepDesertSimulation();
+    void SetupSimulationScheduling();
+    bool StepDesertSimulation(const float dt);
 
     void ExportFrame();
 
@@ -221,6 +223,14 @@ class Renderer {
     LargeScaleDesertModel_Rasterization m_largeScaleDuneModel;
     SmallScaleDesertModel m_smallScaleRippleModel;
 
+    // Each simulation records its steps into its own deferred context on a scheduler worker
+    struct SimulationContext {
+        Microsoft::WRL::ComPtr<ID3D11DeviceContext> m_pDeferredContext = nullptr;
+        Microsoft::WRL::ComPtr<ID3DUserDefinedAnnotation> m_pPerf = nullptr;
+    };
+    std::map<std::string, SimulationContext> m_simulationContexts;
+    SimulationScheduler m_simulationScheduler;
+
     Microsoft::WRL::ComPtr<ID3D11Texture2D> m_pEdgeTargetSMAA = nullptr;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_pEdgeTargetSRV = nullptr;
     Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_pEdgeTargetRTV = nullptr;
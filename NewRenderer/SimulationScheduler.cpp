@@ -0,0 +1,215 @@
+#include "SimulationScheduler.h"
+
+#include "../Util/Logger.h"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace Farlor {
+
+SimulationScheduler::SimulationScheduler(uint32_t maxCatchUpSteps)
+    : m_maxCatchUpSteps(maxCatchUpSteps)
+{
+    assert(maxCatchUpSteps > 0);
+}
+
+SimulationScheduler::~SimulationScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_workAvailable.notify_all();
+
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+}
+
+void SimulationScheduler::RegisterSimulation(const std::string &simulationId,
+      float targetRateHz, float frameBudgetMs, StepFunction stepFunction)
+{
+    assert(targetRateHz > 0.0f && "Simulation target rate must be positive");
+    assert(m_simulations.find(simulationId) == m_simulations.end()
+          && "Simulation id registered twice");
+
+    auto upSimulation = std::make_unique<ScheduledSimulation>();
+    upSimulation->m_simulationId = simulationId;
+    upSimulation->m_stepFunction = std::move(stepFunction);
+    upSimulation->m_windowStart = std::chrono::steady_clock::now();
+    upSimulation->m_stats.m_targetRateHz = targetRateHz;
+    upSimulation->m_stats.m_frameBudgetMs = frameBudgetMs;
+
+    m_simulations[simulationId] = std::move(upSimulation);
+}
+
+void SimulationScheduler::SetTargetRate(const std::string &simulationId, float targetRateHz)
+{
+    assert(targetRateHz > 0.0f && "Simulation target rate must be positive");
+    m_simulations.at(simulationId)->m_stats.m_targetRateHz = targetRateHz;
+}
+
+void SimulationScheduler::SetFrameBudget(const std::string &simulationId, float frameBudgetMs)
+{
+    m_simulations.at(simulationId)->m_stats.m_frameBudgetMs = frameBudgetMs;
+}
+
+const std::vector<std::string> &SimulationScheduler::Tick(float frameTimeSeconds)
+{
+    std::vector<ScheduledSimulation *> dueSimulations;
+    for (auto &[simulationId, upSimulation] : m_simulations) {
+        ScheduledSimulation &simulation = *upSimulation;
+        const double rate = simulation.m_stats.m_targetRateHz;
+
+        simulation.m_accumulatedSeconds += frameTimeSeconds;
+        const double owedSteps = simulation.m_accumulatedSeconds * rate;
+
+        simulation.m_stats.m_stepsBehind = static_cast<float>(owedSteps);
+        simulation.m_stats.m_stepsLastFrame = 0;
+        simulation.m_stats.m_lastFrameWorkMs = 0.0f;
+        simulation.m_stepsDue
+              = static_cast<uint32_t>(std::min(std::floor(owedSteps), double(m_maxCatchUpSteps)));
+
+        if (simulation.m_stepsDue > 0) {
+            dueSimulations.push_back(&simulation);
+        }
+    }
+
+    // Hand out the simulations that are furthest behind first
+    std::stable_sort(dueSimulations.begin(), dueSimulations.end(),
+          [](const ScheduledSimulation *pLhs, const ScheduledSimulation *pRhs) {
+              return pLhs->m_stats.m_stepsBehind > pRhs->m_stats.m_stepsBehind;
+          });
+
+    m_frameOrder.clear();
+    for (const ScheduledSimulation *pSimulation : dueSimulations) {
+        m_frameOrder.push_back(pSimulation->m_simulationId);
+    }
+
+    if (!dueSimulations.empty()) {
+        EnsureWorkers();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_frameJobs = std::move(dueSimulations);
+        m_nextJob = 0;
+        m_jobsRemaining = static_cast<uint32_t>(m_frameJobs.size());
+        m_frameIdx++;
+        m_workAvailable.notify_all();
+
+        m_workFinished.wait(lock, [this]() { return m_jobsRemaining == 0; });
+        m_frameJobs.clear();
+    }
+
+    // Achieved rates are measured over roughly one second of wall time
+    const auto now = std::chrono::steady_clock::now();
+    for (auto &[simulationId, upSimulation] : m_simulations) {
+        ScheduledSimulation &simulation = *upSimulation;
+        const std::chrono::duration<double> windowLength = now - simulation.m_windowStart;
+        if (windowLength.count() >= 1.0) {
+            simulation.m_stats.m_achievedRateHz
+                  = static_cast<float>(simulation.m_windowSteps / windowLength.count());
+            simulation.m_windowSteps = 0;
+            simulation.m_windowStart = now;
+        }
+    }
+
+    return m_frameOrder;
+}
+
+const SimulationScheduler::SimulationStats &SimulationScheduler::GetStats(
+      const std::string &simulationId) const
+{
+    return m_simulations.at(simulationId)->m_stats;
+}
+
+void SimulationScheduler::Gui()
+{
+    for (auto &[simulationId, upSimulation] : m_simulations) {
+        SimulationStats &stats = upSimulation->m_stats;
+
+        ImGui::PushID(simulationId.c_str());
+        ImGui::Text("%s: %.2f / %.2f Hz, %u steps, %.3f ms", simulationId.c_str(),
+              stats.m_achievedRateHz, stats.m_targetRateHz, stats.m_stepsLastFrame,
+              stats.m_lastFrameWorkMs);
+        ImGui::SliderFloat("Target Rate (Hz)", &stats.m_targetRateHz, 0.5f, 120.0f, "%.1f");
+        ImGui::SliderFloat("Frame Budget (ms)", &stats.m_frameBudgetMs, 0.5f, 33.0f, "%.1f");
+        ImGui::PopID();
+    }
+}
+
+void SimulationScheduler::EnsureWorkers()
+{
+    const uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t desiredWorkers = std::min<size_t>(m_simulations.size(), hardwareThreads);
+
+    while (m_workers.size() < desiredWorkers) {
+        m_workers.emplace_back(&SimulationScheduler::WorkerLoop, this);
+    }
+}
+
+void SimulationScheduler::WorkerLoop()
+{
+    uint64_t lastFrameIdx = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_workAvailable.wait(
+              lock, [this, &lastFrameIdx]() { return m_shutdown || m_frameIdx != lastFrameIdx; });
+        if (m_shutdown) {
+            return;
+        }
+        lastFrameIdx = m_frameIdx;
+
+        while (m_nextJob < m_frameJobs.size()) {
+            ScheduledSimulation *pSimulation = m_frameJobs[m_nextJob++];
+
+            lock.unlock();
+            RunSimulation(*pSimulation);
+            lock.lock();
+
+            m_jobsRemaining--;
+            if (m_jobsRemaining == 0) {
+                m_workFinished.notify_one();
+            }
+        }
+    }
+}
+
+void SimulationScheduler::RunSimulation(ScheduledSimulation &simulation)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const double budgetMs = simulation.m_stats.m_frameBudgetMs;
+    const double rate = simulation.m_stats.m_targetRateHz;
+
+    uint32_t stepsTaken = 0;
+    double elapsedMs = 0.0;
+    while (stepsTaken < simulation.m_stepsDue) {
+        if (!simulation.m_stepFunction()) {
+            FARLOR_LOG_WARNING("Simulation {} failed to step", simulation.m_simulationId);
+            break;
+        }
+        stepsTaken++;
+
+        elapsedMs = std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - start)
+                          .count();
+        if (elapsedMs >= budgetMs) {
+            break;
+        }
+    }
+
+    // Drop whatever backlog could never be caught up on so a slow frame does not snowball
+    simulation.m_accumulatedSeconds -= stepsTaken / rate;
+    simulation.m_accumulatedSeconds
+          = std::min(simulation.m_accumulatedSeconds, m_maxCatchUpSteps / rate);
+
+    simulation.m_windowSteps += stepsTaken;
+    simulation.m_stats.m_stepsLastFrame = stepsTaken;
+    simulation.m_stats.m_lastFrameWorkMs = static_cast<float>(elapsedMs);
+    simulation.m_stats.m_totalSteps += stepsTaken;
+}
+
+}
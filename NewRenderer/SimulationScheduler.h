@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Farlor {
+
+// Steps independent simulations at their own target rates. Each simulation is identified by its
+// simulation id, owns a per-frame time budget, and is stepped on a worker thread. Simulations that
+// have fallen furthest behind their target rate are handed to the workers first.
+class SimulationScheduler {
+   public:
+    using StepFunction = std::function<bool()>;
+
+    struct SimulationStats {
+        float m_targetRateHz = 0.0f;
+        float m_frameBudgetMs = 0.0f;
+        float m_achievedRateHz = 0.0f;
+        float m_stepsBehind = 0.0f;
+        float m_lastFrameWorkMs = 0.0f;
+        uint32_t m_stepsLastFrame = 0;
+        uint64_t m_totalSteps = 0;
+    };
+
+   public:
+    explicit SimulationScheduler(uint32_t maxCatchUpSteps = 4);
+    ~SimulationScheduler();
+
+    void RegisterSimulation(const std::string &simulationId, float targetRateHz,
+          float frameBudgetMs, StepFunction stepFunction);
+
+    void SetTargetRate(const std::string &simulationId, float targetRateHz);
+    void SetFrameBudget(const std::string &simulationId, float frameBudgetMs);
+
+    // Advances every simulation by frameTimeSeconds of wall time, running the steps that are due
+    // on the worker threads. Returns once every worker has finished its share of the frame. The
+    // returned ids are the simulations that stepped this frame, most behind first.
+    const std::vector<std::string> &Tick(float frameTimeSeconds);
+
+    const SimulationStats &GetStats(const std::string &simulationId) const;
+
+    void Gui();
+
+   private:
+    struct ScheduledSimulation {
+        std::string m_simulationId = "";
+        StepFunction m_stepFunction;
+
+        // Wall time not yet simulated, in seconds
+        double m_accumulatedSeconds = 0.0;
+        uint32_t m_stepsDue = 0;
+
+        uint32_t m_windowSteps = 0;
+        std::chrono::steady_clock::time_point m_windowStart;
+
+        SimulationStats m_stats;
+    };
+
+    SimulationScheduler(const SimulationScheduler &);  // Prevent copies
+    SimulationScheduler &operator=(const SimulationScheduler &);
+
+    void EnsureWorkers();
+    void WorkerLoop();
+    void RunSimulation(ScheduledSimulation &simulation);
+
+   private:
+    uint32_t m_maxCatchUpSteps = 4;
+
+    std::map<std::string, std::unique_ptr<ScheduledSimulation>> m_simulations;
+
+    // Jobs for the current frame, sorted most behind first
+    std::vector<ScheduledSimulation *> m_frameJobs;
+    std::vector<std::string> m_frameOrder;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workFinished;
+    uint64_t m_frameIdx = 0;
+    uint32_t m_nextJob = 0;
+    uint32_t m_jobsRemaining = 0;
+    bool m_shutdown = false;
+};
+
+}
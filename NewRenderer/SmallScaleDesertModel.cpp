@@ -222,7 +222,7 @@ void SmallScaleDesertModel::FirstFrameSetup(
     }
 }
 
-bool SmallScaleDesertModel::StepDesertSimulation(
+void SmallScaleDesertModel::ProcessPendingRequests(
       ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf)
 {
     if (m_resetRequested) {
@@ -230,7 +230,11 @@ bool SmallScaleDesertModel::StepDesertSimulation(
         Reset(pDeviceContext);
         pPerf->EndEvent();
     }
+}
 
+bool SmallScaleDesertModel::StepDesertSimulation(
+      ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf)
+{
     if (!m_stepSimulation) {
         return true;
     }
@@ -52,6 +52,9 @@ class SmallScaleDesertModel {
           ID3D11DeviceContext *const pDeviceContext, const std::vector<float> &initialSandHeights,
           const std::vector<float> &initialBedrockHeights,
           const std::vector<float> &initialVegitation);
+    // Handles reset and readback requests. Must run on the immediate context.
+    void ProcessPendingRequests(
+          ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf);
     bool StepDesertSimulation(
           ID3D11DeviceContext *const pDeviceContext, ID3DUserDefinedAnnotation *const pPerf);
 
@@ -60,6 +63,7 @@ class SmallScaleDesertModel {
 
     void Gui();
 
+    const std::string &GetSimulationId() const { return m_simulationId; }
     uint32_t GetGridResolution() const { return m_gridResolution; }
     float GetCellSizeMeters() const { return m_cellSizeMeters; }
 
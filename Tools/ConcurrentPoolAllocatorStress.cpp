@@ -0,0 +1,235 @@
+#include "../Core/Memory/ConcurrentPoolAllocator.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+using Farlor::ConcurrentPoolAllocator;
+
+namespace {
+
+// Every word of a live object is stamped with its owner and sequence number, so two threads
+// handed the same object, or a free list node written over a live one, show up on the next check
+struct Object {
+    static constexpr uint32_t NumWords = 8;
+    uint64_t words[NumWords];
+
+    void Stamp(const uint64_t value)
+    {
+        for (uint32_t wordIdx = 0; wordIdx < NumWords; wordIdx++) {
+            words[wordIdx] = value ^ (uint64_t(wordIdx) * 0x9E3779B97F4A7C15ull);
+        }
+    }
+
+    bool Check(const uint64_t value) const
+    {
+        for (uint32_t wordIdx = 0; wordIdx < NumWords; wordIdx++) {
+            if (words[wordIdx] != (value ^ (uint64_t(wordIdx) * 0x9E3779B97F4A7C15ull))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct Live {
+    Object *pObject;
+    uint64_t stamp;
+};
+
+// Objects handed between threads, so most frees happen on a thread other than the allocating one
+struct Mailbox {
+    std::mutex mutex;
+    std::vector<Live> objects;
+};
+
+struct Pool {
+    explicit Pool(const uint32_t numObjects)
+        : memory(size_t(numObjects) * sizeof(Object) + alignof(Object))
+        , allocator(sizeof(Object), alignof(Object), memory.size(), memory.data())
+    {
+    }
+
+    std::vector<uint8_t> memory;
+    ConcurrentPoolAllocator allocator;
+};
+
+bool RunStress(const uint32_t numThreads, const uint32_t opsPerThread)
+{
+    const uint32_t numObjects = numThreads * 256;
+    Pool pool(numObjects);
+    Mailbox mailbox;
+    std::atomic<uint64_t> numErrors = 0;
+    std::atomic<uint64_t> numCrossThreadFrees = 0;
+
+    const auto worker = [&](const uint32_t threadIdx) {
+        std::mt19937 rng(threadIdx + 1);
+        std::vector<Live> owned;
+        uint64_t seq = 0;
+
+        const auto freeChecked = [&](const Live &live) {
+            if (!live.pObject->Check(live.stamp)) {
+                numErrors++;
+            }
+            pool.allocator.Deallocate(live.pObject);
+        };
+
+        for (uint32_t opIdx = 0; opIdx < opsPerThread; opIdx++) {
+            const uint32_t action = rng() % 8;
+            if ((action < 4) && (owned.size() < 192)) {
+                Object *pObject
+                      = (Object *)pool.allocator.Allocate(sizeof(Object), alignof(Object));
+                if (pObject == nullptr) {
+                    continue;
+                }
+                const uint64_t stamp = (uint64_t(threadIdx) << 40) | seq++;
+                pObject->Stamp(stamp);
+                owned.push_back({ pObject, stamp });
+            } else if ((action < 6) && !owned.empty()) {
+                const size_t ownedIdx = rng() % owned.size();
+                freeChecked(owned[ownedIdx]);
+                owned[ownedIdx] = owned.back();
+                owned.pop_back();
+            } else if ((action == 6) && !owned.empty()) {
+                std::lock_guard<std::mutex> lock(mailbox.mutex);
+                mailbox.objects.push_back(owned.back());
+                owned.pop_back();
+            } else {
+                Live live = {};
+                {
+                    std::lock_guard<std::mutex> lock(mailbox.mutex);
+                    if (mailbox.objects.empty()) {
+                        continue;
+                    }
+                    live = mailbox.objects.back();
+                    mailbox.objects.pop_back();
+                }
+                freeChecked(live);
+                numCrossThreadFrees++;
+            }
+        }
+
+        for (const Live &live : owned) {
+            freeChecked(live);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t threadIdx = 0; threadIdx < numThreads; threadIdx++) {
+        threads.emplace_back(worker, threadIdx);
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    for (const Live &live : mailbox.objects) {
+        if (!live.pObject->Check(live.stamp)) {
+            numErrors++;
+        }
+        pool.allocator.Deallocate(live.pObject);
+    }
+
+    // The workers have exited and returned their magazines, so every object must be free again
+    // and handed out exactly once
+    std::set<Object *> objects;
+    while (Object *pObject = (Object *)pool.allocator.Allocate(sizeof(Object), alignof(Object))) {
+        if (!objects.insert(pObject).second) {
+            numErrors++;
+            break;
+        }
+    }
+    const bool allReturned = objects.size() == numObjects;
+    for (Object *pObject : objects) {
+        pool.allocator.Deallocate(pObject);
+    }
+    pool.allocator.FlushThreadCache();
+
+    std::printf("Stress %2u threads: %u ops each, %llu cross thread frees, %zu of %u objects "
+                "returned, %llu errors\n",
+          numThreads, opsPerThread, (unsigned long long)numCrossThreadFrees.load(), objects.size(),
+          numObjects, (unsigned long long)numErrors.load());
+    return allReturned && (numErrors == 0);
+}
+
+// Each thread allocates a batch and frees it again, the pattern of a job working on temporary
+// nodes. Reports the throughput of alloc + free pairs over all threads.
+void RunBenchmark(const uint32_t numThreads, const uint32_t pairsPerThread)
+{
+    // Room for each thread's batch plus the two magazines it may keep parked, twice over
+    const uint32_t BatchSize = 16;
+    const uint32_t numObjects
+          = 2 * numThreads * (BatchSize + 2 * ConcurrentPoolAllocator::MagazineSize);
+    Pool pool(numObjects);
+    std::atomic<uint32_t> numReady = 0;
+    std::atomic<bool> start = false;
+
+    const auto worker = [&]() {
+        Object *pBatch[BatchSize];
+        numReady++;
+        while (!start.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+
+        for (uint32_t pairIdx = 0; pairIdx < pairsPerThread; pairIdx += BatchSize) {
+            for (uint32_t batchIdx = 0; batchIdx < BatchSize; batchIdx++) {
+                pBatch[batchIdx]
+                      = (Object *)pool.allocator.Allocate(sizeof(Object), alignof(Object));
+                pBatch[batchIdx]->words[0] = pairIdx;
+            }
+            for (uint32_t batchIdx = 0; batchIdx < BatchSize; batchIdx++) {
+                pool.allocator.Deallocate(pBatch[batchIdx]);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t threadIdx = 0; threadIdx < numThreads; threadIdx++) {
+        threads.emplace_back(worker);
+    }
+    while (numReady.load() < numThreads) {
+        std::this_thread::yield();
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    const double seconds
+          = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    const double totalPairs = double(numThreads) * pairsPerThread;
+    std::printf("Benchmark %2u threads: %8.2f M pairs/s, %6.2f ns per pair per thread\n",
+          numThreads, totalPairs / seconds * 1e-6, seconds * 1e9 / pairsPerThread);
+}
+
+}
+
+// Stress test and thread scaling benchmark for ConcurrentPoolAllocator. Call as
+// ConcurrentPoolAllocatorStress [max_threads] [ops_per_thread]. Returns non zero if the stress
+// test finds a corrupted, duplicated or lost object.
+int main(int argc, char *argv[])
+{
+    const uint32_t maxThreads = (argc > 1) ? uint32_t(std::atoi(argv[1])) : 64;
+    const uint32_t opsPerThread = (argc > 2) ? uint32_t(std::atoi(argv[2])) : 1000000;
+
+    std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+
+    bool passed = true;
+    for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        passed = RunStress(numThreads, opsPerThread / 4) && passed;
+    }
+    for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        RunBenchmark(numThreads, opsPerThread);
+    }
+
+    std::printf(passed ? "Stress test passed\n" : "Stress test FAILED\n");
+    return passed ? 0 : 1;
+}